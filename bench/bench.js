@@ -0,0 +1,244 @@
+#!/usr/bin/env node
+
+"use strict";
+
+// Throughput and latency benchmarks for the hot paths of node-mapnik.
+//
+// Every suite runs in a fresh child process per UV_THREADPOOL_SIZE, since the
+// size of the libuv threadpool is fixed once the first async job is queued.
+// Inside a child, as many operations are kept in flight as there are threads.
+//
+//   node bench/bench.js
+//   node bench/bench.js --suites blend,image-encode --threads 1,4 --iterations 500
+//   node bench/bench.js --output before.json
+//   node bench/bench.js --compare before.json
+
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+var child_process = require('child_process');
+
+var usage = 'usage: bench.js [--suites a,b] [--threads 1,2,4] [--iterations N] [--warmup N] [--output file.json] [--compare baseline.json]';
+
+var data = path.join(__dirname, '../test/data');
+var blend_fixtures = path.join(__dirname, '../test/blend-fixtures');
+
+// Each suite returns a function(callback) running one operation. Setup runs
+// once per child process and is not measured.
+var suites = {
+    'blend': function(mapnik) {
+        var images = [
+            fs.readFileSync(path.join(blend_fixtures, '1.png')),
+            fs.readFileSync(path.join(blend_fixtures, '2.png'))
+        ];
+        return function(callback) {
+            mapnik.blend(images, {reencode: true}, callback);
+        };
+    },
+    'blend-tinted-jpeg': function(mapnik) {
+        var images = [
+            {buffer: fs.readFileSync(path.join(blend_fixtures, '1a.png')), tint: {h: [0.5, 0.6], s: [0.2, 0.8]}},
+            {buffer: fs.readFileSync(path.join(blend_fixtures, '2a.png')), x: 10, y: 10}
+        ];
+        return function(callback) {
+            mapnik.blend(images, {width: 256, height: 256, format: 'jpeg'}, callback);
+        };
+    },
+    'vtile-composite': function(mapnik) {
+        var source = new mapnik.VectorTile(0, 0, 0);
+        source.setData(fs.readFileSync(path.join(data, 'v6-0_0_0.mvt')));
+        return function(callback) {
+            new mapnik.VectorTile(0, 0, 0).composite([source], {reencode: true}, callback);
+        };
+    },
+    'vtile-render': function(mapnik) {
+        var vtile = new mapnik.VectorTile(0, 0, 0);
+        vtile.setData(fs.readFileSync(path.join(data, 'v6-0_0_0.mvt')));
+        var xml = '<Map srs="epsg:3857" background-color="#000000">';
+        vtile.names().forEach(function(name) {
+            xml += '<Style name="' + name + '"><Rule>' +
+                   '<PolygonSymbolizer fill="rgba(120,160,200,0.5)" />' +
+                   '<LineSymbolizer stroke="rgb(200,160,120)" stroke-width="1" />' +
+                   '<DotSymbolizer width="5" fill="rgb(255,255,255)" />' +
+                   '</Rule></Style>' +
+                   '<Layer name="' + name + '" srs="epsg:3857"><StyleName>' + name + '</StyleName></Layer>';
+        });
+        xml += '</Map>';
+        var map = new mapnik.Map(256, 256);
+        map.fromStringSync(xml);
+        return function(callback) {
+            vtile.render(map, new mapnik.Image(256, 256), callback);
+        };
+    },
+    'image-encode': function(mapnik) {
+        var image = mapnik.Image.openSync(path.join(blend_fixtures, 'expected.png'));
+        return function(callback) {
+            image.encode('png8:m=h', callback);
+        };
+    },
+    'map-render': function(mapnik) {
+        mapnik.register_default_input_plugins();
+        var map = new mapnik.Map(512, 512);
+        map.loadSync(path.join(data, 'map.xml'));
+        map.zoomAll();
+        return function(callback) {
+            map.render(new mapnik.Image(512, 512), callback);
+        };
+    }
+};
+
+function parseArgs(argv) {
+    var args = {
+        suites: Object.keys(suites),
+        threads: [1, 4, os.cpus().length].filter(function(n, i, all) { return all.indexOf(n) === i; }),
+        iterations: 200,
+        warmup: 20
+    };
+    for (var i = 0; i < argv.length; ++i) {
+        var value = argv[i + 1];
+        switch (argv[i]) {
+        case '--suites': args.suites = value.split(','); ++i; break;
+        case '--threads': args.threads = value.split(',').map(Number); ++i; break;
+        case '--iterations': args.iterations = Number(value); ++i; break;
+        case '--warmup': args.warmup = Number(value); ++i; break;
+        case '--output': args.output = value; ++i; break;
+        case '--compare': args.compare = value; ++i; break;
+        case '--child': args.child = value; ++i; break;
+        default:
+            console.error(usage);
+            process.exit(1);
+        }
+    }
+    args.suites.forEach(function(name) {
+        if (!suites[name]) {
+            console.error('unknown suite "' + name + '", available: ' + Object.keys(suites).join(', '));
+            process.exit(1);
+        }
+    });
+    if (!(args.iterations > 0) || !(args.warmup >= 0) || args.threads.some(function(n) { return !(n > 0); })) {
+        console.error(usage);
+        process.exit(1);
+    }
+    return args;
+}
+
+function percentile(sorted, p) {
+    return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+// Runs `count` operations keeping `inflight` of them queued at any time and
+// calls back with the latency of each in milliseconds and the total wall time.
+function run(op, count, inflight, callback) {
+    var latencies = [];
+    var started = 0;
+    var done = 0;
+    var failed = false;
+    var start = process.hrtime.bigint();
+    function next() {
+        var t0 = process.hrtime.bigint();
+        ++started;
+        op(function(err) {
+            if (failed) return;
+            if (err) {
+                failed = true;
+                return callback(err);
+            }
+            latencies.push(Number(process.hrtime.bigint() - t0) / 1e6);
+            if (++done === count) {
+                return callback(null, latencies, Number(process.hrtime.bigint() - start) / 1e6);
+            }
+            if (started < count) next();
+        });
+    }
+    for (var i = 0; i < Math.min(inflight, count); ++i) next();
+}
+
+function runChild(args) {
+    var mapnik = require('../');
+    var threads = Number(process.env.UV_THREADPOOL_SIZE);
+    var op = suites[args.child](mapnik);
+    run(op, args.warmup || 1, threads, function(err) {
+        if (err) throw err;
+        run(op, args.iterations, threads, function(err, latencies, elapsed) {
+            if (err) throw err;
+            var sorted = latencies.slice().sort(function(a, b) { return a - b; });
+            var sum = sorted.reduce(function(a, b) { return a + b; }, 0);
+            process.stdout.write(JSON.stringify({
+                suite: args.child,
+                threads: threads,
+                iterations: args.iterations,
+                ops_per_sec: args.iterations / (elapsed / 1000),
+                mean_ms: sum / sorted.length,
+                p50_ms: percentile(sorted, 0.5),
+                p99_ms: percentile(sorted, 0.99),
+                min_ms: sorted[0],
+                max_ms: sorted[sorted.length - 1],
+                max_rss: process.memoryUsage().rss
+            }));
+        });
+    });
+}
+
+function metadata() {
+    var mapnik = require('../');
+    var git = null;
+    try {
+        git = child_process.execFileSync('git', ['rev-parse', 'HEAD'], {cwd: __dirname, stdio: ['ignore', 'pipe', 'ignore']}).toString().trim();
+    } catch (err) {
+        // not a checkout
+    }
+    return {
+        date: new Date().toISOString(),
+        git: git,
+        versions: mapnik.versions,
+        platform: process.platform,
+        arch: process.arch,
+        cpus: os.cpus().length,
+        cpu_model: os.cpus().length ? os.cpus()[0].model : null
+    };
+}
+
+function pad(value, width) {
+    value = String(value);
+    return value.length >= width ? value : new Array(width - value.length + 1).join(' ') + value;
+}
+
+function main(args) {
+    var baseline = {};
+    if (args.compare) {
+        JSON.parse(fs.readFileSync(args.compare, 'utf8')).results.forEach(function(r) {
+            baseline[r.suite + '@' + r.threads] = r;
+        });
+    }
+    var results = [];
+    console.log(pad('suite', 20) + pad('threads', 9) + pad('ops/sec', 12) + pad('p50 ms', 10) + pad('p99 ms', 10) +
+                (args.compare ? pad('vs base', 10) : ''));
+    args.suites.forEach(function(suite) {
+        args.threads.forEach(function(threads) {
+            var child_args = [__filename, '--child', suite, '--iterations', String(args.iterations), '--warmup', String(args.warmup)];
+            var env = Object.assign({}, process.env, {UV_THREADPOOL_SIZE: String(threads)});
+            var out = child_process.execFileSync(process.execPath, child_args, {env: env, stdio: ['ignore', 'pipe', 'inherit']});
+            var r = JSON.parse(out.toString());
+            results.push(r);
+            var line = pad(suite, 20) + pad(threads, 9) + pad(r.ops_per_sec.toFixed(1), 12) +
+                       pad(r.p50_ms.toFixed(2), 10) + pad(r.p99_ms.toFixed(2), 10);
+            var base = baseline[suite + '@' + threads];
+            if (base) {
+                var delta = (r.ops_per_sec / base.ops_per_sec - 1) * 100;
+                line += pad((delta >= 0 ? '+' : '') + delta.toFixed(1) + '%', 10);
+            }
+            console.log(line);
+        });
+    });
+    if (args.output) {
+        fs.writeFileSync(args.output, JSON.stringify({meta: metadata(), results: results}, null, 2) + '\n');
+        console.log('wrote ' + args.output);
+    }
+}
+
+var args = parseArgs(process.argv.slice(2));
+if (args.child) {
+    runChild(args);
+} else {
+    main(args);
+}
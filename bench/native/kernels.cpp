@@ -0,0 +1,374 @@
+// Native micro-benchmarks for the hot kernels behind mapnik.blend, Grid.encode,
+// VectorTile.query, VectorTile.toGeoJSON, VectorTile.addGeoJSON and
+// ProjTransform.forwardArray, without N-API or GC in the way.
+// Built by binding.gyp when configured with ENABLE_BENCHMARKS=true and meant
+// to be run from the repository root so the fixtures in test/ resolve:
+//
+//   ./build/Release/native_bench [filter]
+
+#include "blend_composite.hpp"
+#include "geojson_reader.hpp"
+#include "js_grid_utils.hpp"
+#include "mercator.hpp"
+#include "p2p_distance.hpp"
+#include "mapnik_vector_tile_geojson.hpp"
+#include "mapnik_vector_tile_query_index.hpp"
+
+// mapnik
+#include <mapnik/image.hpp>
+#include <mapnik/image_reader.hpp>
+#include <mapnik/grid/grid.hpp>
+#include <mapnik/feature.hpp>
+#include <mapnik/featureset.hpp>
+#include <mapnik/query.hpp>
+#include <mapnik/well_known_srs.hpp>
+// mapnik-vector-tile
+#include "vector_tile_config.hpp"
+#include "vector_tile_datasource_pbf.hpp"
+#include "vector_tile_load_tile.hpp"
+#include "vector_tile_merc_tile.hpp"
+
+// stl
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string filter;
+
+template <typename T>
+inline void keep(T const& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile(""
+                 :
+                 : "r,m"(value)
+                 : "memory");
+#else
+    static volatile T sink;
+    sink = value;
+#endif
+}
+
+// Runs fn() in batches that take at least 50ms, keeps the best of five
+// batches and reports the time per unit, e.g. per pixel or per feature.
+template <typename Fn>
+void run(std::string const& name, double units, char const* unit, Fn const& fn)
+{
+    if (!filter.empty() && name.find(filter) == std::string::npos) return;
+    using clock = std::chrono::steady_clock;
+    auto batch = [&](std::size_t reps) {
+        auto start = clock::now();
+        for (std::size_t i = 0; i < reps; ++i)
+        {
+            fn();
+        }
+        return std::chrono::duration<double, std::nano>(clock::now() - start).count();
+    };
+    std::size_t reps = 1;
+    while (batch(reps) < 50e6)
+    {
+        reps *= 2;
+    }
+    double best = std::numeric_limits<double>::max();
+    for (int sample = 0; sample < 5; ++sample)
+    {
+        best = std::min(best, batch(reps));
+    }
+    std::printf("%-36s %12.2f ns/%s\n", name.c_str(), best / reps / units, unit);
+}
+
+mapnik::image_rgba8 read_image(std::string const& filename)
+{
+    std::unique_ptr<mapnik::image_reader> reader(mapnik::get_image_reader(filename));
+    if (!reader) throw std::runtime_error("could not open " + filename);
+    mapnik::image_rgba8 image(reader->width(), reader->height());
+    reader->read(0, 0, image);
+    return image;
+}
+
+std::string read_file(std::string const& filename)
+{
+    std::ifstream stream(filename, std::ios::binary);
+    if (!stream) throw std::runtime_error("could not open " + filename);
+    return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+void bench_blend()
+{
+    // Two layers with partial transparency, the worst case for compositing.
+    mapnik::image_rgba8 const bottom = read_image("test/blend-fixtures/1a.png");
+    mapnik::image_rgba8 const top = read_image("test/blend-fixtures/2a.png");
+    int width = static_cast<int>(top.width());
+    int height = static_cast<int>(top.height());
+    double pixels = static_cast<double>(width) * height;
+    mapnik::image_rgba8 target(width, height);
+
+    run("blend/copy-baseline", pixels, "px", [&]() {
+        std::memcpy(target.data(), bottom.data(), bottom.size());
+        keep(target.data()[0]);
+    });
+    run("blend/composite-pixel", pixels, "px", [&]() {
+        std::memcpy(target.data(), bottom.data(), bottom.size());
+        for (int y = 0; y < height; ++y)
+        {
+            std::uint32_t* target_row = target.get_row(y);
+            std::uint32_t const* source_row = top.get_row(y);
+            for (int x = 0; x < width; ++x)
+            {
+                node_mapnik::Blend_CompositePixel(target_row[x], source_row[x]);
+            }
+        }
+        keep(target.data()[0]);
+    });
+    run(std::string("blend/composite-row-") + node_mapnik::Blend_CompositeKernel(), pixels, "px", [&]() {
+        std::memcpy(target.data(), bottom.data(), bottom.size());
+        for (int y = 0; y < height; ++y)
+        {
+            node_mapnik::Blend_CompositeRow(target.get_row(y), top.get_row(y), width);
+        }
+        keep(target.data()[0]);
+    });
+
+    // A fully opaque image is the worst case for the opacity scan.
+    mapnik::image_rgba8 opaque(width, height);
+    opaque.set(0xff336699);
+    run("blend/all-opaque", pixels, "px", [&]() {
+        keep(node_mapnik::Blend_AllOpaque(opaque.data(), opaque.width() * opaque.height()));
+    });
+}
+
+void bench_grid()
+{
+    // 256 features in 16px squares, as a polygon layer would paint them.
+    unsigned const size = 256;
+    mapnik::grid grid(size, size, "__id__");
+    mapnik::context_ptr ctx = std::make_shared<mapnik::context_type>();
+    for (mapnik::value_integer id = 1; id <= 256; ++id)
+    {
+        mapnik::feature_impl feature(ctx, id);
+        grid.add_feature(feature);
+    }
+    for (unsigned y = 0; y < size; ++y)
+    {
+        for (unsigned x = 0; x < size; ++x)
+        {
+            grid.data()(x, y) = 1 + (x / 16) + (y / 16) * 16;
+        }
+    }
+    for (unsigned resolution : {1u, 4u})
+    {
+        double cells = std::ceil(size / static_cast<double>(resolution)) * std::ceil(size / static_cast<double>(resolution));
+        run("grid/grid2utf-resolution-" + std::to_string(resolution), cells, "cell", [&]() {
+            std::vector<node_mapnik::grid_line_type> lines;
+            std::vector<mapnik::grid::lookup_type> key_order;
+            node_mapnik::grid2utf<mapnik::grid>(grid, lines, key_order, resolution);
+            keep(lines.size());
+        });
+    }
+}
+
+// Decodes every feature of every layer, as the query and GeoJSON paths do.
+template <typename Fn>
+std::size_t for_each_feature(mapnik::vector_tile_impl::merc_tile const& tile, Fn const& fn)
+{
+    std::size_t count = 0;
+    protozero::pbf_reader tile_msg = tile.get_reader();
+    while (tile_msg.next(mapnik::vector_tile_impl::Tile_Encoding::LAYERS))
+    {
+        protozero::pbf_reader layer_msg(tile_msg.get_message());
+        mapnik::vector_tile_impl::tile_datasource_pbf ds(layer_msg, tile.x(), tile.y(), tile.z());
+        mapnik::query q(ds.envelope());
+        for (auto const& item : ds.get_descriptor().get_descriptors())
+        {
+            q.add_property_name(item.get_name());
+        }
+        mapnik::featureset_ptr fs = ds.features(q);
+        if (!fs || mapnik::is_empty(fs)) continue;
+        while (mapnik::feature_ptr feature = fs->next())
+        {
+            fn(*feature);
+            ++count;
+        }
+    }
+    return count;
+}
+
+void bench_mercator()
+{
+    // A grid of positions over the whole mercator range.
+    std::size_t const count = 1 << 16;
+    std::vector<double> lonlat(2 * count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        lonlat[2 * i] = -180.0 + 360.0 * (i % 256) / 255.0;
+        lonlat[2 * i + 1] = -85.0 + 170.0 * (i / 256) / 255.0;
+    }
+    std::vector<double> merc(lonlat);
+    node_mapnik::lonlat_to_merc(merc.data(), count);
+    std::vector<double> coords(2 * count);
+
+    run("proj/lonlat2merc-scalar", count, "pt", [&]() {
+        coords = lonlat;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            mapnik::lonlat2merc(coords[2 * i], coords[2 * i + 1]);
+        }
+        keep(coords[0]);
+    });
+    run(std::string("proj/lonlat-to-merc-") + node_mapnik::mercator_kernel(), count, "pt", [&]() {
+        coords = lonlat;
+        node_mapnik::lonlat_to_merc(coords.data(), count);
+        keep(coords[0]);
+    });
+    run("proj/merc2lonlat-scalar", count, "pt", [&]() {
+        coords = merc;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            mapnik::merc2lonlat(coords[2 * i], coords[2 * i + 1]);
+        }
+        keep(coords[0]);
+    });
+    run(std::string("proj/merc-to-lonlat-") + node_mapnik::mercator_kernel(), count, "pt", [&]() {
+        coords = merc;
+        node_mapnik::merc_to_lonlat(coords.data(), count);
+        keep(coords[0]);
+    });
+}
+
+void bench_vector_tile()
+{
+    std::string const data = read_file("test/data/v4-10_131_242.mvt");
+    auto tile = std::make_shared<mapnik::vector_tile_impl::merc_tile>(131, 242, 10, 4096, 128);
+    mapnik::vector_tile_impl::merge_from_compressed_buffer(*tile, data.data(), data.size());
+
+    std::vector<mapnik::geometry::geometry<double>> geometries;
+    double features = static_cast<double>(for_each_feature(*tile, [&](mapnik::feature_impl const& feature) {
+        geometries.push_back(feature.get_geometry());
+    }));
+    if (features == 0) throw std::runtime_error("no features in fixture");
+
+    run("mvt/decode-features", features, "feature", [&]() {
+        keep(for_each_feature(*tile, [](mapnik::feature_impl const& feature) { keep(feature.id()); }));
+    });
+
+    // Query the center of the tile, like a click in the middle of a map.
+    mapnik::box2d<double> extent = tile->extent();
+    double x = extent.center().x;
+    double y = extent.center().y;
+    run("mvt/p2p-distance", features, "feature", [&]() {
+        for (auto const& geom : geometries)
+        {
+            keep(detail::path_to_point_distance(geom, x, y).distance);
+        }
+    });
+
+    std::vector<protozero::data_view> layers;
+    protozero::pbf_reader tile_msg = tile->get_reader();
+    while (tile_msg.next(mapnik::vector_tile_impl::Tile_Encoding::LAYERS))
+    {
+        layers.push_back(tile_msg.get_view());
+    }
+    run("mvt/query-index-build", features, "feature", [&]() {
+        for (auto const& layer : layers)
+        {
+            keep(node_mapnik::layer_query_index(layer).size());
+        }
+    });
+    std::vector<std::shared_ptr<node_mapnik::layer_query_index const>> indexes;
+    for (auto const& layer : layers)
+    {
+        indexes.push_back(std::make_shared<node_mapnik::layer_query_index const>(layer));
+    }
+    run("mvt/query-index-lookup", static_cast<double>(indexes.size()), "layer", [&]() {
+        std::vector<std::uint32_t> result;
+        for (auto const& index : indexes)
+        {
+            double center = index->extent() / 2.0;
+            result.clear();
+            index->query(center - 1, center - 1, center + 1, center + 1, result);
+            keep(index->subset(result).size());
+        }
+    });
+
+    run("mvt/layer-to-geojson", features, "feature", [&]() {
+        std::string result;
+        node_mapnik::write_geojson_all(result, tile);
+        keep(result.size());
+    });
+    node_mapnik::geojson_options tile_precision;
+    tile_precision.precision = node_mapnik::geojson_tile_precision;
+    run("mvt/layer-to-geojson-tile-precision", features, "feature", [&]() {
+        std::string result;
+        node_mapnik::write_geojson_all(result, tile, tile_precision);
+        keep(result.size());
+    });
+    // A quarter of the tile, around its center.
+    node_mapnik::geojson_options quarter;
+    {
+        double minx = extent.center().x - extent.width() / 4;
+        double miny = extent.center().y - extent.height() / 4;
+        double maxx = extent.center().x + extent.width() / 4;
+        double maxy = extent.center().y + extent.height() / 4;
+        mapnik::merc2lonlat(minx, miny);
+        mapnik::merc2lonlat(maxx, maxy);
+        quarter.bbox.init(minx, miny, maxx, maxy);
+    }
+    run("mvt/layer-to-geojson-bbox", features, "feature", [&]() {
+        std::string result;
+        node_mapnik::write_geojson_all(result, tile, quarter);
+        keep(result.size());
+    });
+    run("mvt/layer-to-geojson-stream", features, "feature", [&]() {
+        node_mapnik::geojson_stream stream(tile, false);
+        std::string chunk;
+        std::size_t size = 0;
+        bool more = true;
+        while (more)
+        {
+            chunk.clear();
+            more = stream.next(chunk, 1000);
+            size += chunk.size();
+        }
+        keep(size);
+    });
+
+    // Read back what toGeoJSON writes for the fixture.
+    std::string geojson;
+    node_mapnik::write_geojson_all(geojson, tile);
+    run("geojson/read-features", features, "feature", [&]() {
+        auto ds = node_mapnik::read_geojson(geojson.data(), geojson.size());
+        if (!ds) throw std::runtime_error("fixture GeoJSON not read");
+        keep(ds->size());
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) filter = argv[1];
+    try
+    {
+        bench_blend();
+        bench_grid();
+        bench_mercator();
+        bench_vector_tile();
+    }
+    catch (std::exception const& ex)
+    {
+        std::fprintf(stderr, "error: %s (run from the repository root)\n", ex.what());
+        return 1;
+    }
+    return 0;
+}
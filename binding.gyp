@@ -2,6 +2,7 @@
   'includes': [ 'common.gypi' ],
   'variables': {
       'ENABLE_GLIBC_WORKAROUND%':'false', # can be overriden by a command line variable because of the % sign
+      'ENABLE_BENCHMARKS%':'false', # builds the native_bench executable from bench/native
   },
   'targets': [
     {
@@ -10,6 +11,7 @@
         "src/mapnik_logger.cpp",
         "src/node_mapnik.cpp",
         "src/blend.cpp",
+        "src/blend_composite.cpp",
         "src/mapnik_map.cpp",
         "src/mapnik_map_load.cpp",
         "src/mapnik_map_from_string.cpp",
@@ -45,13 +47,19 @@
         "src/mapnik_vector_tile.cpp",
         "src/mapnik_vector_tile_data.cpp",
         "src/mapnik_vector_tile_query.cpp",
+        "src/mapnik_vector_tile_query_index.cpp",
         "src/mapnik_vector_tile_json.cpp",
+        "src/mapnik_vector_tile_geojson.cpp",
+        "src/geojson_reader.cpp",
         "src/mapnik_vector_tile_info.cpp",
         "src/mapnik_vector_tile_simple_valid.cpp",
         "src/mapnik_vector_tile_render.cpp",
         "src/mapnik_vector_tile_clear.cpp",
         "src/mapnik_vector_tile_image.cpp",
         "src/mapnik_vector_tile_composite.cpp",
+        "src/projection_cache.cpp",
+        "src/thread_pool.cpp",
+        "src/mercator.cpp",
         "deps/mapnik-vector-tile/src/vector_tile_compression.cpp",
         "deps/mapnik-vector-tile/src/vector_tile_datasource_pbf.cpp",
         "deps/mapnik-vector-tile/src/vector_tile_featureset_pbf.cpp",
@@ -145,5 +153,71 @@
         ]
       ]
     },
+  ],
+  'conditions': [
+    ['ENABLE_BENCHMARKS != "false" and OS!="win"', {
+      'targets': [
+        {
+          'target_name': 'native_bench',
+          'type': 'executable',
+          'sources': [
+            "bench/native/kernels.cpp",
+            "src/blend_composite.cpp",
+            "src/geojson_reader.cpp",
+            "src/mapnik_vector_tile_geojson.cpp",
+            "src/mapnik_vector_tile_query_index.cpp",
+            "src/projection_cache.cpp",
+            "src/mercator.cpp",
+            "deps/mapnik-vector-tile/src/vector_tile_compression.cpp",
+            "deps/mapnik-vector-tile/src/vector_tile_datasource_pbf.cpp",
+            "deps/mapnik-vector-tile/src/vector_tile_featureset_pbf.cpp",
+            "deps/mapnik-vector-tile/src/vector_tile_geometry_decoder.cpp",
+            "deps/mapnik-vector-tile/src/vector_tile_geometry_encoder_pbf.cpp",
+            "deps/mapnik-vector-tile/src/vector_tile_layer.cpp",
+            "deps/mapnik-vector-tile/src/vector_tile_processor.cpp",
+            "deps/mapnik-vector-tile/src/vector_tile_raster_clipper.cpp",
+            "deps/mapnik-vector-tile/src/vector_tile_tile.cpp"
+          ],
+          'include_dirs': [
+            './src',
+            "<!@(node -p \"require('node-addon-api').include\")",
+            "./deps/geometry/include/",
+            "./deps/protozero/include/",
+            "./deps/wagyu/include/",
+            "./deps/mapnik-vector-tile/src"
+          ],
+          'defines': [
+            'MAPNIK_VECTOR_TILE_LIBRARY=1',
+          ],
+          'cflags_cc!': ['-fno-rtti', '-fno-exceptions'],
+          'cflags_cc' : [
+            '<!@(mapnik-config --cflags)',
+          ],
+          'libraries':[
+            '<!@(mapnik-config --libs)',
+            '-lmapnik-wkt',
+            '-lmapnik-json',
+            '<!@(mapnik-config --ldflags)',
+            '<!@(mapnik-config --dep-libs)'
+          ],
+          'conditions': [
+            ['"<!@(uname -p)"=="x86_64"',{
+              'defines' : [ 'SSE_MATH' ]
+            }]
+          ],
+          'xcode_settings': {
+            'OTHER_CPLUSPLUSFLAGS':[
+              '<!@(mapnik-config --cflags)',
+            ],
+            'GCC_ENABLE_CPP_RTTI': 'YES',
+            'GCC_ENABLE_CPP_EXCEPTIONS': 'YES',
+            'MACOSX_DEPLOYMENT_TARGET':'11',
+            'CLANG_CXX_LIBRARY': 'libc++',
+            'CLANG_CXX_LANGUAGE_STANDARD':'c++20',
+            'GCC_VERSION': 'com.apple.compilers.llvm.clang.1_0'
+          }
+        }
+      ]
+    }]
   ]
 }
@@ -1,4 +1,5 @@
 #include <mapnik/image.hpp>
+#include <mapnik/image_any.hpp>
 #include <mapnik/version.hpp>
 #include <mapnik/image_reader.hpp>
 #include <mapnik/safe_cast.hpp>
@@ -21,14 +22,23 @@
 
 #include "mapnik_palette.hpp"
 #include "blend.hpp"
+#include "blend_composite.hpp"
+#include "thread_pool.hpp"
 #include "tint.hpp"
 #include "utils.hpp"
 
+#include <algorithm>
 #include <sstream>
 #include <cstring>
 #include <cstdlib>
 #include <memory>
 #include <iostream>
+#include <atomic>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <exception>
+#include <stdexcept>
 
 namespace node_mapnik {
 
@@ -171,41 +181,6 @@ static bool parseTintOps(Napi::CallbackInfo const& info, Napi::Object const& tin
     return true;
 }
 
-static inline void Blend_CompositePixel(std::uint32_t& target, std::uint32_t const& source)
-{
-    if (source <= 0x00FFFFFF)
-    {
-        // Top pixel is fully transparent.
-        // <do nothing>
-    }
-    else if (source >= 0xFF000000 || target <= 0x00FFFFFF)
-    {
-        // Top pixel is fully opaque or bottom pixel is fully transparent.
-        target = source;
-    }
-    else
-    {
-        // Both pixels have transparency.
-        // From http://trac.mapnik.org/browser/trunk/include/mapnik/graphics.hpp#L337
-        long a1 = (source >> 24) & 0xff;
-        long r1 = source & 0xff;
-        long g1 = (source >> 8) & 0xff;
-        long b1 = (source >> 16) & 0xff;
-
-        long a0 = (target >> 24) & 0xff;
-        long r0 = (target & 0xff) * a0;
-        long g0 = ((target >> 8) & 0xff) * a0;
-        long b0 = ((target >> 16) & 0xff) * a0;
-
-        a0 = ((a1 + a0) << 8) - a0 * a1;
-        r0 = ((((r1 << 8) - r0) * a1 + (r0 << 8)) / a0);
-        g0 = ((((g1 << 8) - g0) * a1 + (g0 << 8)) / a0);
-        b0 = ((((b1 << 8) - b0) * a1 + (b0 << 8)) / a0);
-        a0 = a0 >> 8;
-        target = (a0 << 24) | (b0 << 16) | (g0 << 8) | (r0);
-    }
-}
-
 static inline void TintPixel(std::uint32_t& r,
                              std::uint32_t& g,
                              std::uint32_t& b,
@@ -227,48 +202,117 @@ static inline void TintPixel(std::uint32_t& r,
     hsl_to_rgb(h2, s2, l2, r, g, b);
 }
 
-static void Blend_Composite(int width_, int height_, std::uint32_t* target, BImage* image)
+// Lookup tables for a single Tinter. The alpha table is computed up front.
+// Tinted colors are memoized in a direct-mapped table which is filled lazily
+// as colors are encountered: each slot packs a valid bit, the 24 bit source
+// color and the 24 bit tinted color into one atomic word, so a table can be
+// shared by concurrent blend jobs and every lookup is exact.
+class TintTable
+{
+  public:
+    static constexpr std::size_t color_slots = 1 << 16;
+
+    explicit TintTable(Tinter const& tint)
+        : tint_(tint),
+          colors_(new std::atomic<std::uint64_t>[color_slots]())
+    {
+        for (std::uint32_t a = 0; a < 256; ++a)
+        {
+            double a2 = tint.a0 + (a / 255.0 * (tint.a1 - tint.a0));
+            if (a2 < 0) a2 = 0;
+            std::uint32_t a3 = static_cast<std::uint32_t>(std::floor((a2 * 255.0) + .5));
+            alpha_[a] = a3 > 255 ? 255 : a3;
+        }
+    }
+
+    Tinter const& tint() const { return tint_; }
+
+    std::uint32_t alpha(std::uint32_t a) const { return alpha_[a]; }
+
+    // Takes and returns a pixel's color as 0x00BBGGRR.
+    std::uint32_t color(std::uint32_t bgr) const
+    {
+        std::atomic<std::uint64_t>& slot = colors_[(bgr * 2654435761u) >> 16];
+        std::uint64_t entry = slot.load(std::memory_order_relaxed);
+        std::uint64_t key = (std::uint64_t(1) << 56) | (std::uint64_t(bgr) << 32);
+        if ((entry & 0xFFFFFFFF00000000ull) == key)
+        {
+            return static_cast<std::uint32_t>(entry);
+        }
+        std::uint32_t r = bgr & 0xff;
+        std::uint32_t g = (bgr >> 8) & 0xff;
+        std::uint32_t b = (bgr >> 16) & 0xff;
+        TintPixel(r, g, b, tint_);
+        std::uint32_t tinted = (b << 16) | (g << 8) | (r);
+        slot.store(key | tinted, std::memory_order_relaxed);
+        return tinted;
+    }
+
+  private:
+    Tinter tint_;
+    std::uint32_t alpha_[256];
+    std::unique_ptr<std::atomic<std::uint64_t>[]> colors_;
+};
+
+// Tint specs tend to repeat across blend calls, so the most recently used
+// tables are kept around and shared.
+static std::shared_ptr<TintTable const> Blend_TintTable(Tinter const& tint)
+{
+    static constexpr std::size_t max_tables = 8;
+    static std::mutex mutex;
+    static std::list<std::shared_ptr<TintTable const>> tables;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = tables.begin(); it != tables.end(); ++it)
+    {
+        if ((*it)->tint() == tint)
+        {
+            tables.splice(tables.begin(), tables, it);
+            return tables.front();
+        }
+    }
+    tables.push_front(std::make_shared<TintTable const>(tint));
+    if (tables.size() > max_tables) tables.pop_back();
+    return tables.front();
+}
+
+// Composites a decoded layer whose top left corner is at layerX/layerY of a
+// width_ x height_ canvas.
+static void Blend_Composite(int width_, int height_, std::uint32_t* target, BImage const& image, int layerX, int layerY)
 {
-    const std::uint32_t* source = image->im_raw_ptr->data();
+    const std::uint32_t* source = image.im_raw_ptr->data();
 
-    int sourceX = std::max(0, -image->x);
-    int sourceY = std::max(0, -image->y);
-    int sourcePos = sourceY * image->width + sourceX;
+    int sourceX = std::max(0, -layerX);
+    int sourceY = std::max(0, -layerY);
+    int sourcePos = sourceY * image.width + sourceX;
 
-    int width = image->width - sourceX - std::max(0, image->x + image->width - width_);
-    int height = image->height - sourceY - std::max(0, image->y + image->height - height_);
+    int width = image.width - sourceX - std::max(0, layerX + image.width - width_);
+    int height = image.height - sourceY - std::max(0, layerY + image.height - height_);
 
-    int targetX = std::max(0, image->x);
-    int targetY = std::max(0, image->y);
+    int targetX = std::max(0, layerX);
+    int targetY = std::max(0, layerY);
     int targetPos = targetY * width_ + targetX;
-    bool tinting = !image->tint.is_identity();
-    bool set_alpha = !image->tint.is_alpha_identity();
+    bool tinting = !image.tint.is_identity();
+    bool set_alpha = !image.tint.is_alpha_identity();
     if (tinting || set_alpha)
     {
+        // Tint one row at a time into a scratch buffer and composite it as a whole.
+        std::shared_ptr<TintTable const> table = Blend_TintTable(image.tint);
+        std::vector<std::uint32_t> row(static_cast<std::size_t>(std::max(0, width)));
         for (int y = 0; y < height; ++y)
         {
             for (int x = 0; x < width; ++x)
             {
-                std::uint32_t const& source_pixel = source[sourcePos + x];
-                std::uint32_t a = (source_pixel >> 24) & 0xff;
-                if (set_alpha)
-                {
-                    double a2 = image->tint.a0 + (a / 255.0 * (image->tint.a1 - image->tint.a0));
-                    if (a2 < 0) a2 = 0;
-                    a = static_cast<std::uint32_t>(std::floor((a2 * 255.0) + .5));
-                    if (a > 255) a = 255;
-                }
-                std::uint32_t r = source_pixel & 0xff;
-                std::uint32_t g = (source_pixel >> 8) & 0xff;
-                std::uint32_t b = (source_pixel >> 16) & 0xff;
+                std::uint32_t source_pixel = source[sourcePos + x];
+                std::uint32_t a = table->alpha((source_pixel >> 24) & 0xff);
+                std::uint32_t bgr = source_pixel & 0x00FFFFFF;
                 if (a > 1 && tinting)
                 {
-                    TintPixel(r, g, b, image->tint);
+                    bgr = table->color(bgr);
                 }
-                std::uint32_t new_pixel = (a << 24) | (b << 16) | (g << 8) | (r);
-                Blend_CompositePixel(target[targetPos + x], new_pixel);
+                row[x] = (a << 24) | bgr;
             }
-            sourcePos += image->width;
+            Blend_CompositeRow(target + targetPos, row.data(), width);
+            sourcePos += image.width;
             targetPos += width_;
         }
     }
@@ -276,44 +320,467 @@ static void Blend_Composite(int width_, int height_, std::uint32_t* target, BIma
     {
         for (int y = 0; y < height; ++y)
         {
-            for (int x = 0; x < width; ++x)
+            Blend_CompositeRow(target + targetPos, source + sourcePos, width);
+            sourcePos += image.width;
+            targetPos += width_;
+        }
+    }
+}
+
+// Upper bound for the `concurrency` option of mapnik.blend.
+static constexpr unsigned max_blend_concurrency = 16;
+
+// Bytes of decoded pixels that were never materialized because they fall
+// outside of the blend canvas, across all blend calls.
+static std::atomic<std::uint64_t> blend_decode_skipped_bytes(0);
+
+// Layers whose format has an alpha channel but which decoded to fully opaque
+// pixels, and opacity lookups answered by the BlendOpacityCache, across all
+// blend calls.
+static std::atomic<std::uint64_t> blend_opacity_detected(0);
+static std::atomic<std::uint64_t> blend_opacity_cache_hits(0);
+
+// Remembers the hashes of encoded layers that decode to fully opaque pixels
+// even though their format has an alpha channel, so that later blends can
+// drop the layers below them before decoding anything. The table is direct
+// mapped: a buffer landing in an occupied slot replaces the older entry.
+class BlendOpacityCache
+{
+  public:
+    static BlendOpacityCache& instance()
+    {
+        static BlendOpacityCache cache;
+        return cache;
+    }
+
+    bool contains(std::uint64_t hash) const
+    {
+        return hash != 0 && slots_[hash >> (64 - slot_bits)].load(std::memory_order_relaxed) == hash;
+    }
+
+    void insert(std::uint64_t hash)
+    {
+        if (hash != 0) slots_[hash >> (64 - slot_bits)].store(hash, std::memory_order_relaxed);
+    }
+
+    void clear()
+    {
+        for (auto& slot : slots_)
+        {
+            slot.store(0, std::memory_order_relaxed);
+        }
+    }
+
+  private:
+    static constexpr unsigned slot_bits = 12;
+    std::atomic<std::uint64_t> slots_[1 << slot_bits] = {};
+};
+
+// A layer whose header has been read and which still has to be decoded.
+// Only the window starting at x0/y0 of the image's width/height is decoded.
+// When `scan` is set the decoded pixels are checked for full opacity, and an
+// opaque layer that also `occludes` the canvas hides every job below it.
+// `hash` identifies the encoded buffer in the BlendOpacityCache, 0 if unknown.
+struct BlendDecodeJob
+{
+    BImage* image;
+    std::unique_ptr<mapnik::image_reader> reader;
+    unsigned x0;
+    unsigned y0;
+    std::uint64_t hash = 0;
+    bool scan = false;
+    bool occludes = false;
+    bool opaque = false;
+};
+
+// Decodes all jobs on at most `concurrency` threads. Jobs are ordered top to
+// bottom, so with a concurrency of 1 layers are decoded serially in the same
+// order as before. Once an occluding job turns out to be opaque the jobs below
+// it are not started anymore, and those that were already running are thrown
+// away, including their errors. `opaque_job` receives the index of the topmost
+// occluding opaque job, or jobs.size() if there is none.
+static bool Blend_DecodeLayers(std::vector<BlendDecodeJob>& jobs, unsigned concurrency, std::size_t& opaque_job)
+{
+    std::size_t const count = jobs.size();
+    // Jobs past `limit` are not needed: they are below an opaque layer or
+    // below a layer that failed to decode, which fails the whole blend.
+    std::atomic<std::size_t> limit(count);
+    std::atomic<std::size_t> opaque(count);
+    std::vector<char> failed(count, 0);
+    auto lower = [](std::atomic<std::size_t>& value, std::size_t i) {
+        std::size_t current = value.load();
+        while (i < current && !value.compare_exchange_weak(current, i))
+            ;
+    };
+    parallel_for(count, concurrency, [&](std::size_t i) {
+        if (i > limit) return;
+        BlendDecodeJob& job = jobs[i];
+        BImage* image = job.image;
+        try
+        {
+            auto im_ptr = std::make_unique<mapnik::image_rgba8>(image->width, image->height);
+            job.reader->read(job.x0, job.y0, *im_ptr);
+            if (job.scan)
             {
-                Blend_CompositePixel(target[targetPos + x], source[sourcePos + x]);
+                job.opaque = Blend_AllOpaque(im_ptr->data(), im_ptr->width() * im_ptr->height());
+                if (job.opaque)
+                {
+                    ++blend_opacity_detected;
+                    // Only remember buffers that were decoded in full.
+                    if (job.x0 == 0 && job.y0 == 0 &&
+                        im_ptr->width() == job.reader->width() && im_ptr->height() == job.reader->height())
+                    {
+                        BlendOpacityCache::instance().insert(job.hash);
+                    }
+                }
             }
-            sourcePos += image->width;
-            targetPos += width_;
+            image->im_ptr = std::move(im_ptr);
+            image->im_raw_ptr = image->im_ptr.get();
+        }
+        catch (std::exception const&)
+        {
+            failed[i] = 1;
+            lower(limit, i);
+            return;
+        }
+        if (job.opaque && job.occludes)
+        {
+            lower(opaque, i);
+            lower(limit, i);
+        }
+    });
+    opaque_job = opaque;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (i < opaque_job)
+        {
+            if (failed[i]) return false;
+        }
+        else if (i > opaque_job)
+        {
+            jobs[i].image->im_ptr.reset();
+            jobs[i].image->im_raw_ptr = nullptr;
+        }
+    }
+    return true;
+}
+
+// Process-wide LRU cache of encoded blend results, bounded by bytes. Keys
+// are built by AsyncBlend::CacheKey from the bytes of the input buffers plus
+// every option that affects the output, so that a hit never depends on a hash
+// alone. Keys count towards max_bytes. Disabled while max_bytes is 0.
+class BlendCache
+{
+  public:
+    static BlendCache& instance()
+    {
+        static BlendCache cache;
+        return cache;
+    }
+
+    bool enabled() const
+    {
+        return max_bytes_.load(std::memory_order_relaxed) > 0;
+    }
+
+    void set_max_bytes(std::size_t max_bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        max_bytes_ = max_bytes;
+        evict();
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lru_.clear();
+        index_.clear();
+        bytes_ = 0;
+    }
+
+    std::shared_ptr<std::string const> get(std::string const& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto itr = index_.find(key);
+        if (itr == index_.end())
+        {
+            ++misses_;
+            return nullptr;
+        }
+        ++hits_;
+        lru_.splice(lru_.begin(), lru_, itr->second);
+        return itr->second->second;
+    }
+
+    void put(std::string const& key, std::string const& value)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (key.size() + value.size() > max_bytes_ || index_.find(key) != index_.end()) return;
+        lru_.emplace_front(key, std::make_shared<std::string const>(value));
+        index_.emplace(key, lru_.begin());
+        bytes_ += key.size() + value.size();
+        evict();
+    }
+
+    void stats(Napi::Object& stats) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Napi::Env env = stats.Env();
+        stats.Set("cacheHits", Napi::Number::New(env, static_cast<double>(hits_)));
+        stats.Set("cacheMisses", Napi::Number::New(env, static_cast<double>(misses_)));
+        stats.Set("cacheEvictions", Napi::Number::New(env, static_cast<double>(evictions_)));
+        stats.Set("cacheEntries", Napi::Number::New(env, static_cast<double>(lru_.size())));
+        stats.Set("cacheBytes", Napi::Number::New(env, static_cast<double>(bytes_)));
+        stats.Set("cacheMaxBytes", Napi::Number::New(env, static_cast<double>(max_bytes_.load())));
+    }
+
+  private:
+    using entry = std::pair<std::string, std::shared_ptr<std::string const>>;
+
+    void evict()
+    {
+        while (bytes_ > max_bytes_ && !lru_.empty())
+        {
+            entry const& last = lru_.back();
+            bytes_ -= last.first.size() + last.second->size();
+            index_.erase(last.first);
+            lru_.pop_back();
+            ++evictions_;
+        }
+    }
+
+    mutable std::mutex mutex_;
+    std::atomic<std::size_t> max_bytes_{0};
+    std::size_t bytes_ = 0;
+    std::uint64_t hits_ = 0;
+    std::uint64_t misses_ = 0;
+    std::uint64_t evictions_ = 0;
+    std::list<entry> lru_;
+    std::unordered_map<std::string, std::list<entry>::iterator> index_;
+};
+
+// MurmurHash64A, used to fingerprint input buffers for the BlendOpacityCache.
+static std::uint64_t Blend_Hash(char const* data, std::size_t length)
+{
+    std::uint64_t const m = 0xc6a4a7935bd1e995ull;
+    int const r = 47;
+    std::uint64_t h = 0x9e3779b97f4a7c15ull ^ (length * m);
+    std::size_t blocks = length / 8;
+    for (std::size_t i = 0; i < blocks; ++i)
+    {
+        std::uint64_t k;
+        std::memcpy(&k, data + i * 8, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    if (length & 7)
+    {
+        std::uint64_t k = 0;
+        std::memcpy(&k, data + blocks * 8, length & 7);
+        h ^= k;
+        h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+template <typename T>
+static inline void Blend_AppendKey(std::string& key, T const& value)
+{
+    key.append(reinterpret_cast<char const*>(&value), sizeof(T));
+}
+
+// Output encoding options of a blend.
+struct BlendEncodeOptions
+{
+    BlendFormat format = BLEND_FORMAT_PNG;
+    int quality = 0;
+    int compression = -1;
+    AlphaMode mode = BLEND_MODE_HEXTREE;
+    palette_ptr palette;
+};
+
+// Encodes a blended image, throws on failure.
+static std::string Blend_Encode(mapnik::image_rgba8 const& image, bool alpha, BlendEncodeOptions const& options)
+{
+    std::ostringstream stream(std::ios::out | std::ios::binary);
+    if (options.format == BLEND_FORMAT_JPEG)
+    {
+#if defined(HAVE_JPEG)
+        mapnik::save_as_jpeg(stream, options.quality == 0 ? 85 : options.quality, image);
+#else
+        throw std::runtime_error("Mapnik not built with jpeg support");
+#endif
+    }
+    else if (options.format == BLEND_FORMAT_WEBP)
+    {
+#if defined(HAVE_WEBP)
+        WebPConfig config;
+        // Default values set here will be lossless=0 and quality=75 (as least as of webp v0.3.1)
+        if (!WebPConfigInit(&config))
+        {
+            // LCOV_EXCL_START
+            throw std::runtime_error("WebPConfigInit failed: version mismatch");
+            // LCOV_EXCL_STOP
+        }
+        // see for more details: https://github.com/mapnik/mapnik/wiki/Image-IO#webp-output-options
+        config.quality = options.quality == 0 ? 80 : options.quality;
+        if (options.compression > 0)
+        {
+            config.method = options.compression;
+        }
+        mapnik::save_as_webp(stream, image, config, alpha);
+#else
+        throw std::runtime_error("Mapnik not built with webp support");
+#endif
+    }
+    else
+    {
+        // Save as PNG.
+#if defined(HAVE_PNG)
+        mapnik::png_options opts;
+        opts.compression = options.compression;
+        if (options.palette && options.palette->valid())
+        {
+            mapnik::save_as_png8_pal(stream, image, *options.palette, opts);
+        }
+        else if (options.quality > 0)
+        {
+            opts.colors = options.quality;
+            // Paletted PNG.
+            if (alpha && options.mode == BLEND_MODE_HEXTREE)
+            {
+                mapnik::save_as_png8_hex(stream, image, opts);
+            }
+            else
+            {
+                mapnik::save_as_png8_oct(stream, image, opts);
+            }
+        }
+        else
+        {
+            mapnik::save_as_png(stream, image, opts);
         }
+#else
+        throw std::runtime_error("Mapnik not built with png support");
+#endif
     }
+    return stream.str();
 }
 
-struct AsyncBlend;
-static void Blend_Encode(AsyncBlend* worker, mapnik::image_rgba8 const& image, bool alpha);
+// Hands an encoded result over to JS without copying it.
+static Napi::Buffer<char> Blend_ToBuffer(Napi::Env env, std::unique_ptr<std::string> output)
+{
+    std::string& str = *output;
+    auto buffer = Napi::Buffer<char>::New(
+        env,
+        str.empty() ? nullptr : &str[0],
+        str.size(),
+        [](Napi::Env env_, char* /*unused*/, std::string* str_ptr) {
+            if (str_ptr != nullptr)
+            {
+                Napi::MemoryManagement::AdjustExternalMemory(env_, -static_cast<std::int64_t>(str_ptr->size()));
+            }
+            delete str_ptr;
+        },
+        output.release());
+    Napi::MemoryManagement::AdjustExternalMemory(env, static_cast<std::int64_t>(str.size()));
+    return buffer;
+}
 
 struct AsyncBlend : Napi::AsyncWorker
 {
     using Base = Napi::AsyncWorker;
-    AsyncBlend(Images const& images, int quality, int width, int height,
-               palette_ptr const& palette, unsigned matte, int compression,
-               AlphaMode mode, BlendFormat format, bool reencode,
+    AsyncBlend(Images const& images, int width, int height, unsigned matte,
+               BlendEncodeOptions const& encode_options, bool reencode,
+               unsigned concurrency, image_ptr const& target, bool encode,
                Napi::Function const& callback)
         : Base(callback),
           images_(images),
-          quality_(quality),
           width_(width),
           height_(height),
-          palette_(palette),
           matte_(matte),
-          compression_(compression),
-          mode_(mode),
-          format_(format),
-          reencode_(reencode)
+          encode_options_(encode_options),
+          reencode_(reencode),
+          concurrency_(concurrency),
+          target_(target),
+          encode_(encode)
     {
     }
 
     void Execute() override
+    {
+        BlendCache& cache = BlendCache::instance();
+        std::string cache_key;
+        if (cache.enabled() && CacheKey(cache_key))
+        {
+            if (auto cached = cache.get(cache_key))
+            {
+                output_buffer_ = std::make_unique<std::string>(*cached);
+                return;
+            }
+        }
+        Blend();
+        if (!cache_key.empty() && output_buffer_ && !failed_)
+        {
+            cache.put(cache_key, *output_buffer_);
+        }
+    }
+
+    // Builds the cache key for this job. Jobs with mapnik.Image inputs or
+    // outputs are not cached since those pixels can change between calls.
+    bool CacheKey(std::string& key) const
+    {
+        if (!encode_) return false;
+        for (auto const& image : images_)
+        {
+            if (image->im_obj) return false;
+            Blend_AppendKey(key, image->dataLength);
+            key.append(image->data, image->dataLength);
+            Blend_AppendKey(key, image->x);
+            Blend_AppendKey(key, image->y);
+            Blend_AppendKey(key, image->tint);
+        }
+        palette_ptr const& palette = encode_options_.palette;
+        Blend_AppendKey(key, images_.size());
+        Blend_AppendKey(key, encode_options_.quality);
+        Blend_AppendKey(key, width_);
+        Blend_AppendKey(key, height_);
+        Blend_AppendKey(key, matte_);
+        Blend_AppendKey(key, encode_options_.compression);
+        Blend_AppendKey(key, encode_options_.mode);
+        Blend_AppendKey(key, encode_options_.format);
+        Blend_AppendKey(key, reencode_);
+        if (palette)
+        {
+            for (mapnik::rgb const& color : palette->palette())
+            {
+                key.push_back(static_cast<char>(color.r));
+                key.push_back(static_cast<char>(color.g));
+                key.push_back(static_cast<char>(color.b));
+            }
+#if MAPNIK_VERSION >= 300012
+            for (unsigned alpha : palette->alpha_table())
+#else
+            for (unsigned alpha : palette->alphaTable())
+#endif
+            {
+                key.push_back(static_cast<char>(alpha));
+            }
+        }
+        return true;
+    }
+
+    void Blend()
     {
         bool alpha = true;
         int size = 0;
+        std::vector<BlendDecodeJob> jobs;
         // Iterate from the last to first image because we potentially don't have
         // to decode all images if there's an opaque one.
         Images::reverse_iterator rit = images_.rbegin();
@@ -412,36 +879,67 @@ struct AsyncBlend : Napi::AsyncWorker
                     return;
                 }
 
-                // allocate image for decoded pixels
-                auto im_ptr = std::make_unique<mapnik::image_rgba8>(layer_width, layer_height);
-                // actually decode pixels now
-                try
-                {
-                    image_reader->read(0, 0, *im_ptr);
-                }
-                catch (std::exception const&)
-                {
-                    SetError("Could not decode image");
-                    return;
-                }
-
                 bool coversWidth = image->x <= 0 && visibleWidth >= width_;
                 bool coversHeight = image->y <= 0 && visibleHeight >= height_;
-                if (!layer_has_alpha && coversWidth && coversHeight && image->tint.is_alpha_identity())
+                bool occludes = coversWidth && coversHeight && image->tint.is_alpha_identity();
+                // Many layers with an alpha channel are opaque anyway. Those we
+                // have seen before are known to be, the others are checked after
+                // decoding.
+                std::uint64_t hash = 0;
+                if (occludes && layer_has_alpha)
+                {
+                    hash = Blend_Hash(image->data, image->dataLength);
+                    if (BlendOpacityCache::instance().contains(hash))
+                    {
+                        ++blend_opacity_cache_hits;
+                        layer_has_alpha = false;
+                    }
+                }
+                if (!layer_has_alpha && occludes)
                 {
                     // Skip decoding more layers.
                     alpha = false;
                 }
 
-                // Convenience aliases.
-                image->width = layer_width;
-                image->height = layer_height;
-                image->im_ptr = std::move(im_ptr);
-                image->im_raw_ptr = image->im_ptr.get();
+                // Only decode the window of the layer that intersects the canvas
+                // and treat that window as the layer from here on.
+                int x0 = std::max(0, -image->x);
+                int y0 = std::max(0, -image->y);
+                int window_width = static_cast<int>(layer_width) - x0 - std::max(0, visibleWidth - width_);
+                int window_height = static_cast<int>(layer_height) - y0 - std::max(0, visibleHeight - height_);
+                blend_decode_skipped_bytes += (static_cast<std::uint64_t>(layer_width) * layer_height -
+                                               static_cast<std::uint64_t>(window_width) * window_height) *
+                                              sizeof(mapnik::image_rgba8::pixel_type);
+                image->x = std::max(0, image->x);
+                image->y = std::max(0, image->y);
+                image->width = window_width;
+                image->height = window_height;
+                // Pixels are decoded below, once we know which layers are needed.
+                jobs.push_back({image.get(), std::move(image_reader), static_cast<unsigned>(x0), static_cast<unsigned>(y0)});
+                jobs.back().hash = hash;
+                jobs.back().scan = layer_has_alpha && occludes;
+                jobs.back().occludes = occludes;
             }
             ++size;
         }
 
+        std::size_t opaque_job = 0;
+        if (!Blend_DecodeLayers(jobs, concurrency_, opaque_job))
+        {
+            SetError("Could not decode image");
+            return;
+        }
+        // A layer found to be opaque while decoding hides everything below it.
+        Images::iterator first = images_.begin();
+        if (opaque_job < jobs.size())
+        {
+            alpha = false;
+            BImage const* bottom = jobs[opaque_job].image;
+            first = std::find_if(images_.begin(), images_.end(), [bottom](ImagePtr const& image) {
+                return image.get() == bottom;
+            });
+        }
+
         // Now blend images.
         int pixels = width_ * height_;
         if (pixels <= 0)
@@ -452,139 +950,548 @@ struct AsyncBlend : Napi::AsyncWorker
             return;
         }
 
-        mapnik::image_rgba8 target(width_, height_);
+        // Blend on top of the caller's image as is, or into a new one.
+        image_ptr output = target_ ? target_ : std::make_shared<mapnik::image_any>(mapnik::image_rgba8(width_, height_));
+        mapnik::image_rgba8& target = output->get<mapnik::image_rgba8>();
         // When we don't actually have transparent pixels, we don't need to set the matte.
-        if (alpha)
+        if (alpha && !target_)
         {
             target.set(matte_);
         }
-        for (auto image_ptr : images_)
+        for (auto it = first; it != images_.end(); ++it)
         {
+            auto const& image_ptr = *it;
             if (image_ptr && image_ptr->im_raw_ptr)
             {
-                Blend_Composite(width_, height_, target.data(), &*image_ptr);
+                Blend_Composite(width_, height_, target.data(), *image_ptr, image_ptr->x, image_ptr->y);
+            }
+        }
+        if (encode_)
+        {
+            try
+            {
+                output_buffer_ = std::make_unique<std::string>(Blend_Encode(target, alpha, encode_options_));
+            }
+            catch (std::exception const& ex)
+            {
+                SetError(ex.what());
             }
         }
-        Blend_Encode(this, target, alpha);
+        else
+        {
+            output_image_ = output;
+        }
     }
 
     std::vector<napi_value> GetResult(Napi::Env env) override
     {
         if (output_buffer_)
         {
-            std::string& str = *output_buffer_;
-            auto buffer = Napi::Buffer<char>::New(
-                env,
-                str.empty() ? nullptr : &str[0],
-                str.size(),
-                [](Napi::Env env_, char* /*unused*/, std::string* str_ptr) {
-                    if (str_ptr != nullptr)
-                    {
-                        Napi::MemoryManagement::AdjustExternalMemory(env_, -static_cast<std::int64_t>(str_ptr->size()));
-                    }
-                    delete str_ptr;
-                },
-                output_buffer_.release());
-            Napi::MemoryManagement::AdjustExternalMemory(env, static_cast<std::int64_t>(str.size()));
-            return {env.Null(), buffer};
+            return {env.Null(), Blend_ToBuffer(env, std::move(output_buffer_))};
+        }
+        if (output_image_)
+        {
+            Napi::Value arg = Napi::External<image_ptr>::New(env, &output_image_);
+            Napi::Object obj = Image::constructor.New({arg});
+            return {env.Null(), napi_value(obj)};
         }
         return Base::GetResult(env);
     }
     void SetError(std::string const& err)
     {
+        failed_ = true;
         Base::SetError(err);
     }
 
     Images images_;
-    int quality_;
     int width_;
     int height_;
-    palette_ptr palette_;
     unsigned matte_;
-    int compression_;
-    AlphaMode mode_;
-    BlendFormat format_;
+    BlendEncodeOptions encode_options_;
     bool reencode_;
+    unsigned concurrency_;
+    image_ptr target_;
+    bool encode_;
+    bool failed_ = false;
     std::unique_ptr<std::string> output_buffer_;
+    image_ptr output_image_;
+};
+
+// One output of mapnik.blendMany: a width x height window whose top left
+// corner is at x/y in the coordinate space of the layers.
+struct BlendOutput
+{
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    unsigned matte = 0;
+    BlendEncodeOptions encode;
 };
 
-static void Blend_Encode(AsyncBlend* worker, mapnik::image_rgba8 const& image, bool alpha)
+struct AsyncBlendMany : Napi::AsyncWorker
 {
-    try
+    using Base = Napi::AsyncWorker;
+    AsyncBlendMany(Images const& images, std::vector<BlendOutput> const& outputs,
+                   unsigned concurrency, Napi::Function const& callback)
+        : Base(callback),
+          images_(images),
+          outputs_(outputs),
+          concurrency_(concurrency)
     {
-        std::ostringstream stream(std::ios::out | std::ios::binary);
-        if (worker->format_ == BLEND_FORMAT_JPEG)
-        {
-#if defined(HAVE_JPEG)
-            if (worker->quality_ == 0) worker->quality_ = 85;
-            mapnik::save_as_jpeg(stream, worker->quality_, image);
-#else
-            worker->SetError("Mapnik not built with jpeg support");
-#endif
-        }
-        else if (worker->format_ == BLEND_FORMAT_WEBP)
+    }
+
+    static bool Intersects(BImage const& image, BlendOutput const& output)
+    {
+        return image.x < output.x + output.width && image.x + image.width > output.x &&
+               image.y < output.y + output.height && image.y + image.height > output.y;
+    }
+
+    static bool Covers(BImage const& image, BlendOutput const& output)
+    {
+        return image.x <= output.x && image.x + image.width >= output.x + output.width &&
+               image.y <= output.y && image.y + image.height >= output.y + output.height;
+    }
+
+    void Execute() override
+    {
+        std::size_t count = images_.size();
+        std::vector<std::unique_ptr<mapnik::image_reader>> readers(count);
+        std::vector<bool> opaque(count, false);
+        std::vector<std::uint64_t> hashes(count, 0);
+        for (std::size_t i = 0; i < count; ++i)
         {
-#if defined(HAVE_WEBP)
-            if (worker->quality_ == 0) worker->quality_ = 80;
-            WebPConfig config;
-            // Default values set here will be lossless=0 and quality=75 (as least as of webp v0.3.1)
-            if (!WebPConfigInit(&config))
+            BImage& image = *images_[i];
+            if (image.im_obj)
             {
-                // LCOV_EXCL_START
-                worker->SetError("WebPConfigInit failed: version mismatch");
-                // LCOV_EXCL_STOP
+                image.width = image.im_obj->width();
+                image.height = image.im_obj->height();
+                image.im_raw_ptr = &image.im_obj->get<mapnik::image_rgba8>();
             }
             else
             {
-                // see for more details: https://github.com/mapnik/mapnik/wiki/Image-IO#webp-output-options
-                config.quality = worker->quality_;
-                if (worker->compression_ > 0)
+                try
                 {
-                    config.method = worker->compression_;
+                    readers[i] = std::unique_ptr<mapnik::image_reader>(mapnik::get_image_reader(image.data, image.dataLength));
                 }
-                mapnik::save_as_webp(stream, image, config, alpha);
-            }
-#else
-            worker->SetError("Mapnik not built with webp support");
-#endif
-        }
+                catch (std::exception const& ex)
+                {
+                    SetError(ex.what());
+                    return;
+                }
+                if (!readers[i])
+                {
+                    // LCOV_EXCL_START
+                    SetError("Unknown image format");
+                    return;
+                    // LCOV_EXCL_STOP
+                }
+                image.width = readers[i]->width();
+                image.height = readers[i]->height();
+                if (image.tint.is_alpha_identity())
+                {
+                    opaque[i] = !readers[i]->has_alpha();
+                    if (!opaque[i])
+                    {
+                        hashes[i] = Blend_Hash(image.data, image.dataLength);
+                        opaque[i] = BlendOpacityCache::instance().contains(hashes[i]);
+                        if (opaque[i]) ++blend_opacity_cache_hits;
+                    }
+                }
+            }
+            if (image.width <= 0 || image.height <= 0)
+            {
+                SetError("zero width/height image encountered");
+                return;
+            }
+        }
+
+        // Each output only needs the layers from the topmost opaque layer
+        // covering its window upwards.
+        std::vector<std::size_t> bottom(outputs_.size(), 0);
+        std::vector<bool> alpha(outputs_.size(), true);
+        auto find_bottom = [&]() {
+            for (std::size_t o = 0; o < outputs_.size(); ++o)
+            {
+                for (std::size_t i = count; i-- > 0;)
+                {
+                    if (opaque[i] && Covers(*images_[i], outputs_[o]))
+                    {
+                        bottom[o] = i;
+                        alpha[o] = false;
+                        break;
+                    }
+                }
+            }
+        };
+        find_bottom();
+
+        // Decode every layer that is visible in at least one output, once.
+        // Layers with an alpha channel are checked for opacity on the way,
+        // but since outputs differ no layer occludes all others here.
+        std::vector<BlendDecodeJob> jobs;
+        std::vector<std::size_t> layers;
+        for (std::size_t i = count; i-- > 0;)
+        {
+            if (!readers[i]) continue;
+            for (std::size_t o = 0; o < outputs_.size(); ++o)
+            {
+                if (i >= bottom[o] && Intersects(*images_[i], outputs_[o]))
+                {
+                    jobs.push_back({images_[i].get(), std::move(readers[i]), 0, 0});
+                    jobs.back().hash = hashes[i];
+                    jobs.back().scan = !opaque[i] && hashes[i] != 0;
+                    layers.push_back(i);
+                    break;
+                }
+            }
+        }
+        std::size_t opaque_job = 0;
+        if (!Blend_DecodeLayers(jobs, concurrency_, opaque_job))
+        {
+            SetError("Could not decode image");
+            return;
+        }
+        bool found = false;
+        for (std::size_t j = 0; j < jobs.size(); ++j)
+        {
+            if (jobs[j].opaque)
+            {
+                opaque[layers[j]] = true;
+                found = true;
+            }
+        }
+        if (found) find_bottom();
+
+        // Composite and encode all outputs.
+        results_.resize(outputs_.size());
+        try
+        {
+            parallel_for(outputs_.size(), concurrency_, [&](std::size_t o) {
+                BlendOutput const& output = outputs_[o];
+                mapnik::image_rgba8 target(output.width, output.height);
+                if (alpha[o])
+                {
+                    target.set(output.matte);
+                }
+                for (std::size_t i = bottom[o]; i < count; ++i)
+                {
+                    BImage const& image = *images_[i];
+                    if (image.im_raw_ptr && Intersects(image, output))
+                    {
+                        Blend_Composite(output.width, output.height, target.data(), image,
+                                        image.x - output.x, image.y - output.y);
+                    }
+                }
+                results_[o] = std::make_unique<std::string>(Blend_Encode(target, alpha[o], output.encode));
+            });
+        }
+        catch (std::exception const& ex)
+        {
+            SetError(ex.what());
+        }
+    }
+
+    std::vector<napi_value> GetResult(Napi::Env env) override
+    {
+        Napi::Array results = Napi::Array::New(env, results_.size());
+        for (std::size_t o = 0; o < results_.size(); ++o)
+        {
+            results.Set(o, Blend_ToBuffer(env, std::move(results_[o])));
+        }
+        return {env.Null(), results};
+    }
+
+    Images images_;
+    std::vector<BlendOutput> outputs_;
+    unsigned concurrency_;
+    std::vector<std::unique_ptr<std::string>> results_;
+};
+
+/**
+ * Counters shared by all `mapnik.blend` calls in this process.
+ *
+ * @name blendStats
+ * @memberof mapnik
+ * @static
+ * @returns {Object} with `decodeSkippedBytes`, the number of decoded pixel bytes
+ * that were never produced because they fell outside of the blended canvas,
+ * `opacityDetected`, the number of layers with an alpha channel that decoded to fully
+ * opaque pixels, `opacityCacheHits`, the number of such layers recognized again without
+ * decoding, which lets the layers below them be skipped, and the result cache counters `cacheHits`, `cacheMisses`, `cacheEvictions`, `cacheEntries`,
+ * `cacheBytes` and `cacheMaxBytes` (see `mapnik.setBlendCacheSize`)
+ * @example
+ * var stats = mapnik.blendStats();
+ * console.log(stats.decodeSkippedBytes);
+ */
+Napi::Value blendStats(Napi::CallbackInfo const& info)
+{
+    Napi::Env env = info.Env();
+    Napi::Object stats = Napi::Object::New(env);
+    stats.Set("decodeSkippedBytes", Napi::Number::New(env, static_cast<double>(blend_decode_skipped_bytes.load())));
+    stats.Set("opacityDetected", Napi::Number::New(env, static_cast<double>(blend_opacity_detected.load())));
+    stats.Set("opacityCacheHits", Napi::Number::New(env, static_cast<double>(blend_opacity_cache_hits.load())));
+    BlendCache::instance().stats(stats);
+    return stats;
+}
+
+/**
+ * Set the size of the process-wide cache of encoded `mapnik.blend` results.
+ * Calls whose inputs are all Buffers are looked up by the contents of the
+ * buffers and all blend options, and a hit returns the stored result without
+ * decoding or encoding. Each entry holds a copy of its input buffers, which
+ * counts towards `maxBytes`. The cache is disabled by default.
+ *
+ * @name setBlendCacheSize
+ * @memberof mapnik
+ * @static
+ * @param {number} maxBytes - upper bound for the cached results, 0 disables the cache
+ * @example
+ * mapnik.setBlendCacheSize(64 * 1024 * 1024);
+ */
+Napi::Value setBlendCacheSize(Napi::CallbackInfo const& info)
+{
+    Napi::Env env = info.Env();
+    if (info.Length() != 1 || !info[0].IsNumber() || info[0].As<Napi::Number>().DoubleValue() < 0)
+    {
+        Napi::TypeError::New(env, "first argument must be a positive number of bytes").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    BlendCache::instance().set_max_bytes(static_cast<std::size_t>(info[0].As<Napi::Number>().DoubleValue()));
+    return env.Undefined();
+}
+
+void clearBlendCache()
+{
+    BlendCache::instance().clear();
+    BlendOpacityCache::instance().clear();
+}
+
+// Parses the output encoding options shared by mapnik.blend and
+// mapnik.blendMany. Throws a JS exception and returns false on invalid input.
+static bool Blend_ParseEncodeOptions(Napi::Env env, Napi::Object const& options, BlendEncodeOptions& encode)
+{
+    if (options.Has("quality"))
+    {
+        Napi::Value quality_val = options.Get("quality");
+        if (!quality_val.IsNumber())
+        {
+            Napi::TypeError::New(env, "quality - expected an integer value").ThrowAsJavaScriptException();
+            return false;
+        }
+        encode.quality = quality_val.As<Napi::Number>().Int32Value();
+    }
+    Napi::Value format_val = options.Get("format");
+
+    if (!format_val.IsEmpty() && format_val.IsString())
+    {
+        std::string format_val_string = format_val.As<Napi::String>();
+
+        if (format_val_string == "jpeg" || format_val_string == "jpg")
+        {
+            encode.format = BLEND_FORMAT_JPEG;
+            if (encode.quality == 0)
+                encode.quality = 85; // 85 is same default as mapnik core jpeg
+            else if (encode.quality < 0 || encode.quality > 100)
+            {
+                Napi::TypeError::New(env, "JPEG quality is range 0-100.").ThrowAsJavaScriptException();
+                return false;
+            }
+        }
+        else if (format_val_string == "png")
+        {
+            if (encode.quality == 1 || encode.quality > 256)
+            {
+                Napi::TypeError::New(env, "PNG images must be quantized between 2 and 256 colors.").ThrowAsJavaScriptException();
+                return false;
+            }
+        }
+        else if (format_val_string == "webp")
+        {
+            encode.format = BLEND_FORMAT_WEBP;
+            if (encode.quality == 0)
+                encode.quality = 80;
+            else if (encode.quality < 0 || encode.quality > 100)
+            {
+                Napi::TypeError::New(env, "WebP quality is range 0-100.").ThrowAsJavaScriptException();
+                return false;
+            }
+        }
         else
         {
-            // Save as PNG.
-#if defined(HAVE_PNG)
-            mapnik::png_options opts;
-            opts.compression = worker->compression_;
-            if (worker->palette_ && worker->palette_->valid())
+            Napi::TypeError::New(env, "Invalid output format.").ThrowAsJavaScriptException();
+            return false;
+        }
+    }
+    if (options.Has("palette"))
+    {
+        Napi::Value palette_val = options.Get("palette");
+        if (palette_val.IsObject())
+        {
+            encode.palette = Napi::ObjectWrap<Palette>::Unwrap(palette_val.As<Napi::Object>())->palette();
+        }
+    }
+    if (options.Has("mode"))
+    {
+        Napi::Value mode_val = options.Get("mode");
+        if (mode_val.IsString())
+        {
+            std::string mode_string = mode_val.As<Napi::String>();
+            if (mode_string == "octree" || mode_string == "o")
             {
-                mapnik::save_as_png8_pal(stream, image, *worker->palette_, opts);
+                encode.mode = BLEND_MODE_OCTREE;
             }
-            else if (worker->quality_ > 0)
+            else if (mode_string == "hextree" || mode_string == "h")
             {
-                opts.colors = worker->quality_;
-                // Paletted PNG.
-                if (alpha && worker->mode_ == BLEND_MODE_HEXTREE)
+                encode.mode = BLEND_MODE_HEXTREE;
+            }
+        }
+    }
+    if (options.Has("compression"))
+    {
+        Napi::Value compression_val = options.Get("compression");
+        if (!compression_val.IsEmpty() && compression_val.IsNumber())
+        {
+            encode.compression = compression_val.As<Napi::Number>().Int32Value();
+        }
+        else
+        {
+            Napi::TypeError::New(env, "Compression option must be a number").ThrowAsJavaScriptException();
+            return false;
+        }
+    }
+
+    int min_compression = Z_NO_COMPRESSION;
+    int max_compression = Z_BEST_COMPRESSION;
+    if (encode.format == BLEND_FORMAT_PNG)
+    {
+        if (encode.compression < 0) encode.compression = Z_DEFAULT_COMPRESSION;
+    }
+    else if (encode.format == BLEND_FORMAT_WEBP)
+    {
+        min_compression = 0, max_compression = 6;
+        if (encode.compression < 0) encode.compression = -1;
+    }
+
+    if (encode.compression > max_compression)
+    {
+        std::ostringstream msg;
+        msg << "Compression level must be between "
+            << min_compression << " and " << max_compression;
+        Napi::TypeError::New(env, msg.str().c_str()).ThrowAsJavaScriptException();
+        return false;
+    }
+    return true;
+}
+
+// Parses the `concurrency` option shared by mapnik.blend and mapnik.blendMany.
+static bool Blend_ParseConcurrency(Napi::Env env, Napi::Object const& options, unsigned& concurrency)
+{
+    if (options.Has("concurrency"))
+    {
+        Napi::Value concurrency_val = options.Get("concurrency");
+        if (!concurrency_val.IsNumber() || concurrency_val.As<Napi::Number>().Int32Value() < 1)
+        {
+            Napi::TypeError::New(env, "concurrency must be a positive integer").ThrowAsJavaScriptException();
+            return false;
+        }
+        concurrency = std::min(concurrency_val.As<Napi::Number>().Uint32Value(), max_blend_concurrency);
+    }
+    return true;
+}
+
+// Parses the input layers shared by mapnik.blend and mapnik.blendMany.
+// Throws a JS exception and returns false on invalid input.
+static bool Blend_ParseImages(Napi::CallbackInfo const& info, Napi::Array const& js_images, Images& images, bool& reencode)
+{
+    Napi::Env env = info.Env();
+    std::size_t length = js_images.Length();
+    for (std::size_t i = 0; i < length; ++i)
+    {
+        ImagePtr image = std::make_shared<BImage>();
+        Napi::Value buffer = js_images.Get(i);
+        if (buffer.IsBuffer())
+        {
+            image->buffer = Napi::Persistent(buffer.As<Napi::Buffer<char>>());
+        }
+        else if (buffer.IsObject())
+        {
+            Napi::Object obj = buffer.As<Napi::Object>();
+            if (obj.InstanceOf(Image::constructor.Value()))
+            {
+                Image* im = Napi::ObjectWrap<Image>::Unwrap(obj);
+
+                if (im->impl()->get_dtype() == mapnik::image_dtype_rgba8)
                 {
-                    mapnik::save_as_png8_hex(stream, image, opts);
+                    image->im_obj = im->impl();
                 }
                 else
                 {
-                    mapnik::save_as_png8_oct(stream, image, opts);
+                    Napi::TypeError::New(env, "Only mapnik.Image types that are rgba8 can be passed to blend").ThrowAsJavaScriptException();
+                    return false;
                 }
             }
             else
             {
-                mapnik::save_as_png(stream, image, opts);
+                if (obj.Has("buffer"))
+                {
+                    buffer = obj.Get("buffer");
+                    if (buffer.IsBuffer())
+                    {
+                        image->buffer = Napi::Persistent(buffer.As<Napi::Buffer<char>>());
+                    }
+                    else if (buffer.IsObject())
+                    {
+                        Napi::Object possible_im = buffer.As<Napi::Object>();
+                        if (possible_im.InstanceOf(Image::constructor.Value()))
+                        {
+                            Image* im = Napi::ObjectWrap<Image>::Unwrap(possible_im);
+                            if (im->impl()->get_dtype() == mapnik::image_dtype_rgba8)
+                            {
+                                image->im_obj = im->impl();
+                            }
+                            else
+                            {
+                                Napi::TypeError::New(env, "Only mapnik.Image types that are rgba8 can be passed to blend").ThrowAsJavaScriptException();
+                                return false;
+                            }
+                        }
+                    }
+                }
+                if (obj.Has("x") && obj.Has("y"))
+                {
+                    image->x = obj.Get("x").As<Napi::Number>().Int32Value();
+                    image->y = obj.Get("y").As<Napi::Number>().Int32Value();
+                }
+                Napi::Value tint_val = obj.Get("tint");
+                if (tint_val.IsObject())
+                {
+                    Napi::Object tint = tint_val.As<Napi::Object>();
+                    if (!tint.IsEmpty())
+                    {
+                        reencode = true;
+                        std::string msg;
+                        if (!parseTintOps(info, tint, image->tint))
+                            return false;
+                    }
+                }
             }
-#else
-            worker->SetError("Mapnik not built with png support");
-#endif
         }
-        worker->output_buffer_ = std::make_unique<std::string>(stream.str());
-    }
-    catch (const std::exception& ex)
-    {
-        worker->SetError(ex.what());
+
+        if (image->buffer.IsEmpty() && !image->im_obj)
+        {
+            Napi::TypeError::New(env, "All elements must be Buffers or RGBA Mapnik Image objects or objects with a 'buffer' property.")
+                .ThrowAsJavaScriptException();
+            return false;
+        }
+        if (!image->im_obj)
+        {
+            image->data = buffer.As<Napi::Buffer<char>>().Data();
+            image->dataLength = buffer.As<Napi::Buffer<char>>().Length();
+        }
+        images.push_back(image);
     }
+    return true;
 }
 
 /**
@@ -599,8 +1506,17 @@ static void Blend_Encode(AsyncBlend* worker, mapnik::image_rgba8 const& image, b
  * `reencode`, palette, mode can be either `hextree` or `octree`, quality. JPEG & WebP quality
  * quality ranges from 0-100, PNG quality from 2-256. Compression varies by platform -
  * it references the internal zlib compression algorithm.
+ * @param {number} [options.concurrency=1] - maximum number of threads used to decode
+ * the input images of this call, counting the one running it. The extra threads come
+ * from a pool of one thread per CPU shared by all calls. Layers hidden below an
+ * opaque layer are never decoded.
+ * @param {boolean} [options.encode=true] - when false the result is a new rgba8
+ * `mapnik.Image` instead of an encoded Buffer
+ * @param {mapnik.Image} [options.target] - rgba8 image to blend into. Its current pixels
+ * are the background (`matte` is ignored), its size is the output size and the
+ * result is this image, not encoded. It can't be one of the images to blend
  * @param {Function} callback called with (err, res), where a successful
- * result is a processed image as a Buffer
+ * result is a processed image as a Buffer, or a `mapnik.Image` when not encoding
  * @example
  * mapnik.blend([
  *  fs.readFileSync('foo.png'),
@@ -609,20 +1525,26 @@ static void Blend_Encode(AsyncBlend* worker, mapnik::image_rgba8 const& image, b
  *  if (err) throw err;
  *  fs.writeFileSync('result.png', result);
  * });
+ *
+ * // keep pixels raw between steps and only encode once at the end
+ * var canvas = new mapnik.Image(256, 256);
+ * mapnik.blend([hillshade, labels], {target: canvas}, function(err, result) {
+ *  if (err) throw err;
+ *  mapnik.blend([result, overlay], function(err, png) {});
+ * });
  */
 Napi::Value blend(Napi::CallbackInfo const& info)
 {
     Napi::Env env = info.Env();
     Images images;
-    int quality = 0;
     int width = 0;
     int height = 0;
-    palette_ptr palette;
     unsigned matte = 0;
-    int compression = -1;
-    AlphaMode mode = BLEND_MODE_HEXTREE;
-    BlendFormat format = BLEND_FORMAT_PNG;
+    BlendEncodeOptions encode_options;
     bool reencode = false;
+    unsigned concurrency = 1;
+    image_ptr target;
+    bool encode = true;
     Napi::Function callback;
 
     Napi::Object options;
@@ -666,58 +1588,7 @@ Napi::Value blend(Napi::CallbackInfo const& info)
     // Validate options
     if (!options.IsEmpty())
     {
-        if (options.Has("quality"))
-        {
-            Napi::Value quality_val = options.Get("quality");
-            if (!quality_val.IsNumber())
-            {
-                Napi::TypeError::New(env, "quality - expected an integer value").ThrowAsJavaScriptException();
-                return env.Undefined();
-            }
-            quality = quality_val.As<Napi::Number>().Int32Value();
-        }
-        Napi::Value format_val = options.Get("format");
-
-        if (!format_val.IsEmpty() && format_val.IsString())
-        {
-            std::string format_val_string = format_val.As<Napi::String>();
-
-            if (format_val_string == "jpeg" || format_val_string == "jpg")
-            {
-                format = BLEND_FORMAT_JPEG;
-                if (quality == 0)
-                    quality = 85; // 85 is same default as mapnik core jpeg
-                else if (quality < 0 || quality > 100)
-                {
-                    Napi::TypeError::New(env, "JPEG quality is range 0-100.").ThrowAsJavaScriptException();
-                    return env.Undefined();
-                }
-            }
-            else if (format_val_string == "png")
-            {
-                if (quality == 1 || quality > 256)
-                {
-                    Napi::TypeError::New(env, "PNG images must be quantized between 2 and 256 colors.").ThrowAsJavaScriptException();
-                    return env.Undefined();
-                }
-            }
-            else if (format_val_string == "webp")
-            {
-                format = BLEND_FORMAT_WEBP;
-                if (quality == 0)
-                    quality = 80;
-                else if (quality < 0 || quality > 100)
-                {
-                    Napi::TypeError::New(env, "WebP quality is range 0-100.").ThrowAsJavaScriptException();
-                    return env.Undefined();
-                }
-            }
-            else
-            {
-                Napi::TypeError::New(env, "Invalid output format.").ThrowAsJavaScriptException();
-                return env.Undefined();
-            }
-        }
+        if (!Blend_ParseEncodeOptions(env, options, encode_options)) return env.Undefined();
         if (options.Has("reencode"))
         {
             reencode = options.Get("reencode").As<Napi::Boolean>();
@@ -749,64 +1620,44 @@ Napi::Value blend(Napi::CallbackInfo const& info)
                 }
             }
         }
-        if (options.Has("palette"))
+        if (!Blend_ParseConcurrency(env, options, concurrency)) return env.Undefined();
+        if (options.Has("encode"))
         {
-            Napi::Value palette_val = options.Get("palette");
-            if (palette_val.IsObject())
+            Napi::Value encode_val = options.Get("encode");
+            if (!encode_val.IsBoolean())
             {
-                palette = Napi::ObjectWrap<Palette>::Unwrap(palette_val.As<Napi::Object>())->palette();
+                Napi::TypeError::New(env, "encode must be a boolean").ThrowAsJavaScriptException();
+                return env.Undefined();
             }
+            encode = encode_val.As<Napi::Boolean>();
         }
-        if (options.Has("mode"))
+        if (options.Has("target"))
         {
-            Napi::Value mode_val = options.Get("mode");
-            if (mode_val.IsString())
+            Napi::Value target_val = options.Get("target");
+            if (!target_val.IsObject() || !target_val.As<Napi::Object>().InstanceOf(Image::constructor.Value()))
             {
-                std::string mode_string = mode_val.As<Napi::String>();
-                if (mode_string == "octree" || mode_string == "o")
-                {
-                    mode = BLEND_MODE_OCTREE;
-                }
-                else if (mode_string == "hextree" || mode_string == "h")
-                {
-                    mode = BLEND_MODE_HEXTREE;
-                }
+                Napi::TypeError::New(env, "target must be a mapnik.Image").ThrowAsJavaScriptException();
+                return env.Undefined();
             }
-        }
-        if (options.Has("compression"))
-        {
-            Napi::Value compression_val = options.Get("compression");
-            if (!compression_val.IsEmpty() && compression_val.IsNumber())
+            target = Napi::ObjectWrap<Image>::Unwrap(target_val.As<Napi::Object>())->impl();
+            if (target->get_dtype() != mapnik::image_dtype_rgba8)
             {
-                compression = compression_val.As<Napi::Number>().Int32Value();
+                Napi::TypeError::New(env, "Only mapnik.Image types that are rgba8 can be used as blend target").ThrowAsJavaScriptException();
+                return env.Undefined();
             }
-            else
+            int target_width = static_cast<int>(target->width());
+            int target_height = static_cast<int>(target->height());
+            if ((width > 0 && width != target_width) || (height > 0 && height != target_height))
             {
-                Napi::TypeError::New(env, "Compression option must be a number").ThrowAsJavaScriptException();
+                Napi::TypeError::New(env, "width and height must match the target image").ThrowAsJavaScriptException();
                 return env.Undefined();
             }
+            width = target_width;
+            height = target_height;
+            encode = false;
         }
-
-        int min_compression = Z_NO_COMPRESSION;
-        int max_compression = Z_BEST_COMPRESSION;
-        if (format == BLEND_FORMAT_PNG)
-        {
-            if (compression < 0) compression = Z_DEFAULT_COMPRESSION;
-        }
-        else if (format == BLEND_FORMAT_WEBP)
-        {
-            min_compression = 0, max_compression = 6;
-            if (compression < 0) compression = -1;
-        }
-
-        if (compression > max_compression)
-        {
-            std::ostringstream msg;
-            msg << "Compression level must be between "
-                << min_compression << " and " << max_compression;
-            Napi::TypeError::New(env, msg.str().c_str()).ThrowAsJavaScriptException();
-            return env.Undefined();
-        }
+        // Raw pixel output can never pass an input buffer through as is.
+        if (!encode) reencode = true;
     }
 
     Napi::Array js_images = info[0].As<Napi::Array>();
@@ -841,92 +1692,149 @@ Napi::Value blend(Napi::CallbackInfo const& info)
         return env.Undefined();
     }
 
-    for (std::size_t i = 0; i < length; ++i)
+    if (!Blend_ParseImages(info, js_images, images, reencode)) return env.Undefined();
+    if (target)
     {
-        ImagePtr image = std::make_shared<BImage>();
-        Napi::Value buffer = js_images.Get(i);
-        if (buffer.IsBuffer())
+        // The target is written row by row while the layers are read.
+        for (auto const& image : images)
         {
-            image->buffer = Napi::Persistent(buffer.As<Napi::Buffer<char>>());
+            if (image && image->im_obj == target)
+            {
+                Napi::TypeError::New(env, "target must not be one of the images to blend").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
         }
-        else if (buffer.IsObject())
+    }
+    auto* worker = new AsyncBlend(images, width, height, matte, encode_options, reencode, concurrency, target, encode, callback);
+    worker->Queue();
+    return env.Undefined();
+}
+
+/**
+ * Composite the same set of layers into several outputs at once. Every input
+ * is decoded a single time, then all outputs are composited and encoded in
+ * parallel within one asynchronous job. This suits metatile and sprite
+ * workflows which would otherwise call `mapnik.blend` repeatedly on the same
+ * buffers with different windows.
+ *
+ * @name blendMany
+ * @memberof mapnik
+ * @static
+ * @param {Array<Buffer>} buffers - layers, accepting the same values as `mapnik.blend`
+ * @param {Array<Object>} outputs - one object per output with `width` and `height`,
+ * the optional `x` and `y` of the output window in layer coordinates (default 0),
+ * `matte`, and the encoding options of `mapnik.blend`: `format`, `quality`,
+ * `compression`, `palette` and `mode`
+ * @param {Object} [options]
+ * @param {number} [options.concurrency] - maximum number of threads used for decoding
+ * and for producing outputs, counting the one running the call, at most 16. The extra
+ * threads come from a pool of one thread per CPU shared by all calls, and by default a
+ * call may use all of them: concurrent calls then take turns on the pool rather than
+ * oversubscribing the CPUs.
+ * @param {Function} callback called with (err, results), where results is
+ * an Array of Buffers in the order of `outputs`
+ * @example
+ * // slice a 512px metatile into four 256px tiles
+ * mapnik.blendMany([hillshade, labels], [
+ *   {x: 0, y: 0, width: 256, height: 256},
+ *   {x: 256, y: 0, width: 256, height: 256},
+ *   {x: 0, y: 256, width: 256, height: 256},
+ *   {x: 256, y: 256, width: 256, height: 256, format: 'webp'}
+ * ], function(err, tiles) {
+ *   if (err) throw err;
+ * });
+ */
+Napi::Value blendMany(Napi::CallbackInfo const& info)
+{
+    Napi::Env env = info.Env();
+    // Every call borrows from the same pool, so by default a call may use all
+    // of it: concurrent calls share those threads rather than adding more.
+    unsigned concurrency = std::min(static_cast<unsigned>(thread_pool::instance().size()) + 1, max_blend_concurrency);
+    if (info.Length() < 3 || !info[0].IsArray() || !info[1].IsArray())
+    {
+        Napi::TypeError::New(env, "expects an array of Buffers, an array of outputs and a callback").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    Napi::Value callback_val = info[info.Length() - 1];
+    if (!callback_val.IsFunction())
+    {
+        Napi::TypeError::New(env, "last argument must be a callback function").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (info.Length() > 3)
+    {
+        if (!info[2].IsObject())
         {
-            Napi::Object obj = buffer.As<Napi::Object>();
-            if (obj.InstanceOf(Image::constructor.Value()))
-            {
-                Image* im = Napi::ObjectWrap<Image>::Unwrap(obj);
+            Napi::TypeError::New(env, "optional third argument must be an options object").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        if (!Blend_ParseConcurrency(env, info[2].As<Napi::Object>(), concurrency)) return env.Undefined();
+    }
 
-                if (im->impl()->get_dtype() == mapnik::image_dtype_rgba8)
-                {
-                    image->im_obj = im->impl();
-                }
-                else
-                {
-                    Napi::TypeError::New(env, "Only mapnik.Image types that are rgba8 can be passed to blend").ThrowAsJavaScriptException();
-                    return env.Undefined();
-                }
-            }
-            else
+    Napi::Array js_outputs = info[1].As<Napi::Array>();
+    std::size_t num_outputs = js_outputs.Length();
+    if (num_outputs == 0)
+    {
+        Napi::TypeError::New(env, "at least one output must be provided").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    std::vector<BlendOutput> outputs(num_outputs);
+    for (std::size_t o = 0; o < num_outputs; ++o)
+    {
+        Napi::Value output_val = js_outputs.Get(o);
+        if (!output_val.IsObject())
+        {
+            Napi::TypeError::New(env, "outputs must be objects").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        Napi::Object output_obj = output_val.As<Napi::Object>();
+        BlendOutput& output = outputs[o];
+        Napi::Value width_val = output_obj.Get("width");
+        Napi::Value height_val = output_obj.Get("height");
+        if (!width_val.IsNumber() || !height_val.IsNumber() ||
+            width_val.As<Napi::Number>().Int32Value() <= 0 || height_val.As<Napi::Number>().Int32Value() <= 0)
+        {
+            Napi::TypeError::New(env, "each output requires a positive width and height").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        output.width = width_val.As<Napi::Number>().Int32Value();
+        output.height = height_val.As<Napi::Number>().Int32Value();
+        if (output_obj.Has("x"))
+        {
+            Napi::Value x_val = output_obj.Get("x");
+            if (!x_val.IsNumber())
             {
-                if (obj.Has("buffer"))
-                {
-                    buffer = obj.Get("buffer");
-                    if (buffer.IsBuffer())
-                    {
-                        image->buffer = Napi::Persistent(buffer.As<Napi::Buffer<char>>());
-                    }
-                    else if (buffer.IsObject())
-                    {
-                        Napi::Object possible_im = buffer.As<Napi::Object>();
-                        if (possible_im.InstanceOf(Image::constructor.Value()))
-                        {
-                            Image* im = Napi::ObjectWrap<Image>::Unwrap(possible_im);
-                            if (im->impl()->get_dtype() == mapnik::image_dtype_rgba8)
-                            {
-                                image->im_obj = im->impl();
-                            }
-                            else
-                            {
-                                Napi::TypeError::New(env, "Only mapnik.Image types that are rgba8 can be passed to blend").ThrowAsJavaScriptException();
-                                return env.Undefined();
-                            }
-                        }
-                    }
-                }
-                if (obj.Has("x") && obj.Has("y"))
-                {
-                    image->x = obj.Get("x").As<Napi::Number>().Int32Value();
-                    image->y = obj.Get("y").As<Napi::Number>().Int32Value();
-                }
-                Napi::Value tint_val = obj.Get("tint");
-                if (tint_val.IsObject())
-                {
-                    Napi::Object tint = tint_val.As<Napi::Object>();
-                    if (!tint.IsEmpty())
-                    {
-                        reencode = true;
-                        std::string msg;
-                        if (!parseTintOps(info, tint, image->tint))
-                            return env.Undefined();
-                    }
-                }
+                Napi::TypeError::New(env, "output x must be a number").ThrowAsJavaScriptException();
+                return env.Undefined();
             }
+            output.x = x_val.As<Napi::Number>().Int32Value();
         }
-
-        if (image->buffer.IsEmpty() && !image->im_obj)
+        if (output_obj.Has("y"))
         {
-            Napi::TypeError::New(env, "All elements must be Buffers or RGBA Mapnik Image objects or objects with a 'buffer' property.")
-                .ThrowAsJavaScriptException();
-            return env.Undefined();
+            Napi::Value y_val = output_obj.Get("y");
+            if (!y_val.IsNumber())
+            {
+                Napi::TypeError::New(env, "output y must be a number").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            output.y = y_val.As<Napi::Number>().Int32Value();
         }
-        if (!image->im_obj)
+        if (output_obj.Has("matte"))
         {
-            image->data = buffer.As<Napi::Buffer<char>>().Data();
-            image->dataLength = buffer.As<Napi::Buffer<char>>().Length();
+            Napi::Value matte_val = output_obj.Get("matte");
+            if (!matte_val.IsString() || !hexToUInt32Color(matte_val.ToString().Utf8Value().c_str(), output.matte))
+            {
+                Napi::TypeError::New(env, "Invalid matte provided.").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
         }
-        images.push_back(image);
+        if (!Blend_ParseEncodeOptions(env, output_obj, output.encode)) return env.Undefined();
     }
-    auto* worker = new AsyncBlend(images, quality, width, height, palette, matte, compression, mode, format, reencode, callback);
+
+    Images images;
+    bool reencode = true;
+    if (!Blend_ParseImages(info, info[0].As<Napi::Array>(), images, reencode)) return env.Undefined();
+    auto* worker = new AsyncBlendMany(images, outputs, concurrency, callback_val.As<Napi::Function>());
     worker->Queue();
     return env.Undefined();
 }
@@ -55,5 +55,9 @@ enum AlphaMode
 Napi::Value rgb2hsl(Napi::CallbackInfo const& info);
 Napi::Value hsl2rgb(Napi::CallbackInfo const& info);
 Napi::Value blend(Napi::CallbackInfo const& info);
+Napi::Value blendMany(Napi::CallbackInfo const& info);
+Napi::Value blendStats(Napi::CallbackInfo const& info);
+Napi::Value setBlendCacheSize(Napi::CallbackInfo const& info);
+void clearBlendCache();
 
 } // namespace node_mapnik
@@ -0,0 +1,254 @@
+#include "blend_composite.hpp"
+
+// stl
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define NODE_MAPNIK_BLEND_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace node_mapnik {
+
+namespace {
+
+using composite_row_fn = void (*)(std::uint32_t*, std::uint32_t const*, int);
+using all_opaque_fn = bool (*)(std::uint32_t const*, std::size_t);
+
+struct composite_kernel
+{
+    composite_row_fn fn;
+    all_opaque_fn all_opaque;
+    char const* name;
+};
+
+void composite_row_scalar(std::uint32_t* target, std::uint32_t const* source, int width)
+{
+    int x = 0;
+    while (x < width)
+    {
+        std::uint32_t pixel = source[x];
+        if (pixel <= 0x00FFFFFF)
+        {
+            // Skip the whole run of fully transparent source pixels.
+            while (++x < width && source[x] <= 0x00FFFFFF)
+                ;
+        }
+        else if (pixel >= 0xFF000000)
+        {
+            // Copy the whole run of fully opaque source pixels at once.
+            int start = x;
+            while (++x < width && source[x] >= 0xFF000000)
+                ;
+            std::memcpy(target + start, source + start, (x - start) * sizeof(std::uint32_t));
+        }
+        else
+        {
+            Blend_CompositePixel(target[x], pixel);
+            ++x;
+        }
+    }
+}
+
+// Alpha is checked once per block of pixels so that the inner loops stay
+// branch free, while a transparent pixel near the start still ends the scan early.
+bool all_opaque_scalar(std::uint32_t const* pixels, std::size_t count)
+{
+    std::size_t i = 0;
+    for (; i + 64 <= count; i += 64)
+    {
+        std::uint32_t acc = 0xFFFFFFFF;
+        for (std::size_t j = 0; j < 64; ++j)
+        {
+            acc &= pixels[i + j];
+        }
+        if (acc < 0xFF000000) return false;
+    }
+    for (; i < count; ++i)
+    {
+        if (pixels[i] < 0xFF000000) return false;
+    }
+    return true;
+}
+
+#if defined(NODE_MAPNIK_BLEND_SIMD)
+
+// The SIMD kernels evaluate the exact integer formula of Blend_CompositePixel
+// in 32 bit lanes. The only operation without an integer instruction is the
+// division: the quotient is estimated in single precision and then corrected
+// by at most one in either direction, which makes it exact (numerators are
+// below 2^25 and every result is in 0..255).
+
+__attribute__((target("sse4.1"))) inline __m128i div_epi32_sse41(__m128i n, __m128i d)
+{
+    __m128i q = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(n), _mm_cvtepi32_ps(d)));
+    __m128i r = _mm_sub_epi32(n, _mm_mullo_epi32(q, d));
+    __m128i too_big = _mm_cmplt_epi32(r, _mm_setzero_si128());
+    q = _mm_add_epi32(q, too_big);
+    r = _mm_add_epi32(r, _mm_and_si128(too_big, d));
+    __m128i too_small = _mm_cmpgt_epi32(r, _mm_sub_epi32(d, _mm_set1_epi32(1)));
+    return _mm_sub_epi32(q, too_small);
+}
+
+__attribute__((target("sse4.1"))) void composite_row_sse41(std::uint32_t* target, std::uint32_t const* source, int width)
+{
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const one = _mm_set1_epi32(1);
+    __m128i const mask = _mm_set1_epi32(0xff);
+    int x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128i src = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + x));
+        __m128i a1 = _mm_srli_epi32(src, 24);
+        __m128i src_transparent = _mm_cmpeq_epi32(a1, zero);
+        if (_mm_movemask_ps(_mm_castsi128_ps(src_transparent)) == 0xF) continue;
+        __m128i src_opaque = _mm_cmpeq_epi32(a1, mask);
+        if (_mm_movemask_ps(_mm_castsi128_ps(src_opaque)) == 0xF)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + x), src);
+            continue;
+        }
+        __m128i dst = _mm_loadu_si128(reinterpret_cast<__m128i const*>(target + x));
+        __m128i a0 = _mm_srli_epi32(dst, 24);
+        __m128i copy = _mm_or_si128(src_opaque, _mm_cmpeq_epi32(a0, zero));
+
+        __m128i r1 = _mm_and_si128(src, mask);
+        __m128i g1 = _mm_and_si128(_mm_srli_epi32(src, 8), mask);
+        __m128i b1 = _mm_and_si128(_mm_srli_epi32(src, 16), mask);
+        __m128i r0 = _mm_mullo_epi32(_mm_and_si128(dst, mask), a0);
+        __m128i g0 = _mm_mullo_epi32(_mm_and_si128(_mm_srli_epi32(dst, 8), mask), a0);
+        __m128i b0 = _mm_mullo_epi32(_mm_and_si128(_mm_srli_epi32(dst, 16), mask), a0);
+
+        __m128i a = _mm_sub_epi32(_mm_slli_epi32(_mm_add_epi32(a1, a0), 8), _mm_mullo_epi32(a0, a1));
+        // Lanes that are copied or skipped may have a zero divisor.
+        __m128i d = _mm_max_epi32(a, one);
+        __m128i r = div_epi32_sse41(_mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(_mm_slli_epi32(r1, 8), r0), a1), _mm_slli_epi32(r0, 8)), d);
+        __m128i g = div_epi32_sse41(_mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(_mm_slli_epi32(g1, 8), g0), a1), _mm_slli_epi32(g0, 8)), d);
+        __m128i b = div_epi32_sse41(_mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(_mm_slli_epi32(b1, 8), b0), a1), _mm_slli_epi32(b0, 8)), d);
+        __m128i out = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_srli_epi32(a, 8), 24), _mm_slli_epi32(b, 16)),
+                                   _mm_or_si128(_mm_slli_epi32(g, 8), r));
+        out = _mm_blendv_epi8(out, src, copy);
+        out = _mm_blendv_epi8(out, dst, src_transparent);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(target + x), out);
+    }
+    composite_row_scalar(target + x, source + x, width - x);
+}
+
+__attribute__((target("sse4.1"))) bool all_opaque_sse41(std::uint32_t const* pixels, std::size_t count)
+{
+    __m128i const ones = _mm_set1_epi32(-1);
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i const* p = reinterpret_cast<__m128i const*>(pixels + i);
+        __m128i acc = _mm_and_si128(_mm_and_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)),
+                                    _mm_and_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3)));
+        // The alpha byte is the most significant byte of each pixel.
+        if ((_mm_movemask_epi8(_mm_cmpeq_epi8(acc, ones)) & 0x8888) != 0x8888) return false;
+    }
+    return all_opaque_scalar(pixels + i, count - i);
+}
+
+__attribute__((target("avx2"))) inline __m256i div_epi32_avx2(__m256i n, __m256i d)
+{
+    __m256i q = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(n), _mm256_cvtepi32_ps(d)));
+    __m256i r = _mm256_sub_epi32(n, _mm256_mullo_epi32(q, d));
+    __m256i too_big = _mm256_cmpgt_epi32(_mm256_setzero_si256(), r);
+    q = _mm256_add_epi32(q, too_big);
+    r = _mm256_add_epi32(r, _mm256_and_si256(too_big, d));
+    __m256i too_small = _mm256_cmpgt_epi32(r, _mm256_sub_epi32(d, _mm256_set1_epi32(1)));
+    return _mm256_sub_epi32(q, too_small);
+}
+
+__attribute__((target("avx2"))) void composite_row_avx2(std::uint32_t* target, std::uint32_t const* source, int width)
+{
+    __m256i const zero = _mm256_setzero_si256();
+    __m256i const one = _mm256_set1_epi32(1);
+    __m256i const mask = _mm256_set1_epi32(0xff);
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256i src = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(source + x));
+        __m256i a1 = _mm256_srli_epi32(src, 24);
+        __m256i src_transparent = _mm256_cmpeq_epi32(a1, zero);
+        if (_mm256_movemask_ps(_mm256_castsi256_ps(src_transparent)) == 0xFF) continue;
+        __m256i src_opaque = _mm256_cmpeq_epi32(a1, mask);
+        if (_mm256_movemask_ps(_mm256_castsi256_ps(src_opaque)) == 0xFF)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + x), src);
+            continue;
+        }
+        __m256i dst = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(target + x));
+        __m256i a0 = _mm256_srli_epi32(dst, 24);
+        __m256i copy = _mm256_or_si256(src_opaque, _mm256_cmpeq_epi32(a0, zero));
+
+        __m256i r1 = _mm256_and_si256(src, mask);
+        __m256i g1 = _mm256_and_si256(_mm256_srli_epi32(src, 8), mask);
+        __m256i b1 = _mm256_and_si256(_mm256_srli_epi32(src, 16), mask);
+        __m256i r0 = _mm256_mullo_epi32(_mm256_and_si256(dst, mask), a0);
+        __m256i g0 = _mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(dst, 8), mask), a0);
+        __m256i b0 = _mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(dst, 16), mask), a0);
+
+        __m256i a = _mm256_sub_epi32(_mm256_slli_epi32(_mm256_add_epi32(a1, a0), 8), _mm256_mullo_epi32(a0, a1));
+        // Lanes that are copied or skipped may have a zero divisor.
+        __m256i d = _mm256_max_epi32(a, one);
+        __m256i r = div_epi32_avx2(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_slli_epi32(r1, 8), r0), a1), _mm256_slli_epi32(r0, 8)), d);
+        __m256i g = div_epi32_avx2(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_slli_epi32(g1, 8), g0), a1), _mm256_slli_epi32(g0, 8)), d);
+        __m256i b = div_epi32_avx2(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_slli_epi32(b1, 8), b0), a1), _mm256_slli_epi32(b0, 8)), d);
+        __m256i out = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(_mm256_srli_epi32(a, 8), 24), _mm256_slli_epi32(b, 16)),
+                                      _mm256_or_si256(_mm256_slli_epi32(g, 8), r));
+        out = _mm256_blendv_epi8(out, src, copy);
+        out = _mm256_blendv_epi8(out, dst, src_transparent);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + x), out);
+    }
+    composite_row_scalar(target + x, source + x, width - x);
+}
+
+__attribute__((target("avx2"))) bool all_opaque_avx2(std::uint32_t const* pixels, std::size_t count)
+{
+    __m256i const ones = _mm256_set1_epi32(-1);
+    std::size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i const* p = reinterpret_cast<__m256i const*>(pixels + i);
+        __m256i acc = _mm256_and_si256(_mm256_and_si256(_mm256_loadu_si256(p), _mm256_loadu_si256(p + 1)),
+                                       _mm256_and_si256(_mm256_loadu_si256(p + 2), _mm256_loadu_si256(p + 3)));
+        // The alpha byte is the most significant byte of each pixel.
+        if ((static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(acc, ones))) & 0x88888888u) != 0x88888888u) return false;
+    }
+    return all_opaque_scalar(pixels + i, count - i);
+}
+
+#endif
+
+composite_kernel const& select_kernel()
+{
+    static composite_kernel const kernel = []() -> composite_kernel {
+#if defined(NODE_MAPNIK_BLEND_SIMD)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return {composite_row_avx2, all_opaque_avx2, "avx2"};
+        if (__builtin_cpu_supports("sse4.1")) return {composite_row_sse41, all_opaque_sse41, "sse4.1"};
+#endif
+        return {composite_row_scalar, all_opaque_scalar, "scalar"};
+    }();
+    return kernel;
+}
+
+} // namespace
+
+void Blend_CompositeRow(std::uint32_t* target, std::uint32_t const* source, int width)
+{
+    select_kernel().fn(target, source, width);
+}
+
+bool Blend_AllOpaque(std::uint32_t const* pixels, std::size_t count)
+{
+    return select_kernel().all_opaque(pixels, count);
+}
+
+char const* Blend_CompositeKernel()
+{
+    return select_kernel().name;
+}
+
+} // namespace node_mapnik
@@ -0,0 +1,56 @@
+#pragma once
+
+// stl
+#include <cstddef>
+#include <cstdint>
+
+namespace node_mapnik {
+
+static inline void Blend_CompositePixel(std::uint32_t& target, std::uint32_t const& source)
+{
+    if (source <= 0x00FFFFFF)
+    {
+        // Top pixel is fully transparent.
+        // <do nothing>
+    }
+    else if (source >= 0xFF000000 || target <= 0x00FFFFFF)
+    {
+        // Top pixel is fully opaque or bottom pixel is fully transparent.
+        target = source;
+    }
+    else
+    {
+        // Both pixels have transparency.
+        // From http://trac.mapnik.org/browser/trunk/include/mapnik/graphics.hpp#L337
+        long a1 = (source >> 24) & 0xff;
+        long r1 = source & 0xff;
+        long g1 = (source >> 8) & 0xff;
+        long b1 = (source >> 16) & 0xff;
+
+        long a0 = (target >> 24) & 0xff;
+        long r0 = (target & 0xff) * a0;
+        long g0 = ((target >> 8) & 0xff) * a0;
+        long b0 = ((target >> 16) & 0xff) * a0;
+
+        a0 = ((a1 + a0) << 8) - a0 * a1;
+        r0 = ((((r1 << 8) - r0) * a1 + (r0 << 8)) / a0);
+        g0 = ((((g1 << 8) - g0) * a1 + (g0 << 8)) / a0);
+        b0 = ((((b1 << 8) - b0) * a1 + (b0 << 8)) / a0);
+        a0 = a0 >> 8;
+        target = (a0 << 24) | (b0 << 16) | (g0 << 8) | (r0);
+    }
+}
+
+// Composites `width` source pixels over `width` target pixels using the same
+// math as Blend_CompositePixel. The implementation (AVX2, SSE4.1 or scalar) is
+// picked once at runtime based on what the CPU supports.
+void Blend_CompositeRow(std::uint32_t* target, std::uint32_t const* source, int width);
+
+// Returns true when all `count` pixels have an alpha of 255. Uses the same
+// runtime dispatch as Blend_CompositeRow.
+bool Blend_AllOpaque(std::uint32_t const* pixels, std::size_t count);
+
+// Name of the row kernel picked at runtime: "avx2", "sse4.1" or "scalar".
+char const* Blend_CompositeKernel();
+
+} // namespace node_mapnik
@@ -0,0 +1,664 @@
+#include "geojson_reader.hpp"
+
+// mapnik
+#include <mapnik/feature.hpp>
+#include <mapnik/feature_factory.hpp>
+#include <mapnik/geometry.hpp>
+#include <mapnik/geometry/correct.hpp>
+#include <mapnik/unicode.hpp>
+#include <mapnik/value/types.hpp>
+
+// stl
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace node_mapnik {
+
+namespace {
+
+// Deeper documents are left to the geojson plugin.
+constexpr int max_depth = 64;
+
+class geojson_reader
+{
+  public:
+    geojson_reader(char const* data, std::size_t size)
+        : pos_(data),
+          end_(data + size),
+          tr_("utf-8") {}
+
+    std::shared_ptr<mapnik::memory_datasource> read()
+    {
+        if (!read_document()) return nullptr;
+        skip_ws();
+        if (pos_ != end_) return nullptr;
+
+        // The context is complete before the first feature is created, so
+        // every feature shares it as is.
+        mapnik::context_ptr ctx = std::make_shared<mapnik::context_type>();
+        for (auto const& key : keys_)
+        {
+            ctx->push(key);
+        }
+        auto ds = std::make_shared<mapnik::memory_datasource>(mapnik::parameters());
+        std::size_t property = 0;
+        mapnik::value_integer id = 0;
+        for (auto& pending : features_)
+        {
+            ++id;
+            std::size_t const properties_end = property + pending.properties;
+            if (pending.geometry.is<mapnik::geometry::geometry_empty>())
+            {
+                property = properties_end;
+                continue;
+            }
+            mapnik::feature_ptr feature(mapnik::feature_factory::create(ctx, id));
+            for (; property < properties_end; ++property)
+            {
+                auto& prop = properties_[property];
+                feature->put(keys_[prop.first], std::move(prop.second));
+            }
+            feature->set_geometry(std::move(pending.geometry));
+            ds->push(feature);
+        }
+        return ds;
+    }
+
+  private:
+    struct pending_feature
+    {
+        mapnik::geometry::geometry<double> geometry;
+        std::size_t properties = 0;
+    };
+
+    enum class geometry_kind
+    {
+        unknown,
+        point,
+        multi_point,
+        line_string,
+        multi_line_string,
+        polygon,
+        multi_polygon,
+        collection
+    };
+
+    void skip_ws()
+    {
+        while (pos_ != end_ && (*pos_ == ' ' || *pos_ == '\n' || *pos_ == '\r' || *pos_ == '\t'))
+        {
+            ++pos_;
+        }
+    }
+
+    bool consume(char c)
+    {
+        skip_ws();
+        if (pos_ == end_ || *pos_ != c) return false;
+        ++pos_;
+        return true;
+    }
+
+    bool peek(char c)
+    {
+        skip_ws();
+        return pos_ != end_ && *pos_ == c;
+    }
+
+    bool consume_literal(char const* literal)
+    {
+        std::size_t const len = std::strlen(literal);
+        if (static_cast<std::size_t>(end_ - pos_) < len || std::memcmp(pos_, literal, len) != 0) return false;
+        pos_ += len;
+        return true;
+    }
+
+    // Calls `member(key)` for each member of an object, with the reader on
+    // the member's value.
+    template <typename Member>
+    bool read_object(Member&& member)
+    {
+        if (!consume('{')) return false;
+        if (consume('}')) return true;
+        do
+        {
+            skip_ws();
+            if (!read_string(key_) || !consume(':')) return false;
+            if (!member(key_)) return false;
+        } while (consume(','));
+        return consume('}');
+    }
+
+    // Calls `element()` for each element of an array.
+    template <typename Element>
+    bool read_array(Element&& element)
+    {
+        if (!consume('[')) return false;
+        if (consume(']')) return true;
+        do
+        {
+            if (!element()) return false;
+        } while (consume(','));
+        return consume(']');
+    }
+
+    static void append_utf8(std::string& out, std::uint32_t cp)
+    {
+        if (cp < 0x80)
+        {
+            out.push_back(static_cast<char>(cp));
+        }
+        else if (cp < 0x800)
+        {
+            out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+        else if (cp < 0x10000)
+        {
+            out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+        else
+        {
+            out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    bool read_hex4(std::uint32_t& cp)
+    {
+        if (end_ - pos_ < 4) return false;
+        cp = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            char const c = *pos_++;
+            cp <<= 4;
+            if (c >= '0' && c <= '9') cp |= static_cast<std::uint32_t>(c - '0');
+            else if (c >= 'a' && c <= 'f') cp |= static_cast<std::uint32_t>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') cp |= static_cast<std::uint32_t>(c - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+
+    // Reads a string, unescaped to UTF-8, with the reader on its opening quote.
+    bool read_string(std::string& out)
+    {
+        out.clear();
+        if (pos_ == end_ || *pos_ != '"') return false;
+        ++pos_;
+        while (true)
+        {
+            char const* run = pos_;
+            while (pos_ != end_ && *pos_ != '"' && *pos_ != '\\' && static_cast<unsigned char>(*pos_) >= 0x20)
+            {
+                ++pos_;
+            }
+            out.append(run, pos_);
+            if (pos_ == end_) return false;
+            char const c = *pos_++;
+            if (c == '"') return true;
+            if (c != '\\' || pos_ == end_) return false;
+            switch (*pos_++)
+            {
+            case '"': out.push_back('"'); break;
+            case '\\': out.push_back('\\'); break;
+            case '/': out.push_back('/'); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u':
+            {
+                std::uint32_t cp;
+                if (!read_hex4(cp)) return false;
+                if (cp >= 0xD800 && cp < 0xDC00)
+                {
+                    std::uint32_t low;
+                    if (!consume_literal("\\u") || !read_hex4(low) || low < 0xDC00 || low >= 0xE000) return false;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                else if (cp >= 0xDC00 && cp < 0xE000)
+                {
+                    return false;
+                }
+                append_utf8(out, cp);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+    }
+
+    // Reads a number as an integer when it has neither fraction nor
+    // exponent and fits, as a double otherwise.
+    bool read_number(mapnik::value& out)
+    {
+        char const* start = pos_;
+        bool integral = true;
+        if (pos_ != end_ && *pos_ == '-') ++pos_;
+        if (pos_ == end_ || *pos_ < '0' || *pos_ > '9') return false;
+        while (pos_ != end_)
+        {
+            char const c = *pos_;
+            if (c >= '0' && c <= '9')
+            {
+            }
+            else if (c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-')
+            {
+                integral = false;
+            }
+            else
+            {
+                break;
+            }
+            ++pos_;
+        }
+        if (integral)
+        {
+            mapnik::value_integer value;
+            auto result = std::from_chars(start, pos_, value);
+            if (result.ec == std::errc() && result.ptr == pos_)
+            {
+                out = value;
+                return true;
+            }
+        }
+        double value;
+        if (!to_double(start, pos_, value)) return false;
+        out = value;
+        return true;
+    }
+
+    bool read_number(double& out)
+    {
+        char const* start = pos_;
+        while (pos_ != end_ && ((*pos_ >= '0' && *pos_ <= '9') || *pos_ == '-' || *pos_ == '+' ||
+                                *pos_ == '.' || *pos_ == 'e' || *pos_ == 'E'))
+        {
+            ++pos_;
+        }
+        return start != pos_ && to_double(start, pos_, out);
+    }
+
+    static bool to_double(char const* begin, char const* end, double& out)
+    {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        auto result = std::from_chars(begin, end, out);
+        return result.ec == std::errc() && result.ptr == end;
+#else
+        // strtod needs a terminated string, numbers longer than any double
+        // needs are left to the plugin.
+        char buffer[64];
+        std::size_t const len = static_cast<std::size_t>(end - begin);
+        if (len >= sizeof(buffer)) return false;
+        std::memcpy(buffer, begin, len);
+        buffer[len] = '\0';
+        char* parsed;
+        out = std::strtod(buffer, &parsed);
+        return parsed == buffer + len;
+#endif
+    }
+
+    // Skips any value, only used for members the reader has no use for.
+    bool skip_value(int depth)
+    {
+        if (depth > max_depth) return false;
+        skip_ws();
+        if (pos_ == end_) return false;
+        switch (*pos_)
+        {
+        case '{':
+            return read_object([&](std::string const&) { return skip_value(depth + 1); });
+        case '[':
+            return read_array([&]() { return skip_value(depth + 1); });
+        case '"':
+            return read_string(scratch_);
+        case 't':
+            return consume_literal("true");
+        case 'f':
+            return consume_literal("false");
+        case 'n':
+            return consume_literal("null");
+        default:
+        {
+            double ignored;
+            return read_number(ignored);
+        }
+        }
+    }
+
+    bool read_type(std::string& type)
+    {
+        skip_ws();
+        return read_string(type);
+    }
+
+    static geometry_kind kind_of(std::string const& type)
+    {
+        if (type == "Point") return geometry_kind::point;
+        if (type == "MultiPoint") return geometry_kind::multi_point;
+        if (type == "LineString") return geometry_kind::line_string;
+        if (type == "MultiLineString") return geometry_kind::multi_line_string;
+        if (type == "Polygon") return geometry_kind::polygon;
+        if (type == "MultiPolygon") return geometry_kind::multi_polygon;
+        if (type == "GeometryCollection") return geometry_kind::collection;
+        return geometry_kind::unknown;
+    }
+
+    // Reads a coordinates array of any nesting into flat buffers: positions
+    // into points_, ends of position lists into lines_ and ends of lists of
+    // those into polygons_. `depth` is set to the nesting, 1 for a position.
+    bool read_coordinates(int level, int& depth)
+    {
+        if (level > 4 || !consume('[')) return false;
+        skip_ws();
+        if (pos_ == end_) return false;
+        if (*pos_ != '[')
+        {
+            // a position, extra ordinates are ignored
+            double x, y;
+            if (!read_number(x) || !consume(',')) return false;
+            skip_ws();
+            if (!read_number(y)) return false;
+            while (consume(','))
+            {
+                skip_ws();
+                double ignored;
+                if (!read_number(ignored)) return false;
+            }
+            if (!consume(']')) return false;
+            points_.emplace_back(x, y);
+            depth = 1;
+            return true;
+        }
+        // Empty arrays have no nesting to check against, and end up as
+        // empty geometries anyway, so they are left to the plugin.
+        int child_depth = 0;
+        do
+        {
+            int d = 0;
+            if (!read_coordinates(level + 1, d)) return false;
+            if (child_depth != 0 && d != child_depth) return false;
+            child_depth = d;
+        } while (consume(','));
+        if (!consume(']')) return false;
+        depth = child_depth + 1;
+        if (depth == 2) lines_.push_back(points_.size());
+        else if (depth == 3) polygons_.push_back(lines_.size());
+        return true;
+    }
+
+    mapnik::geometry::linear_ring<double> ring(std::size_t line) const
+    {
+        std::size_t const begin = line == 0 ? 0 : lines_[line - 1];
+        return mapnik::geometry::linear_ring<double>(points_.begin() + begin, points_.begin() + lines_[line]);
+    }
+
+    mapnik::geometry::line_string<double> line_string(std::size_t line) const
+    {
+        std::size_t const begin = line == 0 ? 0 : lines_[line - 1];
+        return mapnik::geometry::line_string<double>(points_.begin() + begin, points_.begin() + lines_[line]);
+    }
+
+    std::size_t line_size(std::size_t line) const
+    {
+        return lines_[line] - (line == 0 ? 0 : lines_[line - 1]);
+    }
+
+    // Lines of a single point and rings of fewer than four points are
+    // handled in ways of its own by mapnik's JSON grammar: they are left to
+    // the plugin.
+    bool lines_valid(std::size_t min_size) const
+    {
+        for (std::size_t line = 0; line < lines_.size(); ++line)
+        {
+            if (line_size(line) < min_size) return false;
+        }
+        return true;
+    }
+
+    mapnik::geometry::polygon<double> polygon(std::size_t begin, std::size_t end) const
+    {
+        mapnik::geometry::polygon<double> poly;
+        poly.reserve(end - begin);
+        for (std::size_t line = begin; line < end; ++line)
+        {
+            poly.push_back(ring(line));
+        }
+        return poly;
+    }
+
+    bool build_geometry(geometry_kind kind, int depth, mapnik::geometry::geometry<double>& geom) const
+    {
+        switch (kind)
+        {
+        case geometry_kind::point:
+            if (depth != 1) return false;
+            geom = points_.front();
+            return true;
+        case geometry_kind::multi_point:
+            if (depth != 2) return false;
+            geom = mapnik::geometry::multi_point<double>(points_.begin(), points_.end());
+            return true;
+        case geometry_kind::line_string:
+            if (depth != 2 || !lines_valid(2)) return false;
+            geom = line_string(0);
+            return true;
+        case geometry_kind::multi_line_string:
+        {
+            if (depth != 3 || !lines_valid(2)) return false;
+            mapnik::geometry::multi_line_string<double> lines;
+            lines.reserve(lines_.size());
+            for (std::size_t line = 0; line < lines_.size(); ++line)
+            {
+                lines.push_back(line_string(line));
+            }
+            geom = std::move(lines);
+            return true;
+        }
+        case geometry_kind::polygon:
+            if (depth != 3 || !lines_valid(4)) return false;
+            geom = polygon(0, lines_.size());
+            // closes and orients the rings, as mapnik's JSON grammar does
+            mapnik::geometry::correct(geom);
+            return true;
+        case geometry_kind::multi_polygon:
+        {
+            if (depth != 4 || !lines_valid(4)) return false;
+            mapnik::geometry::multi_polygon<double> polys;
+            polys.reserve(polygons_.size());
+            std::size_t begin = 0;
+            for (std::size_t end : polygons_)
+            {
+                polys.push_back(polygon(begin, end));
+                begin = end;
+            }
+            geom = std::move(polys);
+            mapnik::geometry::correct(geom);
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    // Reads a geometry object, members may come in any order.
+    bool read_geometry(mapnik::geometry::geometry<double>& geom, int depth)
+    {
+        if (depth > max_depth) return false;
+        if (peek('n')) return consume_literal("null");
+        std::string type;
+        int coordinates_depth = 0;
+        bool has_geometries = false;
+        mapnik::geometry::geometry_collection<double> collection;
+        bool ok = read_object([&](std::string const& key) {
+            if (key == "type") return read_type(type);
+            if (key == "coordinates")
+            {
+                points_.clear();
+                lines_.clear();
+                polygons_.clear();
+                return read_coordinates(1, coordinates_depth);
+            }
+            if (key == "geometries")
+            {
+                has_geometries = true;
+                return read_array([&]() {
+                    mapnik::geometry::geometry<double> part;
+                    if (!read_geometry(part, depth + 1)) return false;
+                    collection.push_back(std::move(part));
+                    return true;
+                });
+            }
+            return skip_value(depth + 1);
+        });
+        if (!ok) return false;
+        geometry_kind const kind = kind_of(type);
+        if (kind == geometry_kind::collection)
+        {
+            if (!has_geometries || coordinates_depth != 0) return false;
+            geom = std::move(collection);
+            return true;
+        }
+        if (has_geometries || coordinates_depth == 0) return false;
+        return build_geometry(kind, coordinates_depth, geom);
+    }
+
+    std::size_t key_index(std::string const& key)
+    {
+        auto itr = key_indices_.find(key);
+        if (itr != key_indices_.end()) return itr->second;
+        std::size_t const index = keys_.size();
+        keys_.push_back(key);
+        key_indices_.emplace(key, index);
+        return index;
+    }
+
+    // Reads the properties of a feature, nested objects and arrays are not
+    // read here.
+    bool read_properties(std::size_t& count)
+    {
+        if (peek('n')) return consume_literal("null");
+        return read_object([&](std::string const& key) {
+            std::size_t const index = key_index(key);
+            skip_ws();
+            if (pos_ == end_) return false;
+            mapnik::value value;
+            switch (*pos_)
+            {
+            case '"':
+                if (!read_string(scratch_)) return false;
+                value = tr_.transcode(scratch_.data(), static_cast<std::int32_t>(scratch_.size()));
+                break;
+            case 't':
+                if (!consume_literal("true")) return false;
+                value = true;
+                break;
+            case 'f':
+                if (!consume_literal("false")) return false;
+                value = false;
+                break;
+            case 'n':
+                if (!consume_literal("null")) return false;
+                break;
+            default:
+                if (!read_number(value)) return false;
+                break;
+            }
+            properties_.emplace_back(index, std::move(value));
+            ++count;
+            return true;
+        });
+    }
+
+    // Reads the members of a Feature object, the opening brace included.
+    bool read_feature()
+    {
+        std::string type;
+        pending_feature feature;
+        bool ok = read_object([&](std::string const& key) {
+            if (key == "type") return read_type(type);
+            if (key == "geometry") return read_geometry(feature.geometry, 1);
+            if (key == "properties") return read_properties(feature.properties);
+            return skip_value(1);
+        });
+        if (!ok || type != "Feature") return false;
+        features_.push_back(std::move(feature));
+        return true;
+    }
+
+    // A FeatureCollection, or a lone Feature. Which one it is is only known
+    // once "type" is seen, which may come after the other members.
+    bool read_document()
+    {
+        std::string type;
+        pending_feature feature;
+        bool has_features = false;
+        bool has_feature_members = false;
+        bool ok = read_object([&](std::string const& key) {
+            if (key == "type") return read_type(type);
+            if (key == "features")
+            {
+                has_features = true;
+                return read_array([&]() { return read_feature(); });
+            }
+            if (key == "geometry")
+            {
+                has_feature_members = true;
+                return read_geometry(feature.geometry, 1);
+            }
+            if (key == "properties")
+            {
+                has_feature_members = true;
+                return read_properties(feature.properties);
+            }
+            return skip_value(1);
+        });
+        if (!ok) return false;
+        if (type == "FeatureCollection")
+        {
+            return has_features && !has_feature_members;
+        }
+        if (type == "Feature")
+        {
+            if (has_features) return false;
+            features_.push_back(std::move(feature));
+            return true;
+        }
+        return false;
+    }
+
+    char const* pos_;
+    char const* end_;
+    mapnik::transcoder tr_;
+    std::string key_;
+    std::string scratch_;
+    std::vector<std::string> keys_;
+    std::unordered_map<std::string, std::size_t> key_indices_;
+    std::vector<std::pair<std::size_t, mapnik::value>> properties_;
+    std::vector<pending_feature> features_;
+    std::vector<mapnik::geometry::point<double>> points_;
+    std::vector<std::size_t> lines_;
+    std::vector<std::size_t> polygons_;
+};
+
+} // namespace
+
+std::shared_ptr<mapnik::memory_datasource> read_geojson(char const* data, std::size_t size)
+{
+    return geojson_reader(data, size).read();
+}
+
+} // namespace node_mapnik
@@ -0,0 +1,27 @@
+#pragma once
+
+// mapnik
+#include <mapnik/memory_datasource.hpp>
+
+// stl
+#include <cstddef>
+#include <memory>
+
+namespace node_mapnik {
+
+// Reads a GeoJSON FeatureCollection, or a single Feature, in WGS84 straight
+// into a memory datasource, in a single pass over the text. Features are
+// numbered from 1 in document order and properties are typed like mapnik's
+// geojson plugin types them.
+//
+// Polygons are closed and oriented like mapnik's JSON grammar does, so that
+// the features are the same as the geojson plugin's.
+//
+// Returns nullptr for documents that are not plain enough for the reader:
+// nested property values, empty coordinate arrays, lines of a single point,
+// rings of fewer than four points, top level geometries or malformed JSON.
+// Callers then go through the geojson plugin, which handles and reports those
+// as it always did.
+std::shared_ptr<mapnik::memory_datasource> read_geojson(char const* data, std::size_t size);
+
+} // namespace node_mapnik
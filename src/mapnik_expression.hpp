@@ -11,8 +11,9 @@ class Expression : public Napi::ObjectWrap<Expression>
     explicit Expression(Napi::CallbackInfo const& info);
     Napi::Value toString(Napi::CallbackInfo const& info);
     Napi::Value evaluate(Napi::CallbackInfo const& info);
+    inline mapnik::expression_ptr impl() const { return expression_; }
+    static Napi::FunctionReference constructor;
 
   private:
-    static Napi::FunctionReference constructor;
     mapnik::expression_ptr expression_;
 };
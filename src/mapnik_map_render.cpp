@@ -293,6 +293,7 @@ struct AsyncRenderVectorTile : AsyncRender
 {
     AsyncRenderVectorTile(Map* map_obj,
                           mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                          std::shared_ptr<node_mapnik::vector_tile_query_index> const& query_index,
                           double area_threshold,
                           double scale_factor,
                           double scale_denominator,
@@ -310,6 +311,7 @@ struct AsyncRenderVectorTile : AsyncRender
                           Napi::Function const& callback)
         : AsyncRender(map_obj, callback),
           tile_(tile),
+          query_index_(query_index),
           area_threshold_(area_threshold),
           scale_factor_(scale_factor),
           scale_denominator_(scale_denominator),
@@ -354,12 +356,14 @@ struct AsyncRenderVectorTile : AsyncRender
     std::vector<napi_value> GetResult(Napi::Env env) override
     {
         Napi::Value arg = Napi::External<mapnik::vector_tile_impl::merc_tile_ptr>::New(env, &tile_);
-        Napi::Object obj = VectorTile::constructor.New({arg});
+        Napi::Value index = Napi::External<std::shared_ptr<node_mapnik::vector_tile_query_index>>::New(env, &query_index_);
+        Napi::Object obj = VectorTile::constructor.New({arg, index});
         return {env.Undefined(), napi_value(obj)};
     }
 
   private:
     mapnik::vector_tile_impl::merc_tile_ptr tile_;
+    std::shared_ptr<node_mapnik::vector_tile_query_index> query_index_;
     double area_threshold_;
     double scale_factor_;
     double scale_denominator_;
@@ -848,10 +852,12 @@ Napi::Value Map::render(Napi::CallbackInfo const& info)
 
             if (vt && vt->impl())
             {
+                vt->detach_exported_data();
                 this->Ref();
                 auto* worker = new detail::AsyncRenderVectorTile{
                     this,
                     vt->impl(),
+                    vt->query_index(),
                     area_threshold,
                     scale_factor,
                     scale_denominator,
@@ -1,10 +1,18 @@
 #include "mapnik_projection.hpp"
+#include "mercator.hpp"
+#include "projection_cache.hpp"
+#include "thread_pool.hpp"
 #include "utils.hpp"
 
 #include <mapnik/geometry/box2d.hpp>
 #include <mapnik/proj_transform.hpp>
 #include <mapnik/projection.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
 #include <sstream>
+#include <vector>
 
 Napi::FunctionReference Projection::constructor;
 
@@ -268,7 +276,9 @@ Napi::Object ProjTransform::Initialize(Napi::Env env, Napi::Object exports, napi
     // clang-format off
     Napi::Function func = DefineClass(env, "ProjTransform", {
             InstanceMethod<&ProjTransform::forward>("forward", prop_attr),
-            InstanceMethod<&ProjTransform::backward>("backward", prop_attr)
+            InstanceMethod<&ProjTransform::backward>("backward", prop_attr),
+            InstanceMethod<&ProjTransform::forwardArray>("forwardArray", prop_attr),
+            InstanceMethod<&ProjTransform::backwardArray>("backwardArray", prop_attr)
          });
     // clang-format on
     constructor = Napi::Persistent(func);
@@ -310,6 +320,8 @@ ProjTransform::ProjTransform(Napi::CallbackInfo const& info)
     try
     {
         proj_transform_ = std::make_shared<mapnik::proj_transform>(*p1->projection_, *p2->projection_);
+        source_srs_ = p1->projection_->params();
+        dest_srs_ = p2->projection_->params();
     }
     catch (std::exception const& ex)
     {
@@ -456,3 +468,230 @@ Napi::Value ProjTransform::backward(Napi::CallbackInfo const& info)
         }
     }
 }
+
+namespace {
+
+// Arrays with fewer points than this are transformed by a single thread.
+constexpr std::size_t min_points_per_thread = 1 << 16;
+
+using mercator_fn = void (*)(double*, std::size_t);
+
+// The vectorized kernel transforming from `source` to `dest` (or back) when
+// they are epsg:4326 and epsg:3857, nullptr otherwise.
+mercator_fn mercator_kernel_for(std::string const& source, std::string const& dest, bool forward)
+{
+    std::string const& from = forward ? source : dest;
+    std::string const& to = forward ? dest : source;
+    if (from == "epsg:4326" && to == "epsg:3857") return node_mapnik::lonlat_to_merc;
+    if (from == "epsg:3857" && to == "epsg:4326") return node_mapnik::merc_to_lonlat;
+    return nullptr;
+}
+
+// Transforms `count` interleaved x,y pairs in place, with `mercator` when set
+// and `tr` otherwise. Points that could not be transformed are set to NaN and
+// their bit is set in `failures`, where point i (counted from `first`) is bit
+// i % 8 of byte i / 8.
+void transform_points(mapnik::proj_transform const* tr,
+                      mercator_fn mercator,
+                      bool forward,
+                      double* coords,
+                      std::size_t count,
+                      std::uint8_t* failures,
+                      std::size_t first)
+{
+    if (count == 0) return;
+    // errors are reported per point below, as non finite coordinates
+    if (mercator)
+    {
+        mercator(coords, count);
+    }
+    else if (forward)
+    {
+        tr->forward(coords, coords + 1, nullptr, count, 2);
+    }
+    else
+    {
+        tr->backward(coords, coords + 1, nullptr, count, 2);
+    }
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        double& x = coords[2 * i];
+        double& y = coords[2 * i + 1];
+        if (!std::isfinite(x) || !std::isfinite(y))
+        {
+            x = y = std::numeric_limits<double>::quiet_NaN();
+            std::size_t const p = first + i;
+            failures[p / 8] |= static_cast<std::uint8_t>(1u << (p % 8));
+        }
+    }
+}
+
+struct AsyncTransformArray : Napi::AsyncWorker
+{
+    using Base = Napi::AsyncWorker;
+    AsyncTransformArray(Napi::Float64Array const& coords,
+                        std::string const& source_srs,
+                        std::string const& dest_srs,
+                        bool forward,
+                        Napi::Function const& callback)
+        : Base(callback),
+          coords_ref_{Napi::Persistent(coords)},
+          coords_{coords.Data()},
+          count_{coords.ElementLength() / 2},
+          source_srs_{source_srs},
+          dest_srs_{dest_srs},
+          forward_{forward},
+          failures_((count_ + 7) / 8, 0)
+    {
+    }
+
+    void Execute() override
+    {
+        try
+        {
+            // PROJ objects can't be shared between threads, each chunk leases
+            // a transform of its own. Chunks cover whole bytes of the bitmask
+            // and are spread over this thread and the shared thread pool.
+            std::size_t const threads = node_mapnik::thread_pool::instance().size() + 1;
+            std::size_t chunk = std::max(min_points_per_thread, (count_ + threads - 1) / threads);
+            chunk = (chunk + 7) / 8 * 8;
+            std::size_t const chunks = (count_ + chunk - 1) / chunk;
+            node_mapnik::parallel_for(chunks, threads, [this, chunk](std::size_t c) {
+                std::size_t const first = c * chunk;
+                std::size_t const count = std::min(chunk, count_ - first);
+                mercator_fn mercator = mercator_kernel_for(source_srs_, dest_srs_, forward_);
+                if (mercator)
+                {
+                    transform_points(nullptr, mercator, forward_, coords_ + 2 * first, count, failures_.data(), first);
+                }
+                else
+                {
+                    auto tr = node_mapnik::acquire_transform(source_srs_, dest_srs_);
+                    transform_points(tr.get(), nullptr, forward_, coords_ + 2 * first, count, failures_.data(), first);
+                }
+            });
+        }
+        catch (std::exception const& ex)
+        {
+            SetError(ex.what());
+        }
+    }
+
+    std::vector<napi_value> GetResult(Napi::Env env) override
+    {
+        Napi::Uint8Array failures = Napi::Uint8Array::New(env, failures_.size());
+        if (!failures_.empty())
+        {
+            std::memcpy(failures.Data(), failures_.data(), failures_.size());
+        }
+        return {env.Null(), napi_value(failures)};
+    }
+
+  private:
+    Napi::Reference<Napi::Float64Array> coords_ref_;
+    double* coords_;
+    std::size_t count_;
+    std::string source_srs_;
+    std::string dest_srs_;
+    bool forward_;
+    std::vector<std::uint8_t> failures_;
+};
+
+} // namespace
+
+/**
+ * Transform many positions at once, in place, from the source to the
+ * destination projection.
+ *
+ * Positions are stored as interleaved `x, y` pairs. Positions that could not
+ * be transformed are set to `NaN` and flagged in the returned bitmask rather
+ * than raising an error: position `i` failed when bit `i % 8` of byte
+ * `Math.floor(i / 8)` is set.
+ *
+ * When a callback is given the positions are transformed off the main
+ * thread, with large arrays split across threads. The array must not be
+ * modified until the callback is called.
+ *
+ * Between `epsg:4326` and `epsg:3857` positions go through vectorized code on
+ * CPUs that support it. Results then agree with `forward` and `backward` to
+ * within 5e-8 m and 1e-13 degrees rather than bit for bit, and can differ in
+ * their last bits between machines.
+ *
+ * @name forwardArray
+ * @memberof ProjTransform
+ * @instance
+ * @param {Float64Array} coords positions as [x0, y0, x1, y1, ...]
+ * @param {Function} [callback] called with (err, failures)
+ * @returns {Uint8Array} failures bitmask, if no callback is provided
+ * @example
+ * var trans = new mapnik.ProjTransform(new mapnik.Projection('epsg:4326'),
+ *                                      new mapnik.Projection('epsg:3857'));
+ * var coords = new Float64Array([-122.33517, 47.63752, 0, 0]);
+ * var failures = trans.forwardArray(coords);
+ * // coords now holds mercator positions, failures[0] === 0
+ */
+Napi::Value ProjTransform::forwardArray(Napi::CallbackInfo const& info)
+{
+    return transformArray(info, true);
+}
+
+/**
+ * Transform many positions at once, in place, from the destination to the
+ * source projection. Same arguments and results as `forwardArray`.
+ *
+ * @name backwardArray
+ * @memberof ProjTransform
+ * @instance
+ * @param {Float64Array} coords positions as [x0, y0, x1, y1, ...]
+ * @param {Function} [callback] called with (err, failures)
+ * @returns {Uint8Array} failures bitmask, if no callback is provided
+ */
+Napi::Value ProjTransform::backwardArray(Napi::CallbackInfo const& info)
+{
+    return transformArray(info, false);
+}
+
+Napi::Value ProjTransform::transformArray(Napi::CallbackInfo const& info, bool forward)
+{
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsTypedArray() ||
+        info[0].As<Napi::TypedArray>().TypedArrayType() != napi_float64_array)
+    {
+        Napi::TypeError::New(env, "Must provide a Float64Array of interleaved x,y positions")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    Napi::Float64Array coords = info[0].As<Napi::Float64Array>();
+    if (coords.ElementLength() % 2 != 0)
+    {
+        Napi::TypeError::New(env, "Float64Array length must be even")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (info.Length() > 1)
+    {
+        if (!info[1].IsFunction())
+        {
+            Napi::TypeError::New(env, "last argument must be a callback function")
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        auto* worker = new AsyncTransformArray(coords, source_srs_, dest_srs_, forward,
+                                               info[1].As<Napi::Function>());
+        worker->Queue();
+        return env.Undefined();
+    }
+    std::size_t const count = coords.ElementLength() / 2;
+    Napi::Uint8Array failures = Napi::Uint8Array::New(env, (count + 7) / 8);
+    try
+    {
+        transform_points(proj_transform_.get(), mercator_kernel_for(source_srs_, dest_srs_, forward),
+                         forward, coords.Data(), count, failures.Data(), 0);
+    }
+    catch (std::exception const& ex)
+    {
+        Napi::Error::New(env, ex.what()).ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    return failures;
+}
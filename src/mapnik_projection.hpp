@@ -48,9 +48,16 @@ class ProjTransform : public Napi::ObjectWrap<ProjTransform>
     // methods
     Napi::Value forward(Napi::CallbackInfo const& info);
     Napi::Value backward(Napi::CallbackInfo const& info);
+    Napi::Value forwardArray(Napi::CallbackInfo const& info);
+    Napi::Value backwardArray(Napi::CallbackInfo const& info);
     inline proj_tr_ptr impl() { return proj_transform_; }
 
   private:
+    Napi::Value transformArray(Napi::CallbackInfo const& info, bool forward);
     static Napi::FunctionReference constructor;
     proj_tr_ptr proj_transform_;
+    // definitions of the two projections, for worker threads to lease
+    // transforms of their own
+    std::string source_srs_;
+    std::string dest_srs_;
 };
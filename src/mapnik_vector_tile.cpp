@@ -85,7 +85,9 @@ Napi::Object VectorTile::Initialize(Napi::Env env, Napi::Object exports, napi_pr
             InstanceMethod<&VectorTile::clearSync>("clearSync", prop_attr),
             InstanceMethod<&VectorTile::empty>("empty", prop_attr),
             // static methods
-            StaticMethod<&VectorTile::info>("info", prop_attr)
+            StaticMethod<&VectorTile::info>("info", prop_attr),
+            StaticMethod<&VectorTile::queryTiles>("queryTiles", prop_attr),
+            StaticMethod<&VectorTile::queryStats>("queryStats", prop_attr)
         });
     // clang-format on
     constructor = Napi::Persistent(func);
@@ -120,10 +122,17 @@ VectorTile::VectorTile(Napi::CallbackInfo const& info)
     : Napi::ObjectWrap<VectorTile>(info)
 {
     Napi::Env env = info.Env();
-    if (info.Length() == 1 && info[0].IsExternal())
+    if ((info.Length() == 1 || info.Length() == 2) && info[0].IsExternal())
     {
         auto ext = info[0].As<Napi::External<mapnik::vector_tile_impl::merc_tile_ptr>>();
         if (ext) tile_ = *ext.Data();
+        // Wrappers of the same tile share its query index, so that replacing
+        // the data through one of them invalidates it for all.
+        if (info.Length() == 2 && info[1].IsExternal())
+        {
+            auto index = info[1].As<Napi::External<std::shared_ptr<node_mapnik::vector_tile_query_index>>>();
+            if (index) query_index_ = *index.Data();
+        }
         return;
     }
 
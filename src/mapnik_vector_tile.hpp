@@ -5,6 +5,7 @@
 #include <napi.h>
 // mapnik-vector-tile
 #include "vector_tile_merc_tile.hpp"
+#include "mapnik_vector_tile_query_index.hpp"
 // mapnik
 #include <mapnik/feature.hpp>
 // boost
@@ -23,10 +24,14 @@ struct query_result
     double x_hit;
     double y_hit;
     mapnik::feature_ptr feature;
+    // Whether the id of the feature was encoded in the tile, rather than
+    // being its position in the layer.
+    bool encoded_id;
     explicit query_result() : layer(),
                               distance(0),
                               x_hit(0),
-                              y_hit(0) {}
+                              y_hit(0),
+                              encoded_id(false) {}
 };
 
 struct query_hit
@@ -39,6 +44,8 @@ struct queryMany_result
 {
     std::map<unsigned, query_result> features;
     std::map<unsigned, std::vector<query_hit>> hits;
+    // the attributes requested from each feature
+    std::vector<std::string> fields;
 };
 namespace detail {
 struct AsyncRenderVectorTile;
@@ -90,6 +97,8 @@ class VectorTile : public Napi::ObjectWrap<VectorTile>
 #endif // BOOST_VERSION >= 105800
     // static methods
     static Napi::Value info(Napi::CallbackInfo const& info);
+    static Napi::Value queryTiles(Napi::CallbackInfo const& info);
+    static Napi::Value queryStats(Napi::CallbackInfo const& info);
     // accessors
     Napi::Value get_tile_x(Napi::CallbackInfo const& info);
     void set_tile_x(Napi::CallbackInfo const& info, const Napi::Value& value);
@@ -102,8 +111,17 @@ class VectorTile : public Napi::ObjectWrap<VectorTile>
     Napi::Value get_buffer_size(Napi::CallbackInfo const& info);
     void set_buffer_size(Napi::CallbackInfo const& info, const Napi::Value& value);
     inline mapnik::vector_tile_impl::merc_tile_ptr impl() const { return tile_; }
+    inline std::shared_ptr<node_mapnik::vector_tile_query_index> query_index() const { return query_index_; }
+    // Must be called before the data of the tile is modified, so that buffers
+    // returned by getData keep the bytes they were given.
+    void detach_exported_data(bool copy_data = true);
+    Napi::Value exported_data(Napi::Env env, long other_holders = 0);
     static Napi::FunctionReference constructor;
 
   private:
     mapnik::vector_tile_impl::merc_tile_ptr tile_;
+    // Set while buffers returned by getData share the data of tile_: each of
+    // them holds a copy of this pointer.
+    std::shared_ptr<mapnik::vector_tile_impl::merc_tile_ptr> exported_;
+    std::shared_ptr<node_mapnik::vector_tile_query_index> query_index_ = std::make_shared<node_mapnik::vector_tile_query_index>();
 };
@@ -4,15 +4,19 @@ namespace {
 
 struct AsyncClear : Napi::AsyncWorker
 {
-    AsyncClear(mapnik::vector_tile_impl::merc_tile_ptr const& tile, Napi::Function const& callback)
+    AsyncClear(mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+               std::shared_ptr<node_mapnik::vector_tile_query_index> const& query_index,
+               Napi::Function const& callback)
         : Napi::AsyncWorker(callback),
-          tile_(tile) {}
+          tile_(tile),
+          query_index_(query_index) {}
 
     void Execute() override
     {
         try
         {
             tile_->clear();
+            query_index_->clear();
         }
         catch (std::exception const& ex)
         {
@@ -25,6 +29,7 @@ struct AsyncClear : Napi::AsyncWorker
 
   private:
     mapnik::vector_tile_impl::merc_tile_ptr tile_;
+    std::shared_ptr<node_mapnik::vector_tile_query_index> query_index_;
 };
 } // namespace
 
@@ -40,7 +45,9 @@ struct AsyncClear : Napi::AsyncWorker
 Napi::Value VectorTile::clearSync(Napi::CallbackInfo const& info)
 {
     Napi::Env env = info.Env();
+    detach_exported_data(false);
     tile_->clear();
+    query_index_->clear();
     return env.Undefined();
 }
 
@@ -73,7 +80,8 @@ Napi::Value VectorTile::clear(Napi::CallbackInfo const& info)
         Napi::TypeError::New(env, "last argument must be a callback function").ThrowAsJavaScriptException();
         return env.Undefined();
     }
-    auto* worker = new AsyncClear(tile_, callback.As<Napi::Function>());
+    detach_exported_data(false);
+    auto* worker = new AsyncClear(tile_, query_index_, callback.As<Napi::Function>());
     worker->Queue();
     return env.Undefined();
 }
@@ -349,6 +349,7 @@ Napi::Value VectorTile::compositeSync(Napi::CallbackInfo const& info)
         }
         vtiles_vec.push_back(Napi::ObjectWrap<VectorTile>::Unwrap(tile_obj)->tile_);
     }
+    detach_exported_data();
     try
     {
         _composite(tile_,
@@ -384,6 +385,7 @@ namespace {
 struct AsyncCompositeVectorTile : Napi::AsyncWorker
 {
     AsyncCompositeVectorTile(tile_type const& tile,
+                             std::shared_ptr<node_mapnik::vector_tile_query_index> const& query_index,
                              std::vector<tile_type> const& vtiles,
                              double scale_factor,
                              unsigned offset_x,
@@ -403,6 +405,7 @@ struct AsyncCompositeVectorTile : Napi::AsyncWorker
                              Napi::Function const& callback)
         : Napi::AsyncWorker(callback),
           tile_(tile),
+          query_index_(query_index),
           vtiles_(vtiles),
           scale_factor_(scale_factor),
           offset_x_(offset_x),
@@ -452,12 +455,14 @@ struct AsyncCompositeVectorTile : Napi::AsyncWorker
     std::vector<napi_value> GetResult(Napi::Env env) override
     {
         Napi::Value arg = Napi::External<mapnik::vector_tile_impl::merc_tile_ptr>::New(env, &tile_);
-        Napi::Object obj = VectorTile::constructor.New({arg});
+        Napi::Value index = Napi::External<std::shared_ptr<node_mapnik::vector_tile_query_index>>::New(env, &query_index_);
+        Napi::Object obj = VectorTile::constructor.New({arg, index});
         return {env.Undefined(), napi_value(obj)};
     }
 
   private:
     tile_type tile_;
+    std::shared_ptr<node_mapnik::vector_tile_query_index> query_index_;
     std::vector<tile_type> vtiles_;
     double scale_factor_;
     unsigned offset_x_;
@@ -818,7 +823,9 @@ Napi::Value VectorTile::composite(Napi::CallbackInfo const& info)
         vtiles_vec.push_back(Napi::ObjectWrap<VectorTile>::Unwrap(tile_obj)->tile_);
     }
 
+    detach_exported_data();
     auto* worker = new AsyncCompositeVectorTile{tile_,
+                                                query_index_,
                                                 vtiles_vec,
                                                 scale_factor,
                                                 offset_x,
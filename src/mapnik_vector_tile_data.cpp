@@ -7,12 +7,14 @@ struct AsyncSetData : Napi::AsyncWorker
 {
     using Base = Napi::AsyncWorker;
     AsyncSetData(mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                 std::shared_ptr<node_mapnik::vector_tile_query_index> const& query_index,
                  Napi::Buffer<char> const& buffer,
                  bool validate,
                  bool upgrade,
                  Napi::Function const& callback)
         : Base(callback),
           tile_(tile),
+          query_index_(query_index),
           buffer_ref{Napi::Persistent(buffer)},
           data_{buffer.Data()},
           length_{buffer.Length()},
@@ -29,6 +31,7 @@ struct AsyncSetData : Napi::AsyncWorker
         try
         {
             tile_->clear();
+            query_index_->clear();
             merge_from_compressed_buffer(*tile_, data_, length_, validate_, upgrade_);
         }
         catch (std::exception const& ex)
@@ -43,6 +46,7 @@ struct AsyncSetData : Napi::AsyncWorker
 
   private:
     mapnik::vector_tile_impl::merc_tile_ptr tile_;
+    std::shared_ptr<node_mapnik::vector_tile_query_index> query_index_;
     Napi::Reference<Napi::Buffer<char>> buffer_ref;
     char const* data_;
     std::size_t length_;
@@ -53,14 +57,20 @@ struct AsyncSetData : Napi::AsyncWorker
 struct AsyncGetData : Napi::AsyncWorker
 {
     using Base = Napi::AsyncWorker;
-    AsyncGetData(mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+    AsyncGetData(VectorTile* vtile,
+                 Napi::Object const& vtile_obj,
+                 mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                 std::shared_ptr<node_mapnik::vector_tile_query_index> const& query_index,
                  bool compress,
                  bool release,
                  int level,
                  int strategy,
                  Napi::Function const& callback)
         : Base(callback),
+          vtile_(vtile),
+          vtile_ref_{Napi::Persistent(vtile_obj)},
           tile_(tile),
+          query_index_(query_index),
           compress_(compress),
           release_(release),
           level_(level),
@@ -94,7 +104,11 @@ struct AsyncGetData : Napi::AsyncWorker
         }
         else if (compress_ && data_)
         {
-            if (release_) tile_->clear();
+            if (release_)
+            {
+                tile_->clear();
+                query_index_->clear();
+            }
             std::string& data = *data_;
             auto buffer = Napi::Buffer<char>::New(
                 Env(),
@@ -115,6 +129,7 @@ struct AsyncGetData : Napi::AsyncWorker
         {
             if (release_)
             {
+                query_index_->clear();
                 std::unique_ptr<std::string> ptr = tile_->release_buffer();
                 std::string& data = *ptr;
                 auto buffer = Napi::Buffer<char>::New(
@@ -132,6 +147,11 @@ struct AsyncGetData : Napi::AsyncWorker
                 Napi::MemoryManagement::AdjustExternalMemory(env, static_cast<std::int64_t>(data.size()));
                 return {env.Undefined(), buffer};
             }
+            else if (vtile_->impl() == tile_)
+            {
+                // the tile is also held by this worker
+                return {env.Undefined(), vtile_->exported_data(env, 1)};
+            }
             else
             {
                 return {env.Undefined(), Napi::Buffer<char>::Copy(env, (char*)tile_->data(), raw_size)};
@@ -141,7 +161,10 @@ struct AsyncGetData : Napi::AsyncWorker
     }
 
   private:
+    VectorTile* vtile_;
+    Napi::ObjectReference vtile_ref_;
     mapnik::vector_tile_impl::merc_tile_ptr tile_;
+    std::shared_ptr<node_mapnik::vector_tile_query_index> query_index_;
     bool compress_;
     bool release_;
     int level_;
@@ -267,9 +290,11 @@ Napi::Value VectorTile::setDataSync(Napi::CallbackInfo const& info)
             upgrade = param_val.As<Napi::Boolean>();
         }
     }
+    detach_exported_data(false);
     try
     {
         tile_->clear();
+        query_index_->clear();
         merge_from_compressed_buffer(*tile_, obj.As<Napi::Buffer<char>>().Data(), buffer_size, validate, upgrade);
     }
     catch (std::exception const& ex)
@@ -353,11 +378,56 @@ Napi::Value VectorTile::setData(Napi::CallbackInfo const& info)
         }
     }
     Napi::Function callback = info[info.Length() - 1].As<Napi::Function>();
-    auto* worker = new AsyncSetData(tile_, obj.As<Napi::Buffer<char>>(), validate, upgrade, callback);
+    detach_exported_data(false);
+    auto* worker = new AsyncSetData(tile_, query_index_, obj.As<Napi::Buffer<char>>(), validate, upgrade, callback);
     worker->Queue();
     return env.Undefined();
 }
 
+// Replaces the tile if buffers returned by getData still share its data, so
+// that they keep the bytes they were given. The new tile is a copy, or an
+// empty tile at the same coordinates when its data is about to be dropped.
+void VectorTile::detach_exported_data(bool copy_data)
+{
+    if (exported_ && exported_.use_count() > 1)
+    {
+        if (copy_data)
+        {
+            tile_ = std::make_shared<mapnik::vector_tile_impl::merc_tile>(*tile_);
+        }
+        else
+        {
+            tile_ = std::make_shared<mapnik::vector_tile_impl::merc_tile>(tile_->x(), tile_->y(), tile_->z(), tile_->tile_size(), tile_->buffer_size());
+        }
+    }
+    exported_.reset();
+}
+
+// Returns the data of the tile as a Buffer sharing its memory, which keeps the
+// tile alive. This is only safe while nothing else can modify the tile, so the
+// data is copied when it is held by another wrapper or by a queued worker,
+// other than the `other_holders` of the caller.
+Napi::Value VectorTile::exported_data(Napi::Env env, long other_holders)
+{
+    long const holders = other_holders + (exported_ ? 2 : 1);
+    if (tile_.use_count() != holders)
+    {
+        return Napi::Buffer<char>::Copy(env, (char*)tile_->data(), tile_->size());
+    }
+    if (!exported_)
+    {
+        exported_ = std::make_shared<mapnik::vector_tile_impl::merc_tile_ptr>(tile_);
+    }
+    return Napi::Buffer<char>::New(
+        env,
+        const_cast<char*>(tile_->data()),
+        tile_->size(),
+        [](Napi::Env /*unused*/, char* /*unused*/, std::shared_ptr<mapnik::vector_tile_impl::merc_tile_ptr>* tile_ptr) {
+            delete tile_ptr;
+        },
+        new std::shared_ptr<mapnik::vector_tile_impl::merc_tile_ptr>(exported_));
+}
+
 /**
  * Get the data in this vector tile as a buffer (synchronous)
  *
@@ -369,7 +439,9 @@ Napi::Value VectorTile::setData(Napi::CallbackInfo const& info)
  * @param {boolean} [options.release=false] releases VT buffer
  * @param {int} [options.level=0] a number `0` (no compression) to `9` (best compression)
  * @param {string} options.strategy must be `FILTERED`, `HUFFMAN_ONLY`, `RLE`, `FIXED`, `DEFAULT`
- * @returns {Buffer} raw data
+ * @returns {Buffer} raw data. Uncompressed data shares the memory of the tile
+ * rather than being copied: the tile is copied instead if it is modified
+ * while the buffer is still around, which leaves the buffer unchanged.
  * @example
  * var data = vt.getData({
  *   compression: 'gzip',
@@ -470,6 +542,7 @@ Napi::Value VectorTile::getDataSync(Napi::CallbackInfo const& info)
         }
     }
 
+    if (release) detach_exported_data();
     try
     {
         std::size_t raw_size = tile_->size();
@@ -498,6 +571,7 @@ Napi::Value VectorTile::getDataSync(Napi::CallbackInfo const& info)
             {
                 if (release)
                 {
+                    query_index_->clear();
                     std::unique_ptr<std::string> ptr = tile_->release_buffer();
                     std::string& data = *ptr;
                     auto buffer = Napi::Buffer<char>::New(
@@ -517,7 +591,7 @@ Napi::Value VectorTile::getDataSync(Napi::CallbackInfo const& info)
                 }
                 else
                 {
-                    return scope.Escape(Napi::Buffer<char>::Copy(env, (char*)tile_->data(), raw_size));
+                    return scope.Escape(exported_data(env));
                 }
             }
             else
@@ -528,6 +602,7 @@ Napi::Value VectorTile::getDataSync(Napi::CallbackInfo const& info)
                 {
                     // To keep the same behaviour as a non compression release, we want to clear the VT buffer
                     tile_->clear();
+                    query_index_->clear();
                 }
 
                 std::string& data = *compressed;
@@ -571,7 +646,8 @@ Napi::Value VectorTile::getDataSync(Napi::CallbackInfo const& info)
  * @param {boolean} [options.release=false] releases VT buffer
  * @param {int} [options.level=0] a number `0` (no compression) to `9` (best compression)
  * @param {string} options.strategy must be `FILTERED`, `HUFFMAN_ONLY`, `RLE`, `FIXED`, `DEFAULT`
- * @param {Function} callback
+ * @param {Function} callback - called with the data, which is shared with the
+ * tile as for {@link VectorTile#getDataSync}
  * @example
  * vt.getData({
  *   compression: 'gzip',
@@ -684,7 +760,8 @@ Napi::Value VectorTile::getData(Napi::CallbackInfo const& info)
         }
     }
 
-    auto* worker = new AsyncGetData(tile_, compress, release, level, strategy, callback.As<Napi::Function>());
+    if (release) detach_exported_data();
+    auto* worker = new AsyncGetData(this, Value(), tile_, query_index_, compress, release, level, strategy, callback.As<Napi::Function>());
     worker->Queue();
     return env.Undefined();
 }
@@ -762,6 +839,7 @@ Napi::Value VectorTile::addDataSync(Napi::CallbackInfo const& info)
             upgrade = param_val.As<Napi::Boolean>();
         }
     }
+    detach_exported_data();
     try
     {
         merge_from_compressed_buffer(*tile_, obj.As<Napi::Buffer<char>>().Data(), buffer_size, validate, upgrade);
@@ -850,6 +928,7 @@ Napi::Value VectorTile::addData(Napi::CallbackInfo const& info)
         }
     }
     Napi::Function callback = info[info.Length() - 1].As<Napi::Function>();
+    detach_exported_data();
     auto* worker = new AsyncAddData(tile_, obj.As<Napi::Buffer<char>>(), validate, upgrade, callback);
     worker->Queue();
     return env.Undefined();
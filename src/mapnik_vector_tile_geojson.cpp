@@ -0,0 +1,885 @@
+#include "mapnik_vector_tile_geojson.hpp"
+#include "mapnik_vector_tile_query_index.hpp"
+#include "mercator.hpp"
+#include "projection_cache.hpp"
+
+// mapnik
+#include <mapnik/attribute.hpp>
+#include <mapnik/expression_evaluator.hpp>
+#include <mapnik/feature_factory.hpp>
+#include <mapnik/geometry/envelope.hpp>
+#include <mapnik/value.hpp>
+#include <mapnik/well_known_srs.hpp>
+// mapnik-vector-tile
+#include "vector_tile_config.hpp"
+#include "vector_tile_geometry_decoder.hpp"
+// protozero
+#include <protozero/varint.hpp>
+
+// stl
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace node_mapnik {
+
+namespace {
+
+enum : std::uint32_t
+{
+    geom_point = 1,
+    geom_linestring = 2,
+    geom_polygon = 3,
+    cmd_move_to = 1,
+    cmd_line_to = 2
+};
+
+void append_integer(std::string& result, std::int64_t value)
+{
+    char buffer[24];
+    auto end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+    result.append(buffer, end);
+}
+
+// The shortest representation that parses back to the same double.
+void append_double(std::string& result, double value)
+{
+    if (!std::isfinite(value))
+    {
+        result += "null";
+        return;
+    }
+    char buffer[32];
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    auto end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+    result.append(buffer, end);
+#else
+    // libc++ has no floating point to_chars on every deployment target
+    int size = 0;
+    for (int precision = 15; precision <= 17; ++precision)
+    {
+        size = std::snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+        if (std::strtod(buffer, nullptr) == value) break;
+    }
+    result.append(buffer, static_cast<std::size_t>(size));
+#endif
+}
+
+// Rounded to `decimals` decimals, without trailing zeros. Values too large
+// for the rounding to fit a double's mantissa have no more decimals than that
+// anyway and are written in full.
+void append_fixed(std::string& result, double value, int decimals)
+{
+    static double const powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+                                    1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+    double scaled = value * powers[decimals];
+    if (!(std::abs(scaled) < 9007199254740992.0))
+    {
+        append_double(result, value);
+        return;
+    }
+    auto rounded = static_cast<std::int64_t>(std::llround(scaled));
+    if (rounded < 0)
+    {
+        result += '-';
+        rounded = -rounded;
+    }
+    auto unit = static_cast<std::uint64_t>(powers[decimals]);
+    auto magnitude = static_cast<std::uint64_t>(rounded);
+    char buffer[24];
+    auto end = std::to_chars(buffer, buffer + sizeof(buffer), magnitude / unit).ptr;
+    result.append(buffer, end);
+    std::uint64_t fraction = magnitude % unit;
+    if (fraction == 0) return;
+    while (fraction % 10 == 0)
+    {
+        fraction /= 10;
+        --decimals;
+    }
+    char* digits_end = buffer + decimals;
+    for (char* digit = digits_end; digit != buffer; fraction /= 10)
+    {
+        *--digit = static_cast<char>('0' + fraction % 10);
+    }
+    result += '.';
+    result.append(buffer, digits_end);
+}
+
+void append_coordinate(std::string& result, double value, int decimals)
+{
+    if (decimals < 0)
+    {
+        append_double(result, value);
+    }
+    else
+    {
+        append_fixed(result, value, decimals);
+    }
+}
+
+void append_point(std::string& result, double const* xy, int decimals)
+{
+    result += '[';
+    append_coordinate(result, xy[0], decimals);
+    result += ',';
+    append_coordinate(result, xy[1], decimals);
+    result += ']';
+}
+
+// Decimals that resolve a tenth of a grid unit in longitude, which still
+// resolves about half of one in latitude up to the limit of web mercator.
+int tile_decimals(std::uint32_t extent, unsigned z)
+{
+    double unit = 360.0 / (std::ldexp(1.0, static_cast<int>(z)) * std::max<std::uint32_t>(extent, 1));
+    int decimals = static_cast<int>(std::ceil(-std::log10(unit))) + 1;
+    return std::min(std::max(decimals, 0), max_geojson_precision);
+}
+
+void append_string(std::string& result, char const* data, std::size_t size)
+{
+    static char const hex[] = "0123456789abcdef";
+    result += '"';
+    char const* end = data + size;
+    char const* run = data;
+    for (char const* itr = data; itr != end; ++itr)
+    {
+        auto c = static_cast<unsigned char>(*itr);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        result.append(run, itr);
+        run = itr + 1;
+        switch (c)
+        {
+        case '"':
+            result += "\\\"";
+            break;
+        case '\\':
+            result += "\\\\";
+            break;
+        case '\b':
+            result += "\\b";
+            break;
+        case '\f':
+            result += "\\f";
+            break;
+        case '\n':
+            result += "\\n";
+            break;
+        case '\r':
+            result += "\\r";
+            break;
+        case '\t':
+            result += "\\t";
+            break;
+        default:
+            result += "\\u00";
+            result += hex[c >> 4];
+            result += hex[c & 0xf];
+            break;
+        }
+    }
+    result.append(run, end);
+    result += '"';
+}
+
+struct geometry_writer
+{
+    void operator()(mapnik::geometry::geometry_empty const&) const {}
+
+    void operator()(mapnik::geometry::point<double> const& pt) const
+    {
+        result += "{\"type\":\"Point\",\"coordinates\":";
+        append_point(result, &pt.x, decimals);
+        result += '}';
+    }
+
+    void operator()(mapnik::geometry::line_string<double> const& line) const
+    {
+        result += "{\"type\":\"LineString\",\"coordinates\":";
+        points(line);
+        result += '}';
+    }
+
+    void operator()(mapnik::geometry::polygon<double> const& poly) const
+    {
+        result += "{\"type\":\"Polygon\",\"coordinates\":";
+        rings(poly);
+        result += '}';
+    }
+
+    void operator()(mapnik::geometry::multi_point<double> const& multi) const
+    {
+        result += "{\"type\":\"MultiPoint\",\"coordinates\":";
+        points(multi);
+        result += '}';
+    }
+
+    void operator()(mapnik::geometry::multi_line_string<double> const& multi) const
+    {
+        result += "{\"type\":\"MultiLineString\",\"coordinates\":[";
+        bool first = true;
+        for (auto const& line : multi)
+        {
+            if (!first) result += ',';
+            first = false;
+            points(line);
+        }
+        result += "]}";
+    }
+
+    void operator()(mapnik::geometry::multi_polygon<double> const& multi) const
+    {
+        result += "{\"type\":\"MultiPolygon\",\"coordinates\":[";
+        bool first = true;
+        for (auto const& poly : multi)
+        {
+            if (!first) result += ',';
+            first = false;
+            rings(poly);
+        }
+        result += "]}";
+    }
+
+    void operator()(mapnik::geometry::geometry_collection<double> const& collection) const
+    {
+        result += "{\"type\":\"GeometryCollection\",\"geometries\":[";
+        bool first = true;
+        for (auto const& geom : collection)
+        {
+            if (!first) result += ',';
+            first = false;
+            mapnik::util::apply_visitor(*this, geom);
+        }
+        result += "]}";
+    }
+
+    void points(std::vector<mapnik::geometry::point<double>> const& pts) const
+    {
+        result += '[';
+        bool first = true;
+        for (auto const& pt : pts)
+        {
+            if (!first) result += ',';
+            first = false;
+            append_point(result, &pt.x, decimals);
+        }
+        result += ']';
+    }
+
+    void rings(mapnik::geometry::polygon<double> const& poly) const
+    {
+        result += '[';
+        bool first = true;
+        for (auto const& ring : poly)
+        {
+            if (!first) result += ',';
+            first = false;
+            points(ring);
+        }
+        result += ']';
+    }
+
+    std::string& result;
+    int decimals;
+};
+
+} // namespace
+
+void geojson_layer_writer::open(protozero::data_view const& layer, unsigned x, unsigned y, unsigned z,
+                                geojson_options const& options)
+{
+    keys_.clear();
+    values_.clear();
+    position_ = 0;
+    version_ = 1;
+    std::uint32_t extent = 4096;
+    protozero::pbf_reader layer_msg(layer);
+    while (layer_msg.next())
+    {
+        switch (layer_msg.tag())
+        {
+        case mapnik::vector_tile_impl::Layer_Encoding::KEYS:
+        {
+            protozero::data_view key = layer_msg.get_view();
+            keys_.emplace_back(key.data(), key.size());
+            break;
+        }
+        case mapnik::vector_tile_impl::Layer_Encoding::VALUES:
+        {
+            value val;
+            protozero::pbf_reader val_msg = layer_msg.get_message();
+            while (val_msg.next())
+            {
+                switch (val_msg.tag())
+                {
+                case mapnik::vector_tile_impl::Value_Encoding::STRING:
+                    val.kind = value::string_value;
+                    val.str = val_msg.get_view();
+                    break;
+                case mapnik::vector_tile_impl::Value_Encoding::FLOAT:
+                    val.kind = value::double_value;
+                    val.num = val_msg.get_float();
+                    break;
+                case mapnik::vector_tile_impl::Value_Encoding::DOUBLE:
+                    val.kind = value::double_value;
+                    val.num = val_msg.get_double();
+                    break;
+                case mapnik::vector_tile_impl::Value_Encoding::INT:
+                    val.kind = value::int_value;
+                    val.integer = val_msg.get_int64();
+                    break;
+                case mapnik::vector_tile_impl::Value_Encoding::UINT:
+                    // mapnik integers are signed
+                    val.kind = value::int_value;
+                    val.integer = static_cast<std::int64_t>(val_msg.get_uint64());
+                    break;
+                case mapnik::vector_tile_impl::Value_Encoding::SINT:
+                    val.kind = value::int_value;
+                    val.integer = val_msg.get_sint64();
+                    break;
+                case mapnik::vector_tile_impl::Value_Encoding::BOOL:
+                    val.kind = value::bool_value;
+                    val.integer = val_msg.get_bool() ? 1 : 0;
+                    break;
+                default:
+                    val_msg.skip();
+                    break;
+                }
+            }
+            values_.push_back(val);
+            break;
+        }
+        case mapnik::vector_tile_impl::Layer_Encoding::EXTENT:
+            extent = layer_msg.get_uint32();
+            break;
+        case mapnik::vector_tile_impl::Layer_Encoding::VERSION:
+            version_ = layer_msg.get_uint32();
+            break;
+        default:
+            layer_msg.skip();
+            break;
+        }
+    }
+    // The same tile placement as mapnik::vector_tile_impl::tile_datasource_pbf
+    double resolution = mapnik::EARTH_CIRCUMFERENCE / static_cast<double>(1ull << z);
+    tile_x_ = -0.5 * mapnik::EARTH_CIRCUMFERENCE + x * resolution;
+    tile_y_ = 0.5 * mapnik::EARTH_CIRCUMFERENCE - y * resolution;
+    scale_ = static_cast<double>(extent) / resolution;
+    decimals_ = options.precision == geojson_tile_precision ? tile_decimals(extent, z) : options.precision;
+    to_lonlat_ = decimals_ == geojson_full_precision ? merc_to_lonlat_scalar : merc_to_lonlat;
+
+    merc_bbox_ = mapnik::box2d<double>();
+    tile_bbox_ = mapnik::box2d<double>();
+    if (options.bbox.valid())
+    {
+        double minx = options.bbox.minx();
+        double miny = options.bbox.miny();
+        double maxx = options.bbox.maxx();
+        double maxy = options.bbox.maxy();
+        mapnik::lonlat2merc(minx, miny);
+        mapnik::lonlat2merc(maxx, maxy);
+        merc_bbox_.init(minx, miny, maxx, maxy);
+        // tile units grow downwards
+        tile_bbox_.init((minx - tile_x_) * scale_, (tile_y_ - maxy) * scale_,
+                        (maxx - tile_x_) * scale_, (tile_y_ - miny) * scale_);
+    }
+    filter_ = options.filter;
+    if (filter_)
+    {
+        if (!transcoder_) transcoder_ = std::make_unique<mapnik::transcoder>("utf-8");
+        filter_context_ = std::make_shared<mapnik::context_type>();
+        for (auto const& key : keys_)
+        {
+            filter_context_->push(std::string(key));
+        }
+    }
+    selected_keys_.clear();
+    if (options.select_properties)
+    {
+        selected_keys_.reserve(keys_.size());
+        for (auto const& key : keys_)
+        {
+            bool selected = std::find(options.properties.begin(), options.properties.end(), key) != options.properties.end();
+            selected_keys_.push_back(selected ? 1 : 0);
+        }
+    }
+    layer_ = protozero::pbf_reader(layer);
+}
+
+// Whether a feature passes the bbox and the filter of the options. When the
+// bbox can't be read from the commands, `check_envelope` is set and it is
+// left to the caller to check the decoded geometry.
+bool geojson_layer_writer::accept(std::int64_t id, std::uint32_t type, protozero::data_view const& tags,
+                                  protozero::data_view const& geometry, bool& check_envelope)
+{
+    check_envelope = false;
+    if (tile_bbox_.valid())
+    {
+        tile_box bbox;
+        if (!encoded_geometry_bbox(type, geometry, bbox))
+        {
+            check_envelope = true;
+        }
+        else if (bbox.maxx < tile_bbox_.minx() || bbox.minx > tile_bbox_.maxx() ||
+                 bbox.maxy < tile_bbox_.miny() || bbox.miny > tile_bbox_.maxy())
+        {
+            return false;
+        }
+    }
+    if (!filter_) return true;
+
+    mapnik::feature_ptr feature(mapnik::feature_factory::create(filter_context_, id));
+    using iterator = protozero::const_varint_iterator<std::uint32_t>;
+    char const* end_data = tags.data() + tags.size();
+    iterator it(tags.data(), end_data);
+    iterator end(end_data, end_data);
+    while (it != end)
+    {
+        std::uint32_t key = *it++;
+        if (it == end) break;
+        std::uint32_t val = *it++;
+        if (key >= keys_.size() || val >= values_.size()) continue;
+        value const& v = values_[val];
+        std::string key_name(keys_[key]);
+        switch (v.kind)
+        {
+        case value::string_value:
+            feature->put(key_name, transcoder_->transcode(v.str.data(), static_cast<std::int32_t>(v.str.size())));
+            break;
+        case value::double_value:
+            feature->put(key_name, v.num);
+            break;
+        case value::int_value:
+            feature->put(key_name, static_cast<mapnik::value_integer>(v.integer));
+            break;
+        case value::bool_value:
+            feature->put(key_name, v.integer != 0);
+            break;
+        default:
+            break;
+        }
+    }
+    static mapnik::attributes const variables;
+    mapnik::value result = mapnik::util::apply_visitor(
+        mapnik::evaluate<mapnik::feature_impl, mapnik::value, mapnik::attributes>(*feature, variables), *filter_);
+    return result.to_bool();
+}
+
+bool geojson_layer_writer::read_geometry(std::uint32_t type, protozero::data_view const& geometry)
+{
+    coords_.clear();
+    parts_.clear();
+    if (type != geom_point && type != geom_linestring) return false;
+    using iterator = protozero::const_varint_iterator<std::uint32_t>;
+    char const* end_data = geometry.data() + geometry.size();
+    iterator it(geometry.data(), end_data);
+    iterator end(end_data, end_data);
+    std::int64_t x = 0;
+    std::int64_t y = 0;
+    auto command = [&](std::uint32_t& id, std::uint32_t& count) {
+        if (it == end) return false;
+        id = *it & 0x7;
+        count = *it >> 3;
+        ++it;
+        return true;
+    };
+    auto point = [&](bool line_to) {
+        if (it == end) return false;
+        std::int32_t dx = protozero::decode_zigzag32(*it++);
+        if (it == end) return false;
+        std::int32_t dy = protozero::decode_zigzag32(*it++);
+        // the decoder drops zero length segments, and with them sometimes
+        // whole lines
+        if (line_to && dx == 0 && dy == 0) return false;
+        x += dx;
+        y += dy;
+        coords_.push_back(tile_x_ + static_cast<double>(x) / scale_);
+        coords_.push_back(tile_y_ - static_cast<double>(y) / scale_);
+        return true;
+    };
+    while (it != end)
+    {
+        std::uint32_t id = 0;
+        std::uint32_t count = 0;
+        if (!command(id, count) || id != cmd_move_to || count == 0) return false;
+        if (type == geom_point)
+        {
+            if (!parts_.empty()) return false;
+            parts_.push_back(count);
+            for (; count > 0; --count)
+            {
+                if (!point(false)) return false;
+            }
+        }
+        else
+        {
+            if (count != 1 || !point(false)) return false;
+            if (!command(id, count) || id != cmd_line_to || count == 0) return false;
+            parts_.push_back(count + 1);
+            for (; count > 0; --count)
+            {
+                if (!point(true)) return false;
+            }
+        }
+    }
+    if (parts_.empty()) return false;
+    to_lonlat_(coords_.data(), coords_.size() / 2);
+    return true;
+}
+
+void geojson_layer_writer::write_geometry(std::string& result, std::uint32_t type) const
+{
+    double const* xy = coords_.data();
+    auto write_points = [&](std::size_t count) {
+        result += '[';
+        for (std::size_t i = 0; i < count; ++i, xy += 2)
+        {
+            if (i > 0) result += ',';
+            append_point(result, xy, decimals_);
+        }
+        result += ']';
+    };
+    if (type == geom_point)
+    {
+        if (parts_.front() == 1)
+        {
+            result += "{\"type\":\"Point\",\"coordinates\":";
+            append_point(result, xy, decimals_);
+        }
+        else
+        {
+            result += "{\"type\":\"MultiPoint\",\"coordinates\":";
+            write_points(parts_.front());
+        }
+    }
+    else if (parts_.size() == 1)
+    {
+        result += "{\"type\":\"LineString\",\"coordinates\":";
+        write_points(parts_.front());
+    }
+    else
+    {
+        result += "{\"type\":\"MultiLineString\",\"coordinates\":[";
+        for (std::size_t part = 0; part < parts_.size(); ++part)
+        {
+            if (part > 0) result += ',';
+            write_points(parts_[part]);
+        }
+        result += ']';
+    }
+    result += '}';
+}
+
+void geojson_layer_writer::write_properties(std::string& result, protozero::data_view const& tags)
+{
+    // Like mapnik features: sorted by key, the last value of a repeated key
+    // wins and keys without a value are left out.
+    tags_.clear();
+    using iterator = protozero::const_varint_iterator<std::uint32_t>;
+    char const* end_data = tags.data() + tags.size();
+    iterator it(tags.data(), end_data);
+    iterator end(end_data, end_data);
+    while (it != end)
+    {
+        std::uint32_t key = *it++;
+        if (it == end) break;
+        std::uint32_t val = *it++;
+        if (key < keys_.size() && val < values_.size() && values_[val].kind != value::null_value &&
+            (selected_keys_.empty() || selected_keys_[key]))
+        {
+            tags_.emplace_back(key, val);
+        }
+    }
+    std::stable_sort(tags_.begin(), tags_.end(), [this](auto const& a, auto const& b) {
+        return keys_[a.first] < keys_[b.first];
+    });
+    result += '{';
+    bool first = true;
+    for (std::size_t i = 0; i < tags_.size(); ++i)
+    {
+        if (i + 1 < tags_.size() && keys_[tags_[i].first] == keys_[tags_[i + 1].first]) continue;
+        if (!first) result += ',';
+        first = false;
+        std::string_view key = keys_[tags_[i].first];
+        append_string(result, key.data(), key.size());
+        result += ':';
+        value const& val = values_[tags_[i].second];
+        switch (val.kind)
+        {
+        case value::string_value:
+            append_string(result, val.str.data(), val.str.size());
+            break;
+        case value::double_value:
+            append_double(result, val.num);
+            break;
+        case value::int_value:
+            append_integer(result, val.integer);
+            break;
+        case value::bool_value:
+            result += val.integer ? "true" : "false";
+            break;
+        default:
+            break;
+        }
+    }
+    result += '}';
+}
+
+bool geojson_layer_writer::write_next(std::string& result, char const* separator)
+{
+    while (layer_.next(mapnik::vector_tile_impl::Layer_Encoding::FEATURES))
+    {
+        ++position_;
+        protozero::pbf_reader feature_msg = layer_.get_message();
+        // mapnik-vector-tile numbers features without an id by their position
+        std::int64_t id = static_cast<std::int64_t>(position_);
+        std::uint32_t type = 0;
+        protozero::data_view tags;
+        protozero::data_view geometry;
+        bool has_geometry = false;
+        while (feature_msg.next())
+        {
+            switch (feature_msg.tag())
+            {
+            case mapnik::vector_tile_impl::Feature_Encoding::ID:
+                id = static_cast<std::int64_t>(feature_msg.get_uint64());
+                break;
+            case mapnik::vector_tile_impl::Feature_Encoding::TAGS:
+                tags = feature_msg.get_view();
+                break;
+            case mapnik::vector_tile_impl::Feature_Encoding::TYPE:
+                type = static_cast<std::uint32_t>(feature_msg.get_enum());
+                break;
+            case mapnik::vector_tile_impl::Feature_Encoding::GEOMETRY:
+                geometry = feature_msg.get_view();
+                has_geometry = true;
+                break;
+            default:
+                feature_msg.skip();
+                break;
+            }
+        }
+        if (!has_geometry || type < geom_point || type > geom_polygon) continue;
+        bool check_envelope = false;
+        if (!accept(id, type, tags, geometry, check_envelope)) continue;
+
+        std::size_t mark = result.size();
+        result += separator;
+        result += "{\"type\":\"Feature\",\"id\":";
+        append_integer(result, id);
+        result += ",\"geometry\":";
+        if (!check_envelope && read_geometry(type, geometry))
+        {
+            write_geometry(result, type);
+        }
+        else
+        {
+            char const* geometry_end = geometry.data() + geometry.size();
+            mapnik::vector_tile_impl::GeometryPBF::pbf_itr geom_itr(
+                protozero::pbf_reader::const_uint32_iterator(geometry.data(), geometry_end),
+                protozero::pbf_reader::const_uint32_iterator(geometry_end, geometry_end));
+            mapnik::vector_tile_impl::GeometryPBF geoms(geom_itr);
+            mapnik::geometry::geometry<double> geom = mapnik::vector_tile_impl::decode_geometry<double>(geoms,
+                                                                                                       static_cast<std::int32_t>(type),
+                                                                                                       version_,
+                                                                                                       tile_x_,
+                                                                                                       tile_y_,
+                                                                                                       scale_,
+                                                                                                       -1.0 * scale_);
+            if (geom.is<mapnik::geometry::geometry_empty>() ||
+                (check_envelope && !mapnik::geometry::envelope(geom).intersects(merc_bbox_)))
+            {
+                result.resize(mark);
+                continue;
+            }
+            merc_to_lonlat(geom, to_lonlat_);
+            mapnik::util::apply_visitor(geometry_writer{result, decimals_}, geom);
+        }
+        result += ",\"properties\":";
+        write_properties(result, tags);
+        result += '}';
+        return true;
+    }
+    return false;
+}
+
+geojson_stream::geojson_stream(mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                               bool array,
+                               geojson_options const& options)
+    : tile_(tile),
+      tile_msg_(tile->get_reader()),
+      options_(options),
+      kind_(array ? kind::array : kind::all) {}
+
+geojson_stream::geojson_stream(mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                               protozero::pbf_reader const& layer,
+                               std::string const& layer_name,
+                               geojson_options const& options)
+    : tile_(tile),
+      layer_msg_(layer),
+      layer_name_(layer_name),
+      options_(options),
+      kind_(kind::layer) {}
+
+bool geojson_stream::open_layer(std::string& result)
+{
+    if (kind_ == kind::layer)
+    {
+        if (layers_opened_ > 0) return false;
+    }
+    else
+    {
+        if (!tile_msg_.next(mapnik::vector_tile_impl::Tile_Encoding::LAYERS)) return false;
+        auto data_view = tile_msg_.get_view();
+        layer_msg_ = protozero::pbf_reader(data_view);
+        if (kind_ == kind::array)
+        {
+            protozero::pbf_reader name_msg(data_view);
+            layer_name_.clear();
+            if (name_msg.next(mapnik::vector_tile_impl::Layer_Encoding::NAME))
+            {
+                layer_name_ = name_msg.get_string();
+            }
+        }
+    }
+    if (kind_ != kind::all)
+    {
+        if (layers_opened_ > 0) result += ",";
+        result += "{\"type\":\"FeatureCollection\",";
+        result += "\"name\":\"" + layer_name_ + "\",\"features\":[";
+    }
+    writer_.open(layer_msg_.data(), tile_->x(), tile_->y(), tile_->z(), options_);
+    ++layers_opened_;
+    layer_features_ = 0;
+    in_layer_ = true;
+    return true;
+}
+
+void geojson_stream::close_layer(std::string& result)
+{
+    if (kind_ != kind::all)
+    {
+        result += "]}";
+    }
+    in_layer_ = false;
+}
+
+bool geojson_stream::next(std::string& result, std::size_t max_features)
+{
+    if (done_) return false;
+    if (!started_)
+    {
+        started_ = true;
+        if (kind_ == kind::all)
+        {
+            result += "{\"type\":\"FeatureCollection\",\"features\":[";
+        }
+        else if (kind_ == kind::array)
+        {
+            result += "[";
+        }
+    }
+    std::size_t written = 0;
+    while (written < max_features)
+    {
+        if (!in_layer_ && !open_layer(result))
+        {
+            if (kind_ == kind::all)
+            {
+                result += "]}";
+            }
+            else if (kind_ == kind::array)
+            {
+                result += "]";
+            }
+            done_ = true;
+            return false;
+        }
+        char const* separator = "";
+        if (layer_features_ > 0)
+        {
+            separator = "\n,";
+        }
+        else if (kind_ == kind::all && total_features_ > 0)
+        {
+            separator = ",";
+        }
+        if (!writer_.write_next(result, separator))
+        {
+            close_layer(result);
+            continue;
+        }
+        ++layer_features_;
+        ++total_features_;
+        ++written;
+    }
+    return true;
+}
+
+bool layer_to_geojson(protozero::pbf_reader const& layer,
+                      std::string& result,
+                      unsigned x,
+                      unsigned y,
+                      unsigned z,
+                      geojson_options const& options)
+{
+    geojson_layer_writer writer;
+    writer.open(layer.data(), x, y, z, options);
+    bool first = true;
+    while (writer.write_next(result, first ? "" : "\n,"))
+    {
+        first = false;
+    }
+    return !first;
+}
+
+void write_geojson_array(std::string& result,
+                         mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                         geojson_options const& options)
+{
+    geojson_stream(tile, true, options).next(result);
+}
+
+void write_geojson_all(std::string& result,
+                       mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                       geojson_options const& options)
+{
+    geojson_stream(tile, false, options).next(result);
+}
+
+bool write_geojson_layer_index(std::string& result,
+                               std::size_t layer_idx,
+                               mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                               geojson_options const& options)
+{
+    protozero::pbf_reader layer_msg;
+    if (tile->layer_reader(layer_idx, layer_msg) &&
+        tile->get_layers().size() > layer_idx)
+    {
+        geojson_stream(tile, layer_msg, tile->get_layers()[layer_idx], options).next(result);
+        return true;
+    }
+    // LCOV_EXCL_START
+    return false;
+    // LCOV_EXCL_STOP
+}
+
+bool write_geojson_layer_name(std::string& result,
+                              std::string const& name,
+                              mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                              geojson_options const& options)
+{
+    protozero::pbf_reader layer_msg;
+    if (tile->layer_reader(name, layer_msg))
+    {
+        geojson_stream(tile, layer_msg, name, options).next(result);
+        return true;
+    }
+    return false;
+}
+
+} // namespace node_mapnik
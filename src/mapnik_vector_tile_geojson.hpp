@@ -0,0 +1,205 @@
+#pragma once
+
+// mapnik
+#include <mapnik/expression.hpp>
+#include <mapnik/feature.hpp>
+#include <mapnik/geometry/box2d.hpp>
+#include <mapnik/unicode.hpp>
+// protozero
+#include <protozero/data_view.hpp>
+#include <protozero/pbf_reader.hpp>
+// mapnik-vector-tile
+#include "vector_tile_merc_tile.hpp"
+
+// stl
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace node_mapnik {
+
+// Writers behind VectorTile.toGeoJSON. They only depend on mapnik and
+// mapnik-vector-tile, not on N-API, so that the native benchmarks can link them.
+
+// Coordinates are written with a number of decimals from 0 to
+// max_geojson_precision, or one of:
+// - geojson_full_precision: the shortest representation that parses back to
+//   the same double
+// - geojson_tile_precision: the fewest decimals that still tell the units of
+//   the layer's grid apart at the tile's zoom
+// Property values are always written in full.
+constexpr int geojson_full_precision = -1;
+constexpr int geojson_tile_precision = -2;
+constexpr int max_geojson_precision = 15;
+
+// What the writers write, all features with all their properties and full
+// precision coordinates by default.
+struct geojson_options
+{
+    int precision = geojson_full_precision;
+    // Features whose bbox doesn't intersect this one, in WGS84, are skipped
+    // before their geometry is decoded. Ignored unless valid.
+    mapnik::box2d<double> bbox;
+    // Features for which it evaluates to false are skipped. It sees the id and
+    // properties of the features, not their geometry.
+    mapnik::expression_ptr filter;
+    // When set, only the properties named in `properties` are written.
+    bool select_properties = false;
+    std::vector<std::string> properties;
+};
+
+// Writes the features of one layer as GeoJSON, reprojected to WGS84, straight
+// from the encoded layer: tags are looked up in the layer's keys and values
+// and point and linestring geometries are read from their commands, without
+// building mapnik features. Polygons, and any geometry that doesn't follow the
+// plain command sequences of the spec, go through the mapnik-vector-tile
+// decoder so that rings are classified exactly as mapnik does. The buffers are
+// reused from one feature and layer to the next.
+class geojson_layer_writer
+{
+  public:
+    void open(protozero::data_view const& layer, unsigned x, unsigned y, unsigned z,
+              geojson_options const& options = geojson_options());
+
+    // Appends `separator` and the next feature to `result`. Features without
+    // a geometry, and those the options rule out, are skipped. Returns false
+    // once all features have been written.
+    bool write_next(std::string& result, char const* separator);
+
+  private:
+    struct value
+    {
+        enum kind_type : std::uint8_t
+        {
+            null_value,
+            string_value,
+            double_value,
+            int_value,
+            bool_value
+        };
+
+        protozero::data_view str;
+        double num = 0.0;
+        std::int64_t integer = 0;
+        kind_type kind = null_value;
+    };
+
+    bool accept(std::int64_t id, std::uint32_t type, protozero::data_view const& tags,
+                protozero::data_view const& geometry, bool& check_envelope);
+    bool read_geometry(std::uint32_t type, protozero::data_view const& geometry);
+    void write_geometry(std::string& result, std::uint32_t type) const;
+    void write_properties(std::string& result, protozero::data_view const& tags);
+
+    protozero::pbf_reader layer_;
+    std::vector<std::string_view> keys_;
+    std::vector<value> values_;
+    // x,y pairs of the geometry being written and the number of points of
+    // each of its parts
+    std::vector<double> coords_;
+    std::vector<std::size_t> parts_;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> tags_;
+    std::uint64_t position_ = 0;
+    std::uint32_t version_ = 1;
+    double tile_x_ = 0.0;
+    double tile_y_ = 0.0;
+    double scale_ = 1.0;
+    int decimals_ = geojson_full_precision;
+    // Coordinates written in full go through the scalar kernel so that they
+    // are the same on every CPU, rounded ones through the vectorized one.
+    void (*to_lonlat_)(double*, std::size_t) = nullptr;
+    // The options' bbox in spherical mercator and in tile units
+    mapnik::box2d<double> merc_bbox_;
+    mapnik::box2d<double> tile_bbox_;
+    mapnik::expression_ptr filter_;
+    mapnik::context_ptr filter_context_;
+    std::unique_ptr<mapnik::transcoder> transcoder_;
+    // whether the property of each key is written, unless empty
+    std::vector<char> selected_keys_;
+};
+
+// Produces the GeoJSON of a tile a few features at a time, so that callers
+// never need to hold more than one piece of the output. The pieces concatenate
+// to exactly what the write_geojson_* functions below return.
+//
+// The stream reads the tile it was given for its whole lifetime: the tile must
+// not be modified until the stream is done or destroyed.
+class geojson_stream
+{
+  public:
+    // All layers, as an array with one FeatureCollection per layer or as a
+    // single FeatureCollection with the features of all layers.
+    geojson_stream(mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                   bool array,
+                   geojson_options const& options = geojson_options());
+    // A FeatureCollection of a single layer.
+    geojson_stream(mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                   protozero::pbf_reader const& layer,
+                   std::string const& layer_name,
+                   geojson_options const& options = geojson_options());
+
+    // Appends the next piece of output, with up to `max_features` features, to
+    // `result`. Returns false once the end of the output has been appended.
+    bool next(std::string& result,
+              std::size_t max_features = std::numeric_limits<std::size_t>::max());
+
+  private:
+    enum class kind : std::uint8_t
+    {
+        all,
+        array,
+        layer
+    };
+
+    bool open_layer(std::string& result);
+    void close_layer(std::string& result);
+
+    mapnik::vector_tile_impl::merc_tile_ptr tile_;
+    protozero::pbf_reader tile_msg_;
+    protozero::pbf_reader layer_msg_;
+    std::string layer_name_;
+    geojson_layer_writer writer_;
+    std::size_t layers_opened_ = 0;
+    std::size_t layer_features_ = 0;
+    std::size_t total_features_ = 0;
+    geojson_options options_;
+    kind kind_;
+    bool started_ = false;
+    bool in_layer_ = false;
+    bool done_ = false;
+};
+
+// Appends the features of one layer, reprojected to WGS84, as comma separated
+// GeoJSON Features. Returns false if the layer has no features.
+bool layer_to_geojson(protozero::pbf_reader const& layer,
+                      std::string& result,
+                      unsigned x,
+                      unsigned y,
+                      unsigned z,
+                      geojson_options const& options = geojson_options());
+
+// An array with one FeatureCollection per layer.
+void write_geojson_array(std::string& result,
+                         mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                         geojson_options const& options = geojson_options());
+
+// A single FeatureCollection with the features of all layers.
+void write_geojson_all(std::string& result,
+                       mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                       geojson_options const& options = geojson_options());
+
+// A FeatureCollection of a single layer. Returns false if there is no such layer.
+bool write_geojson_layer_index(std::string& result,
+                               std::size_t layer_idx,
+                               mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                               geojson_options const& options = geojson_options());
+bool write_geojson_layer_name(std::string& result,
+                              std::string const& name,
+                              mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                              geojson_options const& options = geojson_options());
+
+} // namespace node_mapnik
@@ -115,6 +115,7 @@ Napi::Value VectorTile::addImageSync(Napi::CallbackInfo const& info)
             image_format = param_val.As<Napi::String>();
         }
     }
+    detach_exported_data();
     mapnik::image_any im_copy = *im->impl();
     std::shared_ptr<mapnik::memory_datasource> ds = std::make_shared<mapnik::memory_datasource>(mapnik::parameters());
     mapnik::raster_ptr ras = std::make_shared<mapnik::raster>(tile_->extent(), im_copy, 1.0);
@@ -309,6 +310,7 @@ Napi::Value VectorTile::addImage(Napi::CallbackInfo const& info)
             image_format = param_val.As<Napi::String>();
         }
     }
+    detach_exported_data();
     auto* worker = new AsyncAddImage{tile_, im->impl(), layer_name, image_format,
                                      scaling_method, callback.As<Napi::Function>()};
     worker->Queue();
@@ -358,6 +360,7 @@ Napi::Value VectorTile::addImageBufferSync(Napi::CallbackInfo const& info)
         Napi::Error::New(env, "cannot accept empty buffer as protobuf").ThrowAsJavaScriptException();
         return env.Undefined();
     }
+    detach_exported_data();
     try
     {
         add_image_buffer_as_tile_layer(*tile_, layer_name, obj.As<Napi::Buffer<char>>().Data(), buffer_size);
@@ -480,6 +483,7 @@ Napi::Value VectorTile::addImageBuffer(Napi::CallbackInfo const& info)
         return env.Undefined();
     }
 
+    detach_exported_data();
     auto* worker = new AsyncAddImageBuffer{tile_, obj.As<Napi::Buffer<char>>(), layer_name, callback.As<Napi::Function>()};
     worker->Queue();
     return env.Undefined();
@@ -1,13 +1,10 @@
 //
 #include "mapnik_vector_tile.hpp"
+#include "mapnik_expression.hpp"
 
 // mapnik
-#include <mapnik/util/geometry_to_geojson.hpp>
-#include <mapnik/util/feature_to_geojson.hpp>
-#include <mapnik/projection.hpp>
-#include <mapnik/proj_transform.hpp>
-#include <mapnik/geometry/reprojection.hpp>
 #include <mapnik/datasource_cache.hpp>
+#include <mapnik/memory_datasource.hpp>
 // mapnik-vector-tile
 #include "vector_tile_compression.hpp"
 #include "vector_tile_composite.hpp"
@@ -16,6 +13,8 @@
 #include "vector_tile_geometry_decoder.hpp"
 #include "vector_tile_load_tile.hpp"
 #include "object_to_container.hpp"
+#include "mapnik_vector_tile_geojson.hpp"
+#include "geojson_reader.hpp"
 
 namespace {
 
@@ -312,173 +311,93 @@ enum geojson_write_type : std::uint8_t
     geojson_write_layer_index
 };
 
-bool layer_to_geojson(protozero::pbf_reader const& layer,
-                      std::string& result,
-                      unsigned x,
-                      unsigned y,
-                      unsigned z)
+// Reads the options of toGeoJSON that select what is written. Throws and
+// returns false if one of them is invalid.
+bool geojson_options_from_object(Napi::Env env, Napi::Object const& options, node_mapnik::geojson_options& result)
 {
-    mapnik::vector_tile_impl::tile_datasource_pbf ds(layer, x, y, z);
-    mapnik::projection wgs84("epsg:4326", true);
-    mapnik::projection merc("epsg:3857", true);
-    mapnik::proj_transform prj_trans(merc, wgs84);
-    // This mega box ensures we capture all features, including those
-    // outside the tile extent. Geometries outside the tile extent are
-    // likely when the vtile was created by clipping to a buffered extent
-    mapnik::query q(mapnik::box2d<double>(std::numeric_limits<double>::lowest(),
-                                          std::numeric_limits<double>::lowest(),
-                                          std::numeric_limits<double>::max(),
-                                          std::numeric_limits<double>::max()));
-    mapnik::layer_descriptor ld = ds.get_descriptor();
-    for (auto const& item : ld.get_descriptors())
-    {
-        q.add_property_name(item.get_name());
-    }
-    mapnik::featureset_ptr fs = ds.features(q);
-    bool first = true;
-    if (fs && !mapnik::is_empty(fs))
-    {
-        mapnik::feature_ptr feature;
-        while ((feature = fs->next()))
-        {
-            if (first)
-            {
-                first = false;
-            }
-            else
-            {
-                result += "\n,";
-            }
-            std::string feature_str;
-            mapnik::feature_impl feature_new(feature->context(), feature->id());
-            feature_new.set_data(feature->get_data());
-            unsigned int n_err = 0;
-            feature_new.set_geometry(mapnik::geometry::reproject_copy(feature->get_geometry(), prj_trans, n_err));
-            if (!mapnik::util::to_geojson(feature_str, feature_new))
+    if (options.Has("precision"))
+    {
+        Napi::Value param_val = options.Get("precision");
+        bool valid = false;
+        if (param_val.IsString() && param_val.As<Napi::String>().Utf8Value() == "auto")
+        {
+            result.precision = node_mapnik::geojson_tile_precision;
+            valid = true;
+        }
+        else if (param_val.IsNumber())
+        {
+            double decimals = param_val.As<Napi::Number>().DoubleValue();
+            if (decimals >= 0 && decimals <= node_mapnik::max_geojson_precision && std::floor(decimals) == decimals)
             {
-                // LCOV_EXCL_START
-                throw std::runtime_error("Failed to generate GeoJSON geometry");
-                // LCOV_EXCL_STOP
+                result.precision = static_cast<int>(decimals);
+                valid = true;
             }
-            result += feature_str;
+        }
+        if (!valid)
+        {
+            Napi::TypeError::New(env, "option 'precision' must be an integer from 0 to 15 or 'auto'").ThrowAsJavaScriptException();
+            return false;
         }
     }
-    return !first;
-}
-void write_geojson_array(std::string& result,
-                         mapnik::vector_tile_impl::merc_tile_ptr const& tile)
-{
-    protozero::pbf_reader tile_msg = tile->get_reader();
-    result += "[";
-    bool first = true;
-    while (tile_msg.next(mapnik::vector_tile_impl::Tile_Encoding::LAYERS))
+    if (options.Has("bbox"))
     {
-        if (first)
+        Napi::Value param_val = options.Get("bbox");
+        if (!param_val.IsArray() || param_val.As<Napi::Array>().Length() != 4)
         {
-            first = false;
+            Napi::TypeError::New(env, "option 'bbox' must be an array of four numbers [minx, miny, maxx, maxy]").ThrowAsJavaScriptException();
+            return false;
         }
-        else
+        Napi::Array bbox = param_val.As<Napi::Array>();
+        double coords[4];
+        for (std::uint32_t i = 0; i < 4; ++i)
         {
-            result += ",";
+            Napi::Value coord = bbox.Get(i);
+            if (!coord.IsNumber())
+            {
+                Napi::TypeError::New(env, "option 'bbox' must be an array of four numbers [minx, miny, maxx, maxy]").ThrowAsJavaScriptException();
+                return false;
+            }
+            coords[i] = coord.As<Napi::Number>().DoubleValue();
         }
-        auto data_view = tile_msg.get_view();
-        protozero::pbf_reader layer_msg(data_view);
-        protozero::pbf_reader name_msg(data_view);
-        std::string layer_name;
-        if (name_msg.next(mapnik::vector_tile_impl::Layer_Encoding::NAME))
+        if (!(coords[0] <= coords[2] && coords[1] <= coords[3]))
         {
-            layer_name = name_msg.get_string();
+            Napi::TypeError::New(env, "option 'bbox' must have its minimum before its maximum coordinates").ThrowAsJavaScriptException();
+            return false;
         }
-        result += "{\"type\":\"FeatureCollection\",";
-        result += "\"name\":\"" + layer_name + "\",\"features\":[";
-        std::string features;
-        bool hit = layer_to_geojson(layer_msg,
-                                    features,
-                                    tile->x(),
-                                    tile->y(),
-                                    tile->z());
-        if (hit)
+        result.bbox.init(coords[0], coords[1], coords[2], coords[3]);
+    }
+    if (options.Has("filter"))
+    {
+        Napi::Value param_val = options.Get("filter");
+        if (!param_val.IsObject() || !param_val.As<Napi::Object>().InstanceOf(Expression::constructor.Value()))
         {
-            result += features;
+            Napi::TypeError::New(env, "option 'filter' must be a mapnik.Expression").ThrowAsJavaScriptException();
+            return false;
         }
-        result += "]}";
+        result.filter = Napi::ObjectWrap<Expression>::Unwrap(param_val.As<Napi::Object>())->impl();
     }
-    result += "]";
-}
-
-void write_geojson_all(std::string& result,
-                       mapnik::vector_tile_impl::merc_tile_ptr const& tile)
-{
-    protozero::pbf_reader tile_msg = tile->get_reader();
-    result += "{\"type\":\"FeatureCollection\",\"features\":[";
-    bool first = true;
-    while (tile_msg.next(mapnik::vector_tile_impl::Tile_Encoding::LAYERS))
+    if (options.Has("properties"))
     {
-        protozero::pbf_reader layer_msg(tile_msg.get_message());
-        std::string features;
-        bool hit = layer_to_geojson(layer_msg,
-                                    features,
-                                    tile->x(),
-                                    tile->y(),
-                                    tile->z());
-        if (hit)
+        Napi::Value param_val = options.Get("properties");
+        if (!param_val.IsArray())
         {
-            if (first)
-            {
-                first = false;
-            }
-            else
+            Napi::TypeError::New(env, "option 'properties' must be an array of strings").ThrowAsJavaScriptException();
+            return false;
+        }
+        Napi::Array names = param_val.As<Napi::Array>();
+        result.select_properties = true;
+        for (std::uint32_t i = 0; i < names.Length(); ++i)
+        {
+            Napi::Value name = names.Get(i);
+            if (!name.IsString())
             {
-                result += ",";
+                Napi::TypeError::New(env, "option 'properties' must be an array of strings").ThrowAsJavaScriptException();
+                return false;
             }
-            result += features;
+            result.properties.push_back(name.As<Napi::String>());
         }
     }
-    result += "]}";
-}
-
-bool write_geojson_layer_index(std::string& result,
-                               std::size_t layer_idx,
-                               mapnik::vector_tile_impl::merc_tile_ptr const& tile)
-{
-    protozero::pbf_reader layer_msg;
-    if (tile->layer_reader(layer_idx, layer_msg) &&
-        tile->get_layers().size() > layer_idx)
-    {
-        std::string layer_name = tile->get_layers()[layer_idx];
-        result += "{\"type\":\"FeatureCollection\",";
-        result += "\"name\":\"" + layer_name + "\",\"features\":[";
-        layer_to_geojson(layer_msg,
-                         result,
-                         tile->x(),
-                         tile->y(),
-                         tile->z());
-        result += "]}";
-        return true;
-    }
-    // LCOV_EXCL_START
-    return false;
-    // LCOV_EXCL_STOP
-}
-
-bool write_geojson_layer_name(std::string& result,
-                              std::string const& name,
-                              mapnik::vector_tile_impl::merc_tile_ptr const& tile)
-{
-    protozero::pbf_reader layer_msg;
-    if (tile->layer_reader(name, layer_msg))
-    {
-        result += "{\"type\":\"FeatureCollection\",";
-        result += "\"name\":\"" + name + "\",\"features\":[";
-        layer_to_geojson(layer_msg,
-                         result,
-                         tile->x(),
-                         tile->y(),
-                         tile->z());
-        result += "]}";
-        return true;
-    }
-    return false;
+    return true;
 }
 
 struct AsyncToGeoJSON : Napi::AsyncWorker
@@ -486,12 +405,13 @@ struct AsyncToGeoJSON : Napi::AsyncWorker
     using Base = Napi::AsyncWorker;
     AsyncToGeoJSON(mapnik::vector_tile_impl::merc_tile_ptr const& tile,
                    geojson_write_type type, int layer_idx, std::string const& layer_name,
-                   Napi::Function const& callback)
+                   node_mapnik::geojson_options const& options, Napi::Function const& callback)
         : Base(callback),
           tile_(tile),
           type_(type),
           layer_idx_(layer_idx),
-          layer_name_(layer_name)
+          layer_name_(layer_name),
+          options_(options)
     {
     }
 
@@ -503,16 +423,16 @@ struct AsyncToGeoJSON : Napi::AsyncWorker
             {
             default:
             case geojson_write_all:
-                write_geojson_all(result_, tile_);
+                node_mapnik::write_geojson_all(result_, tile_, options_);
                 break;
             case geojson_write_array:
-                write_geojson_array(result_, tile_);
+                node_mapnik::write_geojson_array(result_, tile_, options_);
                 break;
             case geojson_write_layer_name:
-                write_geojson_layer_name(result_, layer_name_, tile_);
+                node_mapnik::write_geojson_layer_name(result_, layer_name_, tile_, options_);
                 break;
             case geojson_write_layer_index:
-                write_geojson_layer_index(result_, layer_idx_, tile_);
+                node_mapnik::write_geojson_layer_index(result_, layer_idx_, tile_, options_);
                 break;
             }
         }
@@ -532,9 +452,555 @@ struct AsyncToGeoJSON : Napi::AsyncWorker
     geojson_write_type type_;
     int layer_idx_;
     std::string layer_name_;
+    node_mapnik::geojson_options options_;
     std::string result_;
 };
 
+// Shared by the chunks of one streaming toGeoJSON call. Only the main thread
+// touches the references, the stream is used by one chunk worker at a time.
+struct geojson_stream_state
+{
+    geojson_stream_state(std::unique_ptr<node_mapnik::geojson_stream> stream_,
+                         std::size_t chunk_features_,
+                         Napi::Function const& on_chunk_,
+                         Napi::Function const& callback_)
+        : stream(std::move(stream_)),
+          chunk_features(chunk_features_),
+          on_chunk(Napi::Persistent(on_chunk_)),
+          callback(Napi::Persistent(callback_)) {}
+
+    // Drops the stream, with its copy of the tile, and the references to the
+    // callbacks once the stream is done or failed. The state itself lives on
+    // for as long as the consumer holds on to a `next` function.
+    void release()
+    {
+        stream.reset();
+        on_chunk.Reset();
+        callback.Reset();
+        waiting = false;
+    }
+
+    std::unique_ptr<node_mapnik::geojson_stream> stream;
+    std::size_t chunk_features;
+    Napi::FunctionReference on_chunk;
+    Napi::FunctionReference callback;
+    // true while a delivered chunk waits for the consumer to call next()
+    bool waiting = false;
+};
+
+void queue_geojson_chunk(std::shared_ptr<geojson_stream_state> const& state);
+
+// Calls on_chunk, returning what it threw instead of letting it propagate.
+Napi::Value call_on_chunk(Napi::Env env, Napi::Function const& on_chunk, Napi::String const& chunk, Napi::Function const& next)
+{
+#ifdef NAPI_CPP_EXCEPTIONS
+    static_cast<void>(env);
+    try
+    {
+        on_chunk.Call({chunk, next});
+    }
+    catch (Napi::Error const& ex)
+    {
+        return ex.Value();
+    }
+#else
+    on_chunk.Call({chunk, next});
+    if (env.IsExceptionPending())
+    {
+        return env.GetAndClearPendingException().Value();
+    }
+#endif
+    return Napi::Value();
+}
+
+struct AsyncGeoJSONChunk : Napi::AsyncWorker
+{
+    using Base = Napi::AsyncWorker;
+    AsyncGeoJSONChunk(std::shared_ptr<geojson_stream_state> const& state)
+        : Base(state->callback.Value()),
+          state_(state)
+    {
+    }
+
+    void Execute() override
+    {
+        try
+        {
+            more_ = state_->stream->next(chunk_, state_->chunk_features);
+        }
+        catch (std::exception const& ex)
+        {
+            SetError(ex.what());
+        }
+    }
+
+    void OnOK() override
+    {
+        Napi::Env env = Env();
+        Napi::HandleScope scope(env);
+        std::shared_ptr<geojson_stream_state> state = state_;
+        Napi::Function next = Napi::Function::New(env, [state](Napi::CallbackInfo const&) {
+            if (state->waiting && state->stream)
+            {
+                state->waiting = false;
+                queue_geojson_chunk(state);
+            }
+        });
+        state->waiting = more_;
+        Napi::String chunk = Napi::String::New(env, chunk_);
+        // the chunk is now owned by JS
+        std::string().swap(chunk_);
+        Napi::Function on_chunk = state->on_chunk.Value();
+        if (!more_)
+        {
+            state->release();
+        }
+        Napi::Value error = call_on_chunk(env, on_chunk, chunk, next);
+        if (!error.IsEmpty())
+        {
+            // the consumer failed: stop the stream and report it
+            state->release();
+            Callback().Call({error});
+        }
+        else if (!more_)
+        {
+            Callback().Call({env.Null()});
+        }
+    }
+
+    void OnError(Napi::Error const& error) override
+    {
+        Napi::HandleScope scope(Env());
+        state_->release();
+        Callback().Call({error.Value()});
+    }
+
+  private:
+    std::shared_ptr<geojson_stream_state> state_;
+    std::string chunk_;
+    bool more_ = false;
+};
+
+void queue_geojson_chunk(std::shared_ptr<geojson_stream_state> const& state)
+{
+    auto* worker = new AsyncGeoJSONChunk(state);
+    worker->Queue();
+}
+
+// A layer of VectorTile.toJSON, decoded without touching JS so that it can be
+// done on a worker thread. All of it is copied out of the tile.
+struct json_feature
+{
+    std::uint64_t id = 0;
+    std::int32_t type = 0;
+    bool has_id = false;
+    bool has_type = false;
+    bool has_geometry = false;
+    bool has_raster = false;
+    // key and value indexes in json_layer::tags
+    std::size_t tags_offset = 0;
+    std::size_t tags_size = 0;
+    // Words in json_layer::buffer: the encoded geometry, or once decoded for
+    // typed arrays the x,y pairs, then the point count of each part and for
+    // polygons the ring count of each polygon.
+    std::size_t geometry_offset = 0;
+    std::size_t geometry_size = 0;
+    std::size_t parts_size = 0;
+    std::size_t polygons_size = 0;
+    std::string geometry_type;
+    // decoded, when not returned as typed arrays
+    mapnik::geometry::geometry<std::int64_t> geometry;
+    std::string raster;
+};
+
+struct json_layer
+{
+    std::string name;
+    std::uint32_t extent = 0;
+    std::uint32_t version = 1;
+    bool has_name = false;
+    bool has_extent = false;
+    bool has_version = false;
+    std::vector<std::string> keys;
+    mapnik::vector_tile_impl::layer_pbf_attr_type values;
+    std::vector<std::uint32_t> tags;
+    std::vector<json_feature> features;
+    // handed over to the ArrayBuffer of the typed arrays
+    std::unique_ptr<std::vector<std::uint32_t>> buffer = std::make_unique<std::vector<std::uint32_t>>();
+};
+
+// Flattens a decoded geometry into the x,y, part and polygon words of a
+// json_feature.
+struct geometry_flattener
+{
+    void operator()(mapnik::geometry::geometry_empty const&) {}
+
+    void operator()(mapnik::geometry::point<std::int64_t> const& pt)
+    {
+        add(pt);
+        parts.push_back(1);
+    }
+
+    void operator()(mapnik::geometry::multi_point<std::int64_t> const& points)
+    {
+        for (auto const& pt : points) add(pt);
+        parts.push_back(static_cast<std::uint32_t>(points.size()));
+    }
+
+    void operator()(mapnik::geometry::line_string<std::int64_t> const& line)
+    {
+        for (auto const& pt : line) add(pt);
+        parts.push_back(static_cast<std::uint32_t>(line.size()));
+    }
+
+    void operator()(mapnik::geometry::multi_line_string<std::int64_t> const& lines)
+    {
+        for (auto const& line : lines) (*this)(line);
+    }
+
+    void operator()(mapnik::geometry::polygon<std::int64_t> const& poly)
+    {
+        for (auto const& ring : poly)
+        {
+            for (auto const& pt : ring) add(pt);
+            parts.push_back(static_cast<std::uint32_t>(ring.size()));
+        }
+        polygons.push_back(static_cast<std::uint32_t>(poly.size()));
+    }
+
+    void operator()(mapnik::geometry::multi_polygon<std::int64_t> const& polys)
+    {
+        for (auto const& poly : polys) (*this)(poly);
+    }
+
+    void operator()(mapnik::geometry::geometry_collection<std::int64_t> const& collection)
+    {
+        // LCOV_EXCL_START
+        for (auto const& geom : collection) mapnik::util::apply_visitor(*this, geom);
+        // LCOV_EXCL_STOP
+    }
+
+    void add(mapnik::geometry::point<std::int64_t> const& pt)
+    {
+        coords.push_back(static_cast<std::uint32_t>(clamp(pt.x)));
+        coords.push_back(static_cast<std::uint32_t>(clamp(pt.y)));
+    }
+
+    static std::int32_t clamp(std::int64_t v)
+    {
+        return static_cast<std::int32_t>(std::min<std::int64_t>(std::max<std::int64_t>(v, std::numeric_limits<std::int32_t>::min()),
+                                                                 std::numeric_limits<std::int32_t>::max()));
+    }
+
+    std::vector<std::uint32_t> coords;
+    std::vector<std::uint32_t> parts;
+    std::vector<std::uint32_t> polygons;
+};
+
+void decode_tile_json(mapnik::vector_tile_impl::merc_tile const& tile,
+                      bool decode_geometry,
+                      bool typed_geometry,
+                      std::vector<json_layer>& layers)
+{
+    geometry_flattener flat;
+    protozero::pbf_reader tile_msg = tile.get_reader();
+    while (tile_msg.next(mapnik::vector_tile_impl::Tile_Encoding::LAYERS))
+    {
+        protozero::pbf_reader layer_msg = tile_msg.get_message();
+        layers.emplace_back();
+        json_layer& layer = layers.back();
+        std::vector<protozero::pbf_reader> layer_features;
+        protozero::pbf_reader val_msg;
+        while (layer_msg.next())
+        {
+            switch (layer_msg.tag())
+            {
+            case mapnik::vector_tile_impl::Layer_Encoding::NAME:
+                layer.name = layer_msg.get_string();
+                layer.has_name = true;
+                break;
+            case mapnik::vector_tile_impl::Layer_Encoding::FEATURES:
+                layer_features.push_back(layer_msg.get_message());
+                break;
+            case mapnik::vector_tile_impl::Layer_Encoding::KEYS:
+                layer.keys.push_back(layer_msg.get_string());
+                break;
+            case mapnik::vector_tile_impl::Layer_Encoding::VALUES:
+                val_msg = layer_msg.get_message();
+                while (val_msg.next())
+                {
+                    switch (val_msg.tag())
+                    {
+                    case mapnik::vector_tile_impl::Value_Encoding::STRING:
+                        layer.values.push_back(val_msg.get_string());
+                        break;
+                    case mapnik::vector_tile_impl::Value_Encoding::FLOAT:
+                        layer.values.push_back(val_msg.get_float());
+                        break;
+                    case mapnik::vector_tile_impl::Value_Encoding::DOUBLE:
+                        layer.values.push_back(val_msg.get_double());
+                        break;
+                    case mapnik::vector_tile_impl::Value_Encoding::INT:
+                        layer.values.push_back(val_msg.get_int64());
+                        break;
+                    case mapnik::vector_tile_impl::Value_Encoding::UINT:
+                        // LCOV_EXCL_START
+                        layer.values.push_back(val_msg.get_uint64());
+                        break;
+                        // LCOV_EXCL_STOP
+                    case mapnik::vector_tile_impl::Value_Encoding::SINT:
+                        // LCOV_EXCL_START
+                        layer.values.push_back(val_msg.get_sint64());
+                        break;
+                        // LCOV_EXCL_STOP
+                    case mapnik::vector_tile_impl::Value_Encoding::BOOL:
+                        layer.values.push_back(val_msg.get_bool());
+                        break;
+                    default:
+                        // LCOV_EXCL_START
+                        val_msg.skip();
+                        break;
+                        // LCOV_EXCL_STOP
+                    }
+                }
+                break;
+            case mapnik::vector_tile_impl::Layer_Encoding::EXTENT:
+                layer.extent = layer_msg.get_uint32();
+                layer.has_extent = true;
+                break;
+            case mapnik::vector_tile_impl::Layer_Encoding::VERSION:
+                layer.version = layer_msg.get_uint32();
+                layer.has_version = true;
+                break;
+            default:
+                // LCOV_EXCL_START
+                layer_msg.skip();
+                break;
+                // LCOV_EXCL_STOP
+            }
+        }
+        std::vector<std::uint32_t>& buffer = *layer.buffer;
+        layer.features.resize(layer_features.size());
+        for (std::size_t f_idx = 0; f_idx < layer_features.size(); ++f_idx)
+        {
+            protozero::pbf_reader& feature_msg = layer_features[f_idx];
+            json_feature& feature = layer.features[f_idx];
+            mapnik::vector_tile_impl::GeometryPBF::pbf_itr geom_itr;
+            while (feature_msg.next())
+            {
+                switch (feature_msg.tag())
+                {
+                case mapnik::vector_tile_impl::Feature_Encoding::ID:
+                    feature.id = feature_msg.get_uint64();
+                    feature.has_id = true;
+                    break;
+                case mapnik::vector_tile_impl::Feature_Encoding::TAGS:
+                {
+                    auto tag_itr = feature_msg.get_packed_uint32();
+                    feature.tags_offset = layer.tags.size();
+                    layer.tags.insert(layer.tags.end(), tag_itr.begin(), tag_itr.end());
+                    feature.tags_size = layer.tags.size() - feature.tags_offset;
+                    break;
+                }
+                case mapnik::vector_tile_impl::Feature_Encoding::TYPE:
+                    feature.type = feature_msg.get_enum();
+                    feature.has_type = true;
+                    break;
+                case mapnik::vector_tile_impl::Feature_Encoding::GEOMETRY:
+                    geom_itr = feature_msg.get_packed_uint32();
+                    feature.has_geometry = true;
+                    break;
+                case mapnik::vector_tile_impl::Feature_Encoding::RASTER:
+                {
+                    auto im_buffer = feature_msg.get_view();
+                    feature.raster.assign(im_buffer.data(), im_buffer.size());
+                    feature.has_raster = true;
+                    break;
+                }
+                default:
+                    // LCOV_EXCL_START
+                    feature_msg.skip();
+                    break;
+                    // LCOV_EXCL_STOP
+                }
+            }
+            if (!feature.has_geometry || !feature.has_type) continue;
+            feature.geometry_offset = buffer.size();
+            if (decode_geometry)
+            {
+                // Decode the geometry first into an int64_t mapnik geometry
+                mapnik::vector_tile_impl::GeometryPBF geoms(geom_itr);
+                mapnik::geometry::geometry<std::int64_t> geom = mapnik::vector_tile_impl::decode_geometry<std::int64_t>(geoms, feature.type, layer.version, 0, 0, 1.0, 1.0);
+                feature.geometry_type = geometry_type_as_string(geom);
+                if (typed_geometry)
+                {
+                    flat.coords.clear();
+                    flat.parts.clear();
+                    flat.polygons.clear();
+                    mapnik::util::apply_visitor(flat, geom);
+                    buffer.insert(buffer.end(), flat.coords.begin(), flat.coords.end());
+                    buffer.insert(buffer.end(), flat.parts.begin(), flat.parts.end());
+                    buffer.insert(buffer.end(), flat.polygons.begin(), flat.polygons.end());
+                    feature.geometry_size = flat.coords.size();
+                    feature.parts_size = flat.parts.size();
+                    feature.polygons_size = flat.polygons.size();
+                }
+                else
+                {
+                    feature.geometry = std::move(geom);
+                }
+            }
+            else
+            {
+                buffer.insert(buffer.end(), geom_itr.begin(), geom_itr.end());
+                feature.geometry_size = buffer.size() - feature.geometry_offset;
+            }
+        }
+    }
+}
+
+Napi::Array tile_json_to_array(Napi::Env env,
+                               std::vector<json_layer>& layers,
+                               bool decode_geometry,
+                               bool typed_geometry)
+{
+    Napi::Array arr = Napi::Array::New(env, layers.size());
+    for (std::size_t l_idx = 0; l_idx < layers.size(); ++l_idx)
+    {
+        json_layer& layer = layers[l_idx];
+        Napi::Object layer_obj = Napi::Object::New(env);
+        if (layer.has_name) layer_obj.Set("name", layer.name);
+        if (layer.has_extent) layer_obj.Set("extent", Napi::Number::New(env, layer.extent));
+        if (layer.has_version) layer_obj.Set("version", Napi::Number::New(env, layer.version));
+
+        Napi::ArrayBuffer buffer;
+        if (typed_geometry)
+        {
+            std::vector<std::uint32_t>& words = *layer.buffer;
+            if (words.empty())
+            {
+                buffer = Napi::ArrayBuffer::New(env, 0);
+            }
+            else
+            {
+                std::size_t byte_length = words.size() * sizeof(std::uint32_t);
+                buffer = Napi::ArrayBuffer::New(
+                    env,
+                    words.data(),
+                    byte_length,
+                    [](Napi::Env env_, void* /*unused*/, std::vector<std::uint32_t>* vec_ptr) {
+                        Napi::MemoryManagement::AdjustExternalMemory(env_, -static_cast<std::int64_t>(vec_ptr->size() * sizeof(std::uint32_t)));
+                        delete vec_ptr;
+                    },
+                    layer.buffer.release());
+                Napi::MemoryManagement::AdjustExternalMemory(env, static_cast<std::int64_t>(byte_length));
+            }
+        }
+
+        Napi::Array f_arr = Napi::Array::New(env, layer.features.size());
+        for (std::size_t f_idx = 0; f_idx < layer.features.size(); ++f_idx)
+        {
+            json_feature const& feature = layer.features[f_idx];
+            Napi::Object feature_obj = Napi::Object::New(env);
+            if (feature.has_id) feature_obj.Set("id", Napi::Number::New(env, feature.id));
+            if (feature.has_type) feature_obj.Set("type", Napi::Number::New(env, feature.type));
+            if (feature.has_raster)
+            {
+                feature_obj.Set("raster",
+                                Napi::Buffer<char>::Copy(env, feature.raster.data(), feature.raster.size()));
+            }
+            Napi::Object att_obj = Napi::Object::New(env);
+            for (std::size_t t = 0; t + 1 < feature.tags_size; t += 2)
+            {
+                std::size_t key_name = layer.tags[feature.tags_offset + t];
+                std::size_t key_value = layer.tags[feature.tags_offset + t + 1];
+                if (key_name < layer.keys.size() &&
+                    key_value < layer.values.size())
+                {
+                    json_value_visitor vv(env, att_obj, layer.keys[key_name]);
+                    mapnik::util::apply_visitor(vv, layer.values[key_value]);
+                }
+            }
+            feature_obj.Set("properties", att_obj);
+            if (feature.has_geometry && feature.has_type)
+            {
+                std::size_t offset = feature.geometry_offset * sizeof(std::uint32_t);
+                if (typed_geometry && decode_geometry)
+                {
+                    feature_obj.Set("geometry", Napi::Int32Array::New(env, feature.geometry_size, buffer, offset));
+                    offset += feature.geometry_size * sizeof(std::uint32_t);
+                    feature_obj.Set("geometry_parts", Napi::Uint32Array::New(env, feature.parts_size, buffer, offset));
+                    offset += feature.parts_size * sizeof(std::uint32_t);
+                    if (feature.polygons_size > 0)
+                    {
+                        feature_obj.Set("geometry_polygons", Napi::Uint32Array::New(env, feature.polygons_size, buffer, offset));
+                    }
+                    feature_obj.Set("geometry_type", feature.geometry_type);
+                }
+                else if (typed_geometry)
+                {
+                    feature_obj.Set("geometry", Napi::Uint32Array::New(env, feature.geometry_size, buffer, offset));
+                }
+                else if (decode_geometry)
+                {
+                    feature_obj.Set("geometry", geometry_to_array<std::int64_t>(env, feature.geometry));
+                    feature_obj.Set("geometry_type", feature.geometry_type);
+                }
+                else
+                {
+                    Napi::Array g_arr = Napi::Array::New(env, feature.geometry_size);
+                    for (std::size_t k = 0; k < feature.geometry_size; ++k)
+                    {
+                        g_arr.Set(k, Napi::Number::New(env, (*layer.buffer)[feature.geometry_offset + k]));
+                    }
+                    feature_obj.Set("geometry", g_arr);
+                }
+            }
+            f_arr.Set(f_idx, feature_obj);
+        }
+        layer_obj.Set("features", f_arr);
+        arr.Set(l_idx, layer_obj);
+    }
+    return arr;
+}
+
+struct AsyncToJSON : Napi::AsyncWorker
+{
+    using Base = Napi::AsyncWorker;
+    AsyncToJSON(mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                bool decode_geometry, bool typed_geometry,
+                Napi::Function const& callback)
+        : Base(callback),
+          tile_(tile),
+          decode_geometry_(decode_geometry),
+          typed_geometry_(typed_geometry)
+    {
+    }
+
+    void Execute() override
+    {
+        try
+        {
+            decode_tile_json(*tile_, decode_geometry_, typed_geometry_, layers_);
+        }
+        catch (std::exception const& ex)
+        {
+            SetError(ex.what());
+        }
+    }
+
+    std::vector<napi_value> GetResult(Napi::Env env) override
+    {
+        return {env.Undefined(), tile_json_to_array(env, layers_, decode_geometry_, typed_geometry_)};
+    }
+
+  private:
+    mapnik::vector_tile_impl::merc_tile_ptr tile_;
+    bool decode_geometry_;
+    bool typed_geometry_;
+    std::vector<json_layer> layers_;
+};
+
 } // namespace
 
 /**
@@ -546,6 +1012,14 @@ struct AsyncToGeoJSON : Napi::AsyncWorker
  * @param {Object} [options]
  * @param {boolean} [options.decode_geometry=false] return geometry as integers
  * relative to the tile grid
+ * @param {boolean} [options.typed_geometry=false] return the geometries as
+ * typed array views into one `ArrayBuffer` per layer instead of arrays of
+ * numbers: a `Uint32Array` of the encoded geometry, or with `decode_geometry`
+ * an `Int32Array` of x,y pairs along with `geometry_parts`, a `Uint32Array`
+ * of the number of points of each part (line or ring), and for polygons
+ * `geometry_polygons`, a `Uint32Array` of the number of rings of each polygon
+ * @param {Function} [callback] - `function(err, json)`: decode the tile on a
+ * worker thread instead of blocking
  * @returns {Object} json representation of this tile with name, extent,
  * version, and feature properties
  * @example
@@ -560,13 +1034,28 @@ struct AsyncToGeoJSON : Napi::AsyncWorker
  * //   version: 2,
  * //   features: [ ... ] // array of objects
  * // }
+ * @example
+ * vectorTile.toJSON({ decode_geometry: true, typed_geometry: true }, function(err, json) {
+ *   if (err) throw err;
+ *   var feature = json[0].features[0];
+ *   feature.geometry; // Int32Array [x0, y0, x1, y1, ...]
+ *   feature.geometry_parts; // Uint32Array of points per line or ring
+ * });
  */
 Napi::Value VectorTile::toJSON(Napi::CallbackInfo const& info)
 {
     Napi::Env env = info.Env();
     Napi::EscapableHandleScope scope(env);
     bool decode_geometry = false;
-    if (info.Length() >= 1)
+    bool typed_geometry = false;
+    Napi::Value callback;
+    std::size_t num_args = info.Length();
+    if (num_args >= 1 && info[num_args - 1].IsFunction())
+    {
+        callback = info[num_args - 1];
+        --num_args;
+    }
+    if (num_args >= 1)
     {
         if (!info[0].IsObject())
         {
@@ -584,187 +1073,30 @@ Napi::Value VectorTile::toJSON(Napi::CallbackInfo const& info)
             }
             decode_geometry = param_val.As<Napi::Boolean>();
         }
+        if (options.Has("typed_geometry"))
+        {
+            Napi::Value param_val = options.Get("typed_geometry");
+            if (!param_val.IsBoolean())
+            {
+                Napi::Error::New(env, "option 'typed_geometry' must be a boolean").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            typed_geometry = param_val.As<Napi::Boolean>();
+        }
+    }
+
+    if (!callback.IsEmpty())
+    {
+        auto* worker = new AsyncToJSON(tile_, decode_geometry, typed_geometry, callback.As<Napi::Function>());
+        worker->Queue();
+        return env.Undefined();
     }
 
     try
     {
-        protozero::pbf_reader tile_msg = tile_->get_reader();
-        Napi::Array arr = Napi::Array::New(env, tile_->get_layers().size());
-        std::size_t l_idx = 0;
-        while (tile_msg.next(mapnik::vector_tile_impl::Tile_Encoding::LAYERS))
-        {
-            protozero::pbf_reader layer_msg = tile_msg.get_message();
-            Napi::Object layer_obj = Napi::Object::New(env);
-            std::vector<std::string> layer_keys;
-            mapnik::vector_tile_impl::layer_pbf_attr_type layer_values;
-            std::vector<protozero::pbf_reader> layer_features;
-            protozero::pbf_reader val_msg;
-            std::uint32_t version = 1;
-            while (layer_msg.next())
-            {
-                switch (layer_msg.tag())
-                {
-                case mapnik::vector_tile_impl::Layer_Encoding::NAME:
-                    layer_obj.Set("name", layer_msg.get_string());
-                    break;
-                case mapnik::vector_tile_impl::Layer_Encoding::FEATURES:
-                    layer_features.push_back(layer_msg.get_message());
-                    break;
-                case mapnik::vector_tile_impl::Layer_Encoding::KEYS:
-                    layer_keys.push_back(layer_msg.get_string());
-                    break;
-                case mapnik::vector_tile_impl::Layer_Encoding::VALUES:
-                    val_msg = layer_msg.get_message();
-                    while (val_msg.next())
-                    {
-                        switch (val_msg.tag())
-                        {
-                        case mapnik::vector_tile_impl::Value_Encoding::STRING:
-                            layer_values.push_back(val_msg.get_string());
-                            break;
-                        case mapnik::vector_tile_impl::Value_Encoding::FLOAT:
-                            layer_values.push_back(val_msg.get_float());
-                            break;
-                        case mapnik::vector_tile_impl::Value_Encoding::DOUBLE:
-                            layer_values.push_back(val_msg.get_double());
-                            break;
-                        case mapnik::vector_tile_impl::Value_Encoding::INT:
-                            layer_values.push_back(val_msg.get_int64());
-                            break;
-                        case mapnik::vector_tile_impl::Value_Encoding::UINT:
-                            // LCOV_EXCL_START
-                            layer_values.push_back(val_msg.get_uint64());
-                            break;
-                            // LCOV_EXCL_STOP
-                        case mapnik::vector_tile_impl::Value_Encoding::SINT:
-                            // LCOV_EXCL_START
-                            layer_values.push_back(val_msg.get_sint64());
-                            break;
-                            // LCOV_EXCL_STOP
-                        case mapnik::vector_tile_impl::Value_Encoding::BOOL:
-                            layer_values.push_back(val_msg.get_bool());
-                            break;
-                        default:
-                            // LCOV_EXCL_START
-                            val_msg.skip();
-                            break;
-                            // LCOV_EXCL_STOP
-                        }
-                    }
-                    break;
-                case mapnik::vector_tile_impl::Layer_Encoding::EXTENT:
-                    layer_obj.Set("extent", Napi::Number::New(env, layer_msg.get_uint32()));
-                    break;
-                case mapnik::vector_tile_impl::Layer_Encoding::VERSION:
-                    version = layer_msg.get_uint32();
-                    layer_obj.Set("version", Napi::Number::New(env, version));
-                    break;
-                default:
-                    // LCOV_EXCL_START
-                    layer_msg.skip();
-                    break;
-                    // LCOV_EXCL_STOP
-                }
-            }
-            Napi::Array f_arr = Napi::Array::New(env, layer_features.size());
-            std::size_t f_idx = 0;
-            for (auto feature_msg : layer_features)
-            {
-                Napi::Object feature_obj = Napi::Object::New(env);
-                mapnik::vector_tile_impl::GeometryPBF::pbf_itr geom_itr;
-                mapnik::vector_tile_impl::GeometryPBF::pbf_itr tag_itr;
-                bool has_geom = false;
-                bool has_geom_type = false;
-                bool has_tags = false;
-                std::int32_t geom_type_enum = 0;
-                while (feature_msg.next())
-                {
-                    switch (feature_msg.tag())
-                    {
-                    case mapnik::vector_tile_impl::Feature_Encoding::ID:
-                        feature_obj.Set("id", Napi::Number::New(env, feature_msg.get_uint64()));
-                        break;
-                    case mapnik::vector_tile_impl::Feature_Encoding::TAGS:
-                        tag_itr = feature_msg.get_packed_uint32();
-                        has_tags = true;
-                        break;
-                    case mapnik::vector_tile_impl::Feature_Encoding::TYPE:
-                        geom_type_enum = feature_msg.get_enum();
-                        has_geom_type = true;
-                        feature_obj.Set("type", Napi::Number::New(env, geom_type_enum));
-                        break;
-                    case mapnik::vector_tile_impl::Feature_Encoding::GEOMETRY:
-                        geom_itr = feature_msg.get_packed_uint32();
-                        has_geom = true;
-                        break;
-                    case mapnik::vector_tile_impl::Feature_Encoding::RASTER: {
-                        auto im_buffer = feature_msg.get_view();
-                        feature_obj.Set("raster",
-                                        Napi::Buffer<char>::Copy(env, im_buffer.data(), im_buffer.size()));
-                        break;
-                    }
-                    default:
-                        // LCOV_EXCL_START
-                        feature_msg.skip();
-                        break;
-                        // LCOV_EXCL_STOP
-                    }
-                }
-                Napi::Object att_obj = Napi::Object::New(env);
-                if (has_tags)
-                {
-                    for (auto _i = tag_itr.begin(); _i != tag_itr.end();)
-                    {
-                        std::size_t key_name = *(_i++);
-                        if (_i == tag_itr.end())
-                        {
-                            break;
-                        }
-                        std::size_t key_value = *(_i++);
-                        if (key_name < layer_keys.size() &&
-                            key_value < layer_values.size())
-                        {
-                            std::string const& name = layer_keys.at(key_name);
-                            mapnik::vector_tile_impl::pbf_attr_value_type val = layer_values.at(key_value);
-                            json_value_visitor vv(env, att_obj, name);
-                            mapnik::util::apply_visitor(vv, val);
-                        }
-                    }
-                }
-                feature_obj.Set("properties", att_obj);
-                if (has_geom && has_geom_type)
-                {
-                    if (decode_geometry)
-                    {
-                        // Decode the geometry first into an int64_t mapnik geometry
-                        mapnik::vector_tile_impl::GeometryPBF geoms(geom_itr);
-                        mapnik::geometry::geometry<std::int64_t> geom = mapnik::vector_tile_impl::decode_geometry<std::int64_t>(geoms, geom_type_enum, version, 0, 0, 1.0, 1.0);
-                        Napi::Array g_arr = geometry_to_array<std::int64_t>(env, geom);
-                        feature_obj.Set("geometry", g_arr);
-                        std::string geom_type = geometry_type_as_string(geom);
-                        feature_obj.Set("geometry_type", geom_type);
-                    }
-                    else
-                    {
-                        std::vector<std::uint32_t> geom_vec;
-                        for (auto _i = geom_itr.begin(); _i != geom_itr.end(); ++_i)
-                        {
-                            geom_vec.push_back(*_i);
-                        }
-                        Napi::Array g_arr = Napi::Array::New(env, geom_vec.size());
-                        for (std::size_t k = 0; k < geom_vec.size(); ++k)
-                        {
-                            g_arr.Set(k, Napi::Number::New(env, geom_vec[k]));
-                        }
-                        feature_obj.Set("geometry", g_arr);
-                    }
-                }
-                f_arr.Set(f_idx++, feature_obj);
-            }
-            layer_obj.Set("features", f_arr);
-            arr.Set(l_idx++, layer_obj);
-        }
-        return scope.Escape(arr);
+        std::vector<json_layer> layers;
+        decode_tile_json(*tile_, decode_geometry, typed_geometry, layers);
+        return scope.Escape(tile_json_to_array(env, layers, decode_geometry, typed_geometry));
     }
     catch (std::exception const& ex)
     {
@@ -785,6 +1117,22 @@ Napi::Value VectorTile::toJSON(Napi::CallbackInfo const& info)
  * a layer or the string keywords `__array__` or `__all__` to get all layers in the form
  * of an array of GeoJSON `FeatureCollection`s or in the form of a single GeoJSON
  * `FeatureCollection` with all layers smooshed inside
+ * @param {Object} [options]
+ * @param {number|string} [options.precision] the number of decimals, from `0`
+ * to `15`, coordinates are rounded to, or `'auto'` for the fewest decimals that
+ * keep the precision of the tile's grid at its zoom level. Coordinates are
+ * written in full by default, and are then the same on every machine. Rounded
+ * ones are reprojected with the vector instructions of the CPU when it has
+ * them, which are within 1e-13 degrees of the scalar reprojection, so the last
+ * decimal can differ between machines for the rare coordinates that fall that
+ * close to a rounding boundary.
+ * @param {Array<number>} [options.bbox] `[minx, miny, maxx, maxy]` in WGS84:
+ * only features whose bounding box intersects it are written
+ * @param {mapnik.Expression} [options.filter] only features for which it is
+ * true are written. It sees the id and the properties of the features, not
+ * their geometry.
+ * @param {Array<string>} [options.properties] the names of the properties to
+ * write, all by default
  * @returns {string} stringified GeoJSON of all the features in this tile.
  * @example
  * var geojson = vectorTile.toGeoJSONSync('__all__');
@@ -809,6 +1157,20 @@ Napi::Value VectorTile::toGeoJSONSync(Napi::CallbackInfo const& info)
         return env.Undefined();
     }
 
+    node_mapnik::geojson_options geojson_options;
+    if (info.Length() > 1)
+    {
+        if (!info[1].IsObject())
+        {
+            Napi::TypeError::New(env, "optional second argument must be an options object").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        if (!geojson_options_from_object(env, info[1].As<Napi::Object>(), geojson_options))
+        {
+            return env.Undefined();
+        }
+    }
+
     std::string result;
     try
     {
@@ -817,15 +1179,15 @@ Napi::Value VectorTile::toGeoJSONSync(Napi::CallbackInfo const& info)
             std::string layer_name = layer_id.As<Napi::String>();
             if (layer_name == "__array__")
             {
-                write_geojson_array(result, tile_);
+                node_mapnik::write_geojson_array(result, tile_, geojson_options);
             }
             else if (layer_name == "__all__")
             {
-                write_geojson_all(result, tile_);
+                node_mapnik::write_geojson_all(result, tile_, geojson_options);
             }
             else
             {
-                if (!write_geojson_layer_name(result, layer_name, tile_))
+                if (!node_mapnik::write_geojson_layer_name(result, layer_name, tile_, geojson_options))
                 {
                     std::string error_msg("Layer name '" + layer_name + "' not found");
                     Napi::TypeError::New(env, error_msg.c_str()).ThrowAsJavaScriptException();
@@ -846,7 +1208,7 @@ Napi::Value VectorTile::toGeoJSONSync(Napi::CallbackInfo const& info)
                 Napi::TypeError::New(env, "Layer index exceeds the number of layers in the vector tile.").ThrowAsJavaScriptException();
                 return env.Undefined();
             }
-            if (!write_geojson_layer_index(result, layer_idx, tile_))
+            if (!node_mapnik::write_geojson_layer_index(result, layer_idx, tile_, geojson_options))
             {
                 // LCOV_EXCL_START
                 Napi::TypeError::New(env, "Layer could not be retrieved (should have not reached here)").ThrowAsJavaScriptException();
@@ -876,6 +1238,32 @@ Napi::Value VectorTile::toGeoJSONSync(Napi::CallbackInfo const& info)
  * a layer or the string keywords `__array__` or `__all__` to get all layers in the form
  * of an array of GeoJSON `FeatureCollection`s or in the form of a single GeoJSON
  * `FeatureCollection` with all layers smooshed inside
+ * @param {Object} [options]
+ * @param {Function} [options.on_chunk] - `function(chunk, next)`: stream the
+ * GeoJSON instead of building it as a single string. Each piece of the output is
+ * passed as `chunk` and the next one is only produced once `next()` has been
+ * called, so that at most one chunk is held in memory. Concatenated, the chunks
+ * are the same string as the non-streaming output. The callback is called with
+ * no result after the last chunk, or with the error that ended the stream,
+ * including one thrown by `on_chunk`. The tile is copied when the stream starts
+ * and later changes to it are not seen by the stream.
+ * @param {number} [options.chunk_features=1000] the maximum number of features
+ * in a chunk
+ * @param {number|string} [options.precision] the number of decimals, from `0`
+ * to `15`, coordinates are rounded to, or `'auto'` for the fewest decimals that
+ * keep the precision of the tile's grid at its zoom level. Coordinates are
+ * written in full by default, and are then the same on every machine. Rounded
+ * ones are reprojected with the vector instructions of the CPU when it has
+ * them, which are within 1e-13 degrees of the scalar reprojection, so the last
+ * decimal can differ between machines for the rare coordinates that fall that
+ * close to a rounding boundary.
+ * @param {Array<number>} [options.bbox] `[minx, miny, maxx, maxy]` in WGS84:
+ * only features whose bounding box intersects it are written
+ * @param {mapnik.Expression} [options.filter] only features for which it is
+ * true are written. It sees the id and the properties of the features, not
+ * their geometry.
+ * @param {Array<string>} [options.properties] the names of the properties to
+ * write, all by default
  * @param {Function} callback - `function(err, geojson)`: a stringified
  * GeoJSON of all the features in this tile
  * @example
@@ -884,6 +1272,17 @@ Napi::Value VectorTile::toGeoJSONSync(Napi::CallbackInfo const& info)
  *   console.log(geojson); // stringified GeoJSON
  *   console.log(JSON.parse(geojson)); // GeoJSON object
  * });
+ * @example
+ * var out = fs.createWriteStream('tile.geojson');
+ * vectorTile.toGeoJSON('__all__', {
+ *   on_chunk: function(chunk, next) {
+ *     if (out.write(chunk)) next();
+ *     else out.once('drain', next);
+ *   }
+ * }, function(err) {
+ *   if (err) throw err;
+ *   out.end();
+ * });
  */
 
 Napi::Value VectorTile::toGeoJSON(Napi::CallbackInfo const& info)
@@ -942,20 +1341,193 @@ Napi::Value VectorTile::toGeoJSON(Napi::CallbackInfo const& info)
         type = geojson_write_layer_index;
     }
 
+    Napi::Function on_chunk;
+    std::size_t chunk_features = 1000;
+    node_mapnik::geojson_options geojson_options;
+    if (info.Length() > 2)
+    {
+        if (!info[1].IsObject())
+        {
+            Napi::TypeError::New(env, "optional second argument must be an options object").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        Napi::Object options = info[1].As<Napi::Object>();
+        if (options.Has("on_chunk"))
+        {
+            Napi::Value param_val = options.Get("on_chunk");
+            if (!param_val.IsFunction())
+            {
+                Napi::TypeError::New(env, "option 'on_chunk' must be a function").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            on_chunk = param_val.As<Napi::Function>();
+        }
+        if (options.Has("chunk_features"))
+        {
+            Napi::Value param_val = options.Get("chunk_features");
+            if (!param_val.IsNumber() || param_val.As<Napi::Number>().Int64Value() <= 0)
+            {
+                Napi::TypeError::New(env, "option 'chunk_features' must be a positive integer").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            chunk_features = static_cast<std::size_t>(param_val.As<Napi::Number>().Int64Value());
+        }
+        if (!geojson_options_from_object(env, options, geojson_options))
+        {
+            return env.Undefined();
+        }
+    }
+
     Napi::Value callback = info[info.Length() - 1];
-    auto* worker = new AsyncToGeoJSON(tile_, type, layer_idx, layer_name, callback.As<Napi::Function>());
-    worker->Queue();
+    if (on_chunk.IsEmpty())
+    {
+        auto* worker = new AsyncToGeoJSON(tile_, type, layer_idx, layer_name, geojson_options, callback.As<Napi::Function>());
+        worker->Queue();
+        return env.Undefined();
+    }
+
+    // The stream reads the tile across several turns of the event loop, during
+    // which this object may be modified: it works on a copy of the tile.
+    auto tile = std::make_shared<mapnik::vector_tile_impl::merc_tile>(*tile_);
+    std::unique_ptr<node_mapnik::geojson_stream> stream;
+    if (type == geojson_write_all || type == geojson_write_array)
+    {
+        stream = std::make_unique<node_mapnik::geojson_stream>(tile, type == geojson_write_array, geojson_options);
+    }
+    else
+    {
+        protozero::pbf_reader layer_msg;
+        if (type == geojson_write_layer_index)
+        {
+            tile->layer_reader(static_cast<std::size_t>(layer_idx), layer_msg);
+            layer_name = tile->get_layers()[static_cast<std::size_t>(layer_idx)];
+        }
+        else
+        {
+            tile->layer_reader(layer_name, layer_msg);
+        }
+        stream = std::make_unique<node_mapnik::geojson_stream>(tile, layer_msg, layer_name, geojson_options);
+    }
+    queue_geojson_chunk(std::make_shared<geojson_stream_state>(std::move(stream),
+                                                               chunk_features,
+                                                               on_chunk,
+                                                               callback.As<Napi::Function>()));
     return env.Undefined();
 }
 
+namespace {
+
+struct geojson_layer_options
+{
+    double area_threshold = 0.1;
+    double simplify_distance = 0.0;
+    bool strictly_simple = true;
+    bool multi_polygon_union = false;
+    mapnik::vector_tile_impl::polygon_fill_type fill_type = mapnik::vector_tile_impl::positive_fill;
+    bool process_all_rings = false;
+};
+
+void add_geojson_as_tile_layer(mapnik::vector_tile_impl::merc_tile& tile,
+                               char const* data,
+                               std::size_t size,
+                               std::string const& layer_name,
+                               geojson_layer_options const& options)
+{
+    // create map object
+    auto tile_size = tile.tile_size();
+    mapnik::Map map(tile_size, tile_size, "epsg:3857");
+    mapnik::layer lyr(layer_name, "epsg:4326");
+    std::shared_ptr<mapnik::memory_datasource> ds = node_mapnik::read_geojson(data, size);
+    if (ds && ds->size() > 0)
+    {
+        ds->envelope(); // can be removed later, currently doesn't work with out this.
+        lyr.set_datasource(ds);
+    }
+    else
+    {
+        // documents the reader leaves alone, and empty ones, go through the
+        // geojson plugin as they always did
+        mapnik::parameters p;
+        p["type"] = "geojson";
+        p["inline"] = std::string(data, size);
+        lyr.set_datasource(mapnik::datasource_cache::instance().create(p));
+    }
+    map.add_layer(lyr);
+
+    mapnik::vector_tile_impl::processor ren(map);
+    ren.set_area_threshold(options.area_threshold);
+    ren.set_strictly_simple(options.strictly_simple);
+    ren.set_simplify_distance(options.simplify_distance);
+    ren.set_multi_polygon_union(options.multi_polygon_union);
+    ren.set_fill_type(options.fill_type);
+    ren.set_process_all_rings(options.process_all_rings);
+    ren.update_tile(tile);
+}
+
+struct AsyncAddGeoJSON : Napi::AsyncWorker
+{
+    AsyncAddGeoJSON(mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                    Napi::Value const& geojson,
+                    std::string const& layer_name,
+                    geojson_layer_options const& options,
+                    Napi::Function const& callback)
+        : Napi::AsyncWorker(callback),
+          tile_(tile),
+          layer_name_(layer_name),
+          options_(options)
+    {
+        if (geojson.IsBuffer())
+        {
+            Napi::Buffer<char> buffer = geojson.As<Napi::Buffer<char>>();
+            buffer_ref_ = Napi::Persistent(buffer);
+            data_ = buffer.Data();
+            dataLength_ = buffer.Length();
+        }
+        else
+        {
+            geojson_string_ = geojson.As<Napi::String>();
+            data_ = geojson_string_.data();
+            dataLength_ = geojson_string_.size();
+        }
+    }
+
+    void Execute() override
+    {
+        try
+        {
+            add_geojson_as_tile_layer(*tile_, data_, dataLength_, layer_name_, options_);
+        }
+        catch (std::exception const& ex)
+        {
+            SetError(ex.what());
+        }
+    }
+
+  private:
+    mapnik::vector_tile_impl::merc_tile_ptr tile_;
+    Napi::Reference<Napi::Buffer<char>> buffer_ref_;
+    std::string geojson_string_;
+    char const* data_ = nullptr;
+    std::size_t dataLength_ = 0;
+    std::string layer_name_;
+    geojson_layer_options options_;
+};
+
+} // namespace
+
 /**
- * Add features to this tile from a GeoJSON string. GeoJSON coordinates must be in the WGS84 longitude & latitude CRS
+ * Add features to this tile from GeoJSON. GeoJSON coordinates must be in the WGS84 longitude & latitude CRS
  * as specified in the [GeoJSON Specification](https://www.rfc-editor.org/rfc/rfc7946.txt).
  *
+ * FeatureCollections and Features whose properties are strings, numbers, booleans or
+ * `null` are read directly into the tile in a single pass, anything else goes through
+ * mapnik's geojson datasource. Passing the GeoJSON as a Buffer avoids building a string
+ * out of it, and passing a callback reads and encodes it off the main thread.
+ *
  * @memberof VectorTile
  * @instance
  * @name addGeoJSON
- * @param {string} geojson as a string
+ * @param {string|Buffer} geojson as a string or a Buffer of UTF-8 text
  * @param {string} name of the layer to be added
  * @param {Object} [options]
  * @param {number} [options.area_threshold=0.1] used to discard small polygons.
@@ -975,36 +1547,43 @@ Napi::Value VectorTile::toGeoJSON(Napi::CallbackInfo const& info)
  * to learn more about fill types.
  * @param {boolean} [options.process_all_rings=false] if `true`, don't assume winding order and ring order of
  * polygons are correct according to the [`2.0` Mapbox Vector Tile specification](https://github.com/mapbox/vector-tile-spec)
+ * @param {Function} [callback] if given, the features are added asynchronously and
+ * `callback(err)` is called once they are in the tile
  * @example
  * var geojson = { ... };
  * var vt = mapnik.VectorTile(0,0,0);
  * vt.addGeoJSON(JSON.stringify(geojson), 'layer-name', {});
+ * @example
+ * var vt = mapnik.VectorTile(0,0,0);
+ * vt.addGeoJSON(fs.readFileSync('./path/to/data.geojson'), 'layer-name', function(err) {
+ *   if (err) throw err;
+ *   // vt now has a 'layer-name' layer
+ * });
  */
 Napi::Value VectorTile::addGeoJSON(Napi::CallbackInfo const& info)
 {
     Napi::Env env = info.Env();
-    if (info.Length() < 1 || !info[0].IsString())
+    std::size_t args = info.Length();
+    Napi::Value callback;
+    if (args > 0 && info[args - 1].IsFunction())
+    {
+        callback = info[args - 1];
+        --args;
+    }
+    if (args < 1 || !(info[0].IsString() || info[0].IsBuffer()))
     {
-        Napi::Error::New(env, "first argument must be a GeoJSON string").ThrowAsJavaScriptException();
+        Napi::Error::New(env, "first argument must be a GeoJSON string or Buffer").ThrowAsJavaScriptException();
         return env.Undefined();
     }
-    if (info.Length() < 2 || !info[1].IsString())
+    if (args < 2 || !info[1].IsString())
     {
         Napi::Error::New(env, "second argument must be a layer name (string)").ThrowAsJavaScriptException();
         return env.Undefined();
     }
-    std::string geojson_string = info[0].As<Napi::String>();
     std::string geojson_name = info[1].As<Napi::String>();
 
-    Napi::Object options = Napi::Object::New(env);
-    double area_threshold = 0.1;
-    double simplify_distance = 0.0;
-    bool strictly_simple = true;
-    bool multi_polygon_union = false;
-    mapnik::vector_tile_impl::polygon_fill_type fill_type = mapnik::vector_tile_impl::positive_fill;
-    bool process_all_rings = false;
-
-    if (info.Length() > 2)
+    geojson_layer_options layer_options;
+    if (args > 2)
     {
         // options object
         if (!info[2].IsObject())
@@ -1013,7 +1592,7 @@ Napi::Value VectorTile::addGeoJSON(Napi::CallbackInfo const& info)
             return env.Undefined();
         }
 
-        options = info[2].As<Napi::Object>();
+        Napi::Object options = info[2].As<Napi::Object>();
         if (options.Has("area_threshold"))
         {
             Napi::Value param_val = options.Get("area_threshold");
@@ -1022,8 +1601,8 @@ Napi::Value VectorTile::addGeoJSON(Napi::CallbackInfo const& info)
                 Napi::Error::New(env, "option 'area_threshold' must be a number").ThrowAsJavaScriptException();
                 return env.Undefined();
             }
-            area_threshold = param_val.As<Napi::Number>().Int32Value();
-            if (area_threshold < 0.0)
+            layer_options.area_threshold = param_val.As<Napi::Number>().Int32Value();
+            if (layer_options.area_threshold < 0.0)
             {
                 Napi::Error::New(env, "option 'area_threshold' can not be negative").ThrowAsJavaScriptException();
                 return env.Undefined();
@@ -1037,7 +1616,7 @@ Napi::Value VectorTile::addGeoJSON(Napi::CallbackInfo const& info)
                 Napi::Error::New(env, "option 'strictly_simple' must be a boolean").ThrowAsJavaScriptException();
                 return env.Undefined();
             }
-            strictly_simple = param_val.As<Napi::Boolean>();
+            layer_options.strictly_simple = param_val.As<Napi::Boolean>();
         }
         if (options.Has("multi_polygon_union"))
         {
@@ -1047,7 +1626,7 @@ Napi::Value VectorTile::addGeoJSON(Napi::CallbackInfo const& info)
                 Napi::TypeError::New(env, "multi_polygon_union value must be a boolean").ThrowAsJavaScriptException();
                 return env.Undefined();
             }
-            multi_polygon_union = mpu.As<Napi::Boolean>();
+            layer_options.multi_polygon_union = mpu.As<Napi::Boolean>();
         }
         if (options.Has("fill_type"))
         {
@@ -1057,8 +1636,8 @@ Napi::Value VectorTile::addGeoJSON(Napi::CallbackInfo const& info)
                 Napi::TypeError::New(env, "optional arg 'fill_type' must be a number").ThrowAsJavaScriptException();
                 return env.Undefined();
             }
-            fill_type = static_cast<mapnik::vector_tile_impl::polygon_fill_type>(ft.As<Napi::Number>().Int32Value());
-            if (fill_type >= mapnik::vector_tile_impl::polygon_fill_type_max)
+            layer_options.fill_type = static_cast<mapnik::vector_tile_impl::polygon_fill_type>(ft.As<Napi::Number>().Int32Value());
+            if (layer_options.fill_type >= mapnik::vector_tile_impl::polygon_fill_type_max)
             {
                 Napi::TypeError::New(env, "optional arg 'fill_type' out of possible range").ThrowAsJavaScriptException();
                 return env.Undefined();
@@ -1072,8 +1651,8 @@ Napi::Value VectorTile::addGeoJSON(Napi::CallbackInfo const& info)
                 Napi::TypeError::New(env, "option 'simplify_distance' must be an floating point number").ThrowAsJavaScriptException();
                 return env.Undefined();
             }
-            simplify_distance = param_val.As<Napi::Number>().DoubleValue();
-            if (simplify_distance < 0.0)
+            layer_options.simplify_distance = param_val.As<Napi::Number>().DoubleValue();
+            if (layer_options.simplify_distance < 0.0)
             {
                 Napi::TypeError::New(env, "option 'simplify_distance' must be a positive number").ThrowAsJavaScriptException();
                 return env.Undefined();
@@ -1087,30 +1666,30 @@ Napi::Value VectorTile::addGeoJSON(Napi::CallbackInfo const& info)
                 Napi::TypeError::New(env, "option 'process_all_rings' must be a boolean").ThrowAsJavaScriptException();
                 return env.Undefined();
             }
-            process_all_rings = param_val.As<Napi::Boolean>();
+            layer_options.process_all_rings = param_val.As<Napi::Boolean>();
         }
     }
 
+    detach_exported_data();
+    if (!callback.IsEmpty())
+    {
+        auto* worker = new AsyncAddGeoJSON{tile_, info[0], geojson_name, layer_options, callback.As<Napi::Function>()};
+        worker->Queue();
+        return env.Undefined();
+    }
+
     try
     {
-        // create map object
-        auto tile_size = tile_->tile_size();
-        mapnik::Map map(tile_size, tile_size, "epsg:3857");
-        mapnik::parameters p;
-        p["type"] = "geojson";
-        p["inline"] = geojson_string;
-        mapnik::layer lyr(geojson_name, "epsg:4326");
-        lyr.set_datasource(mapnik::datasource_cache::instance().create(p));
-        map.add_layer(lyr);
-
-        mapnik::vector_tile_impl::processor ren(map);
-        ren.set_area_threshold(area_threshold);
-        ren.set_strictly_simple(strictly_simple);
-        ren.set_simplify_distance(simplify_distance);
-        ren.set_multi_polygon_union(multi_polygon_union);
-        ren.set_fill_type(fill_type);
-        ren.set_process_all_rings(process_all_rings);
-        ren.update_tile(*tile_);
+        if (info[0].IsBuffer())
+        {
+            Napi::Buffer<char> buffer = info[0].As<Napi::Buffer<char>>();
+            add_geojson_as_tile_layer(*tile_, buffer.Data(), buffer.Length(), geojson_name, layer_options);
+        }
+        else
+        {
+            std::string geojson_string = info[0].As<Napi::String>();
+            add_geojson_as_tile_layer(*tile_, geojson_string.data(), geojson_string.size(), geojson_name, layer_options);
+        }
         return Napi::Boolean::New(env, true);
     }
     catch (std::exception const& ex)
@@ -1,232 +1,110 @@
 #include "mapnik_vector_tile.hpp"
 #include "mapnik_feature.hpp"
+#include "mercator.hpp"
+#include "p2p_distance.hpp"
+#include "utils.hpp"
 // protozero
 #include <protozero/pbf_reader.hpp>
 // mapnik
 #include <mapnik/geom_util.hpp>
 #include <mapnik/hit_test_filter.hpp>
-#include <mapnik/projection.hpp>
-#include <mapnik/proj_transform.hpp>
 // mapnik-vector-tile
 #include "mapnik_vector_tile.hpp"
 #include "vector_tile_projection.hpp"
 #include "vector_tile_datasource_pbf.hpp"
+// stl
+#include <future>
+#include <map>
+#include <set>
 
 namespace detail {
 
-struct p2p_result
+std::vector<query_result> _query(mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                                 node_mapnik::vector_tile_query_index& index,
+                                 double lon, double lat, double tolerance, std::string const& layer_name)
 {
-    double distance = -1;
-    double x_hit = 0;
-    double y_hit = 0;
-};
-
-struct p2p_distance
-{
-    p2p_distance(double x, double y)
-        : x_(x),
-          y_(y) {}
-
-    p2p_result operator()(mapnik::geometry::geometry_empty const&) const
+    std::vector<query_result> arr;
+    if (tile->is_empty())
     {
-        p2p_result p2p;
-        return p2p;
+        return arr;
     }
 
-    p2p_result operator()(mapnik::geometry::point<double> const& geom) const
-    {
-        p2p_result p2p;
-        p2p.x_hit = geom.x;
-        p2p.y_hit = geom.y;
-        p2p.distance = mapnik::distance(geom.x, geom.y, x_, y_);
-        return p2p;
-    }
-    p2p_result operator()(mapnik::geometry::multi_point<double> const& geom) const
-    {
-        p2p_result p2p;
-        for (auto const& pt : geom)
+    double xy[2] = {lon, lat};
+    node_mapnik::lonlat_to_merc(xy, 1);
+    double const x = xy[0];
+    double const y = xy[1];
+
+    mapnik::coord2d pt(x, y);
+    protozero::data_view tile_view(tile->data(), tile->size());
+    mapnik::box2d<double> const extent = tile->extent();
+    double const pad = std::max(tolerance, 0.0);
+    std::vector<std::uint32_t> candidates;
+    auto query_layer = [&](protozero::data_view const& layer_view) {
+        // Only decode the features whose bbox, padded by a tile unit against
+        // rounding, can be within tolerance of the point.
+        auto layer_index = index.get(tile_view, layer_view);
+        double scale = layer_index->extent() / extent.width();
+        candidates.clear();
+        layer_index->query((pt.x - pad - extent.minx()) * scale - 1,
+                           (extent.maxy() - (pt.y + pad)) * scale - 1,
+                           (pt.x + pad - extent.minx()) * scale + 1,
+                           (extent.maxy() - (pt.y - pad)) * scale + 1,
+                           candidates);
+        auto& stats = node_mapnik::vector_tile_query_stats();
+        stats.features_decoded += candidates.size();
+        stats.features_skipped += layer_index->size() - candidates.size();
+        // A decoded feature only carries its id, which tells whether it was
+        // encoded unless it is also the position of an id-less candidate.
+        std::set<std::uint64_t> encoded_ids;
+        std::set<std::uint64_t> positional_ids;
+        for (std::uint32_t record : candidates)
         {
-            p2p_result p2p_sub = operator()(pt);
-            if (p2p_sub.distance >= 0 && (p2p.distance < 0 || p2p_sub.distance < p2p.distance))
+            if (layer_index->has_encoded_id(record))
             {
-                p2p.x_hit = p2p_sub.x_hit;
-                p2p.y_hit = p2p_sub.y_hit;
-                p2p.distance = p2p_sub.distance;
+                encoded_ids.insert(layer_index->id(record));
             }
-        }
-        return p2p;
-    }
-    p2p_result operator()(mapnik::geometry::line_string<double> const& geom) const
-    {
-        p2p_result p2p;
-        auto num_points = geom.size();
-        if (num_points > 1)
-        {
-            for (std::size_t i = 1; i < num_points; ++i)
+            else
             {
-                auto const& pt0 = geom[i - 1];
-                auto const& pt1 = geom[i];
-                double dist = mapnik::point_to_segment_distance(x_, y_, pt0.x, pt0.y, pt1.x, pt1.y);
-                if (dist >= 0 && (p2p.distance < 0 || dist < p2p.distance))
-                {
-                    p2p.x_hit = pt0.x;
-                    p2p.y_hit = pt0.y;
-                    p2p.distance = dist;
-                }
+                positional_ids.insert(layer_index->id(record));
             }
         }
-        return p2p;
-    }
-    p2p_result operator()(mapnik::geometry::multi_line_string<double> const& geom) const
-    {
-        p2p_result p2p;
-        for (auto const& line : geom)
+        std::string const subset = layer_index->subset(layer_view, candidates);
+        protozero::pbf_reader layer_msg(subset);
+        auto ds = std::make_shared<mapnik::vector_tile_impl::tile_datasource_pbf>(
+            layer_msg,
+            tile->x(),
+            tile->y(),
+            tile->z());
+        mapnik::featureset_ptr fs = ds->features_at_point(pt, tolerance);
+        if (fs && !mapnik::is_empty(fs))
         {
-            p2p_result p2p_sub = operator()(line);
-            if (p2p_sub.distance >= 0 && (p2p.distance < 0 || p2p_sub.distance < p2p.distance))
+            mapnik::feature_ptr feature;
+            while ((feature = fs->next()))
             {
-                p2p.x_hit = p2p_sub.x_hit;
-                p2p.y_hit = p2p_sub.y_hit;
-                p2p.distance = p2p_sub.distance;
-            }
-        }
-        return p2p;
-    }
-    p2p_result operator()(mapnik::geometry::polygon<double> const& poly) const
-    {
-        p2p_result p2p;
-        std::size_t num_rings = poly.size();
-        bool inside = false;
-        for (std::size_t ring_index = 0; ring_index < num_rings; ++ring_index)
-        {
-            auto const& ring = poly[ring_index];
-            auto num_points = ring.size();
-            if (num_points < 4)
-            {
-                if (ring_index == 0) // exterior
-                    return p2p;
-                else // interior
-                    continue;
-            }
-            for (std::size_t index = 1; index < num_points; ++index)
-            {
-                auto const& pt0 = ring[index - 1];
-                auto const& pt1 = ring[index];
-                // todo - account for tolerance
-                if (mapnik::detail::pip(pt0.x, pt0.y, pt1.x, pt1.y, x_, y_))
+                auto const& geom = feature->get_geometry();
+                auto p2p = path_to_point_distance(geom, x, y);
+                if (p2p.distance >= 0 && p2p.distance <= tolerance)
                 {
-                    inside = !inside;
+                    query_result res;
+                    res.x_hit = p2p.x_hit;
+                    res.y_hit = p2p.y_hit;
+                    res.distance = p2p.distance;
+                    res.layer = ds->get_name();
+                    res.feature = feature;
+                    auto id = static_cast<std::uint64_t>(feature->id());
+                    res.encoded_id = encoded_ids.count(id) > 0 && positional_ids.count(id) == 0;
+                    arr.push_back(std::move(res));
                 }
             }
-            if (ring_index == 0 && !inside) return p2p;
-        }
-        if (inside) p2p.distance = 0;
-        return p2p;
-    }
-
-    p2p_result operator()(mapnik::geometry::multi_polygon<double> const& geom) const
-    {
-        p2p_result p2p;
-        for (auto const& poly : geom)
-        {
-            p2p_result p2p_sub = operator()(poly);
-            if (p2p_sub.distance >= 0 && (p2p.distance < 0 || p2p_sub.distance < p2p.distance))
-            {
-                p2p.x_hit = p2p_sub.x_hit;
-                p2p.y_hit = p2p_sub.y_hit;
-                p2p.distance = p2p_sub.distance;
-            }
-        }
-        return p2p;
-    }
-    p2p_result operator()(mapnik::geometry::geometry_collection<double> const& collection) const
-    {
-        // There is no current way that a geometry collection could be returned from a vector tile.
-        // LCOV_EXCL_START
-        p2p_result p2p;
-        for (auto const& geom : collection)
-        {
-            p2p_result p2p_sub = mapnik::util::apply_visitor((*this), geom);
-            if (p2p_sub.distance >= 0 && (p2p.distance < 0 || p2p_sub.distance < p2p.distance))
-            {
-                p2p.x_hit = p2p_sub.x_hit;
-                p2p.y_hit = p2p_sub.y_hit;
-                p2p.distance = p2p_sub.distance;
-            }
         }
-        return p2p;
-        // LCOV_EXCL_STOP
-    }
-
-    double x_;
-    double y_;
-};
-
-detail::p2p_result path_to_point_distance(mapnik::geometry::geometry<double> const& geom, double x, double y)
-{
-    return mapnik::util::apply_visitor(detail::p2p_distance(x, y), geom);
-}
-
-std::vector<query_result> _query(mapnik::vector_tile_impl::merc_tile_ptr const& tile, double lon, double lat, double tolerance, std::string const& layer_name)
-{
-    std::vector<query_result> arr;
-    if (tile->is_empty())
-    {
-        return arr;
-    }
+    };
 
-    mapnik::projection wgs84("epsg:4326", true);
-    mapnik::projection merc("epsg:3857", true);
-    mapnik::proj_transform tr(wgs84, merc);
-    double x = lon;
-    double y = lat;
-    double z = 0;
-    if (!tr.forward(x, y, z))
-    {
-        // THIS CAN NEVER BE REACHED CURRENTLY
-        // internally lonlat2merc in mapnik can never return false.
-        // LCOV_EXCL_START
-        throw std::runtime_error("could not reproject lon/lat to mercator");
-        // LCOV_EXCL_STOP
-    }
-
-    mapnik::coord2d pt(x, y);
     if (!layer_name.empty())
     {
         protozero::pbf_reader layer_msg;
         if (tile->layer_reader(layer_name, layer_msg))
         {
-            auto ds = std::make_shared<mapnik::vector_tile_impl::tile_datasource_pbf>(
-                layer_msg,
-                tile->x(),
-                tile->y(),
-                tile->z());
-            mapnik::featureset_ptr fs = ds->features_at_point(pt, tolerance);
-            if (fs && !mapnik::is_empty(fs))
-            {
-                mapnik::feature_ptr feature;
-                while ((feature = fs->next()))
-                {
-                    auto const& geom = feature->get_geometry();
-                    auto p2p = path_to_point_distance(geom, x, y);
-                    if (!tr.backward(p2p.x_hit, p2p.y_hit, z))
-                    {
-                        // LCOV_EXCL_START
-                        throw std::runtime_error("could not reproject lon/lat to mercator");
-                        // LCOV_EXCL_STOP
-                    }
-                    if (p2p.distance >= 0 && p2p.distance <= tolerance)
-                    {
-                        query_result res;
-                        res.x_hit = p2p.x_hit;
-                        res.y_hit = p2p.y_hit;
-                        res.distance = p2p.distance;
-                        res.layer = layer_name;
-                        res.feature = feature;
-                        arr.push_back(std::move(res));
-                    }
-                }
-            }
+            query_layer(layer_msg.data());
         }
     }
     else
@@ -234,40 +112,23 @@ std::vector<query_result> _query(mapnik::vector_tile_impl::merc_tile_ptr const&
         protozero::pbf_reader item(tile->get_reader());
         while (item.next(mapnik::vector_tile_impl::Tile_Encoding::LAYERS))
         {
-            protozero::pbf_reader layer_msg = item.get_message();
-            auto ds = std::make_shared<mapnik::vector_tile_impl::tile_datasource_pbf>(
-                layer_msg,
-                tile->x(),
-                tile->y(),
-                tile->z());
-            mapnik::featureset_ptr fs = ds->features_at_point(pt, tolerance);
-            if (fs && !mapnik::is_empty(fs))
-            {
-                mapnik::feature_ptr feature;
-                while ((feature = fs->next()))
-                {
-                    auto const& geom = feature->get_geometry();
-                    auto p2p = path_to_point_distance(geom, x, y);
-                    if (!tr.backward(p2p.x_hit, p2p.y_hit, z))
-                    {
-                        // LCOV_EXCL_START
-                        throw std::runtime_error("could not reproject lon/lat to mercator");
-                        // LCOV_EXCL_STOP
-                    }
-                    if (p2p.distance >= 0 && p2p.distance <= tolerance)
-                    {
-                        query_result res;
-                        res.x_hit = p2p.x_hit;
-                        res.y_hit = p2p.y_hit;
-                        res.distance = p2p.distance;
-                        res.layer = ds->get_name();
-                        res.feature = feature;
-                        arr.push_back(std::move(res));
-                    }
-                }
-            }
+            query_layer(item.get_view());
         }
     }
+    // hits are found in mercator, back-project them all at once
+    std::vector<double> hits;
+    hits.reserve(arr.size() * 2);
+    for (auto const& res : arr)
+    {
+        hits.push_back(res.x_hit);
+        hits.push_back(res.y_hit);
+    }
+    node_mapnik::merc_to_lonlat(hits.data(), arr.size());
+    for (std::size_t i = 0; i < arr.size(); ++i)
+    {
+        arr[i].x_hit = hits[2 * i];
+        arr[i].y_hit = hits[2 * i + 1];
+    }
     std::sort(arr.begin(), arr.end(), [](query_result const& a, query_result const& b) {
         return a.distance < b.distance;
     });
@@ -294,10 +155,13 @@ Napi::Array _queryResultToV8(Napi::Env env, std::vector<query_result>& result)
 struct AsyncQuery : Napi::AsyncWorker
 {
     using Base = Napi::AsyncWorker;
-    AsyncQuery(mapnik::vector_tile_impl::merc_tile_ptr const& tile, double lon, double lat, double tolerance,
+    AsyncQuery(mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+               std::shared_ptr<node_mapnik::vector_tile_query_index> const& index,
+               double lon, double lat, double tolerance,
                std::string layer_name, Napi::Function const& callback)
         : Base(callback),
           tile_(tile),
+          index_(index),
           lon_(lon),
           lat_(lat),
           tolerance_(tolerance),
@@ -309,7 +173,7 @@ struct AsyncQuery : Napi::AsyncWorker
     {
         try
         {
-            result_ = _query(tile_, lon_, lat_, tolerance_, layer_name_);
+            result_ = _query(tile_, *index_, lon_, lat_, tolerance_, layer_name_);
         }
         catch (std::exception const& ex)
         {
@@ -324,6 +188,7 @@ struct AsyncQuery : Napi::AsyncWorker
 
   private:
     mapnik::vector_tile_impl::merc_tile_ptr tile_;
+    std::shared_ptr<node_mapnik::vector_tile_query_index> index_;
     double lon_;
     double lat_;
     double tolerance_;
@@ -331,6 +196,125 @@ struct AsyncQuery : Napi::AsyncWorker
     std::vector<query_result> result_;
 };
 
+// Query tiles
+
+struct query_tile
+{
+    mapnik::vector_tile_impl::merc_tile_ptr tile;
+    std::shared_ptr<node_mapnik::vector_tile_query_index> index;
+};
+
+std::vector<query_result> _queryTiles(std::vector<query_tile> const& tiles, double lon, double lat, double tolerance,
+                                      std::string const& layer_name, std::launch threading_mode)
+{
+    std::vector<std::future<std::vector<query_result>>> futures;
+    futures.reserve(tiles.size());
+    for (auto const& item : tiles)
+    {
+        futures.push_back(std::async(threading_mode, [&item, lon, lat, tolerance, &layer_name]() {
+            return _query(item.tile, *item.index, lon, lat, tolerance, layer_name);
+        }));
+    }
+    using feature_key = std::pair<std::string, mapnik::value_integer>;
+    std::vector<std::vector<query_result>> results;
+    results.reserve(futures.size());
+    for (auto& future : futures)
+    {
+        results.push_back(future.get());
+    }
+    // A feature crossing tile edges is encoded in each tile with the same id,
+    // keep its closest hit. Features without an encoded id can't be matched
+    // across tiles, nor can ids that several features of one tile share.
+    std::set<feature_key> ambiguous;
+    for (auto const& tile_results : results)
+    {
+        std::set<feature_key> in_tile;
+        for (auto const& res : tile_results)
+        {
+            if (res.encoded_id)
+            {
+                auto key = std::make_pair(res.layer, res.feature->id());
+                if (!in_tile.insert(key).second) ambiguous.insert(std::move(key));
+            }
+        }
+    }
+    std::vector<query_result> arr;
+    std::map<feature_key, std::size_t> seen;
+    for (auto& tile_results : results)
+    {
+        for (auto& res : tile_results)
+        {
+            if (!res.encoded_id)
+            {
+                arr.push_back(std::move(res));
+                continue;
+            }
+            auto key = std::make_pair(res.layer, res.feature->id());
+            if (ambiguous.count(key) > 0)
+            {
+                arr.push_back(std::move(res));
+                continue;
+            }
+            auto itr = seen.find(key);
+            if (itr == seen.end())
+            {
+                seen.emplace(std::move(key), arr.size());
+                arr.push_back(std::move(res));
+            }
+            else if (res.distance < arr[itr->second].distance)
+            {
+                arr[itr->second] = std::move(res);
+            }
+        }
+    }
+    std::stable_sort(arr.begin(), arr.end(), [](query_result const& a, query_result const& b) {
+        return a.distance < b.distance;
+    });
+    return arr;
+}
+
+struct AsyncQueryTiles : Napi::AsyncWorker
+{
+    using Base = Napi::AsyncWorker;
+    AsyncQueryTiles(std::vector<query_tile> const& tiles, double lon, double lat, double tolerance,
+                    std::string layer_name, std::launch threading_mode, Napi::Function const& callback)
+        : Base(callback),
+          tiles_(tiles),
+          lon_(lon),
+          lat_(lat),
+          tolerance_(tolerance),
+          layer_name_(layer_name),
+          threading_mode_(threading_mode)
+    {
+    }
+
+    void Execute() override
+    {
+        try
+        {
+            result_ = _queryTiles(tiles_, lon_, lat_, tolerance_, layer_name_, threading_mode_);
+        }
+        catch (std::exception const& ex)
+        {
+            SetError(ex.what());
+        }
+    }
+    std::vector<napi_value> GetResult(Napi::Env env) override
+    {
+        Napi::Array arr = _queryResultToV8(env, result_);
+        return {env.Undefined(), arr};
+    }
+
+  private:
+    std::vector<query_tile> tiles_;
+    double lon_;
+    double lat_;
+    double tolerance_;
+    std::string layer_name_;
+    std::launch threading_mode_;
+    std::vector<query_result> result_;
+};
+
 // Query many
 
 Napi::Object _queryManyResultToV8(Napi::Env env, queryMany_result& result)
@@ -367,8 +351,164 @@ Napi::Object _queryManyResultToV8(Napi::Env env, queryMany_result& result)
     return results;
 }
 
+// Uniform grid over the query points of queryMany, with about one point per
+// cell, so that each feature is only measured against the points that fall
+// within its bbox padded by the tolerance.
+class point_grid
+{
+  public:
+    explicit point_grid(std::vector<mapnik::coord2d> const& points)
+        : points_(points)
+    {
+        if (points_.empty()) return;
+        for (auto const& pt : points_)
+        {
+            bbox_.expand_to_include(pt);
+        }
+        columns_ = rows_ = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(points_.size()))));
+        cell_width_ = bbox_.width() / columns_;
+        cell_height_ = bbox_.height() / rows_;
+        // Counting sort of the point indices by cell, keeping them ascending
+        // within each cell.
+        cell_start_.assign(columns_ * rows_ + 1, 0);
+        std::vector<std::size_t> cells;
+        cells.reserve(points_.size());
+        for (auto const& pt : points_)
+        {
+            std::size_t cell = row(pt.y) * columns_ + column(pt.x);
+            cells.push_back(cell);
+            ++cell_start_[cell + 1];
+        }
+        for (std::size_t i = 1; i < cell_start_.size(); ++i)
+        {
+            cell_start_[i] += cell_start_[i - 1];
+        }
+        entries_.resize(points_.size());
+        std::vector<std::size_t> next(cell_start_.begin(), cell_start_.end() - 1);
+        for (std::size_t p = 0; p < points_.size(); ++p)
+        {
+            entries_[next[cells[p]]++] = p;
+        }
+    }
+
+    // Collects the indices of the points within the box, in ascending order.
+    void query(mapnik::box2d<double> const& box, std::vector<std::size_t>& result) const
+    {
+        result.clear();
+        if (points_.empty() || !box.intersects(bbox_)) return;
+        std::size_t col0 = column(box.minx());
+        std::size_t col1 = column(box.maxx());
+        std::size_t row0 = row(box.miny());
+        std::size_t row1 = row(box.maxy());
+        for (std::size_t r = row0; r <= row1; ++r)
+        {
+            for (std::size_t c = col0; c <= col1; ++c)
+            {
+                std::size_t cell = r * columns_ + c;
+                for (std::size_t i = cell_start_[cell]; i < cell_start_[cell + 1]; ++i)
+                {
+                    std::size_t p = entries_[i];
+                    if (box.contains(points_[p])) result.push_back(p);
+                }
+            }
+        }
+        std::sort(result.begin(), result.end());
+    }
+
+  private:
+    std::size_t column(double x) const
+    {
+        if (!(cell_width_ > 0) || !(x > bbox_.minx())) return 0;
+        return std::min(columns_ - 1, static_cast<std::size_t>((x - bbox_.minx()) / cell_width_));
+    }
+    std::size_t row(double y) const
+    {
+        if (!(cell_height_ > 0) || !(y > bbox_.miny())) return 0;
+        return std::min(rows_ - 1, static_cast<std::size_t>((y - bbox_.miny()) / cell_height_));
+    }
+
+    std::vector<mapnik::coord2d> const& points_;
+    mapnik::box2d<double> bbox_;
+    std::size_t columns_ = 0;
+    std::size_t rows_ = 0;
+    double cell_width_ = 0;
+    double cell_height_ = 0;
+    std::vector<std::size_t> cell_start_;
+    std::vector<std::size_t> entries_;
+};
+
+// Columnar form of the queryMany results: one typed array per hit property,
+// grouped by point and sorted by distance, and one array per attribute.
+Napi::Object _queryManyResultToColumns(Napi::Env env, queryMany_result& result)
+{
+    std::size_t num_hits = 0;
+    for (auto const& hit : result.hits)
+    {
+        num_hits += hit.second.size();
+    }
+    Napi::Uint32Array points = Napi::Uint32Array::New(env, num_hits);
+    Napi::Uint32Array feature_ids = Napi::Uint32Array::New(env, num_hits);
+    Napi::Float64Array distances = Napi::Float64Array::New(env, num_hits);
+    std::size_t i = 0;
+    for (auto const& hit : result.hits)
+    {
+        for (auto const& h : hit.second)
+        {
+            points[i] = hit.first;
+            feature_ids[i] = h.feature_id;
+            distances[i] = h.distance;
+            ++i;
+        }
+    }
+    Napi::Object hits = Napi::Object::New(env);
+    hits.Set("point", points);
+    hits.Set("feature", feature_ids);
+    hits.Set("distance", distances);
+
+    // Features are numbered from 0 without gaps.
+    std::size_t num_features = result.features.size();
+    Napi::Float64Array ids = Napi::Float64Array::New(env, num_features);
+    Napi::Object attributes = Napi::Object::New(env);
+    std::vector<Napi::Array> columns;
+    columns.reserve(result.fields.size());
+    for (std::string const& name : result.fields)
+    {
+        columns.push_back(Napi::Array::New(env, num_features));
+        attributes.Set(name, columns.back());
+    }
+    std::string layer;
+    for (auto const& item : result.features)
+    {
+        mapnik::feature_ptr const& feature = item.second.feature;
+        layer = item.second.layer;
+        ids[item.first] = static_cast<double>(feature->id());
+        for (std::size_t f = 0; f < result.fields.size(); ++f)
+        {
+            std::string const& name = result.fields[f];
+            if (feature->has_key(name))
+            {
+                columns[f].Set(item.first, mapnik::util::apply_visitor(node_mapnik::value_converter(env), feature->get(name)));
+            }
+            else
+            {
+                columns[f].Set(item.first, env.Null());
+            }
+        }
+    }
+    Napi::Object features = Napi::Object::New(env);
+    features.Set("id", ids);
+    features.Set("layer", layer);
+    features.Set("attributes", attributes);
+
+    Napi::Object results = Napi::Object::New(env);
+    results.Set("hits", hits);
+    results.Set("features", features);
+    return results;
+}
+
 void _queryMany(queryMany_result& result,
                 mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                node_mapnik::vector_tile_query_index& index,
                 std::vector<query_lonlat> const& query,
                 double tolerance,
                 std::string const& layer_name,
@@ -385,31 +525,59 @@ void _queryMany(queryMany_result& result,
 
     // Reproject query => mercator points
     mapnik::box2d<double> bbox;
-    mapnik::projection wgs84("epsg:4326", true);
-    mapnik::projection merc("epsg:3857", true);
-    mapnik::proj_transform tr(wgs84, merc);
+    std::vector<double> xy;
+    xy.reserve(query.size() * 2);
+    for (auto const& lonlat : query)
+    {
+        xy.push_back(lonlat.lon);
+        xy.push_back(lonlat.lat);
+    }
+    node_mapnik::lonlat_to_merc(xy.data(), query.size());
     std::vector<mapnik::coord2d> points;
     points.reserve(query.size());
     for (std::size_t p = 0; p < query.size(); ++p)
     {
-        double x = query[p].lon;
-        double y = query[p].lat;
-        double z = 0;
-        if (!tr.forward(x, y, z))
-        {
-            // LCOV_EXCL_START
-            throw std::runtime_error("could not reproject lon/lat to mercator");
-            // LCOV_EXCL_STOP
-        }
-        mapnik::coord2d pt(x, y);
+        mapnik::coord2d pt(xy[2 * p], xy[2 * p + 1]);
         bbox.expand_to_include(pt);
         points.emplace_back(std::move(pt));
     }
     bbox.pad(tolerance);
 
+    // Only decode the features whose bbox, padded by a tile unit against
+    // rounding, can be within tolerance of one of the points.
+    auto layer_index = index.get(protozero::data_view(tile->data(), tile->size()), layer_msg.data());
+    mapnik::box2d<double> const extent = tile->extent();
+    double const scale = layer_index->extent() / extent.width();
+    double const pad = std::max(tolerance, 0.0);
+    std::vector<bool> near(layer_index->size(), false);
+    std::vector<std::uint32_t> candidates;
+    for (auto const& pt : points)
+    {
+        candidates.clear();
+        layer_index->query((pt.x - pad - extent.minx()) * scale - 1,
+                           (extent.maxy() - (pt.y + pad)) * scale - 1,
+                           (pt.x + pad - extent.minx()) * scale + 1,
+                           (extent.maxy() - (pt.y - pad)) * scale + 1,
+                           candidates);
+        for (std::uint32_t feature : candidates)
+        {
+            near[feature] = true;
+        }
+    }
+    candidates.clear();
+    for (std::size_t i = 0; i < near.size(); ++i)
+    {
+        if (near[i]) candidates.push_back(static_cast<std::uint32_t>(i));
+    }
+    auto& stats = node_mapnik::vector_tile_query_stats();
+    stats.features_decoded += candidates.size();
+    stats.features_skipped += layer_index->size() - candidates.size();
+    std::string const subset = layer_index->subset(layer_msg.data(), candidates);
+    protozero::pbf_reader subset_msg(subset);
+
     std::shared_ptr<mapnik::vector_tile_impl::tile_datasource_pbf> ds = std::make_shared<
         mapnik::vector_tile_impl::tile_datasource_pbf>(
-        layer_msg,
+        subset_msg,
         tile->x(),
         tile->y(),
         tile->z());
@@ -421,6 +589,7 @@ void _queryMany(queryMany_result& result,
         for (auto const& field : fields2)
         {
             q.add_property_name(field.get_name());
+            result.fields.push_back(field.get_name());
         }
     }
     else
@@ -429,17 +598,27 @@ void _queryMany(queryMany_result& result,
         {
             q.add_property_name(name);
         }
+        result.fields = fields;
     }
     mapnik::featureset_ptr fs = ds->features(q);
 
     if (fs && !mapnik::is_empty(fs))
     {
+        point_grid grid(points);
+        std::vector<std::size_t> candidates;
+        // A point within tolerance of a geometry lies within its bbox padded
+        // by the tolerance, with a little slack for rounding.
+        double pad = std::max(tolerance, 0.0) * (1 + 1e-9) + 1e-6;
         mapnik::feature_ptr feature;
         unsigned idx = 0;
         while ((feature = fs->next()))
         {
+            mapnik::box2d<double> feature_bbox = feature->envelope();
+            if (!feature_bbox.valid()) continue;
+            feature_bbox.pad(pad);
+            grid.query(feature_bbox, candidates);
             unsigned has_hit = 0;
-            for (std::size_t p = 0; p < points.size(); ++p)
+            for (std::size_t p : candidates)
             {
                 mapnik::coord2d const& pt = points[p];
                 auto const& geom = feature->get_geometry();
@@ -496,14 +675,18 @@ struct AsyncQueryMany : Napi::AsyncWorker
 {
     using Base = Napi::AsyncWorker;
     AsyncQueryMany(mapnik::vector_tile_impl::merc_tile_ptr const& tile,
+                   std::shared_ptr<node_mapnik::vector_tile_query_index> const& index,
                    std::vector<query_lonlat> const& query, double tolerance,
-                   std::string layer_name, std::vector<std::string> const& fields, Napi::Function const& callback)
+                   std::string layer_name, std::vector<std::string> const& fields,
+                   bool columnar, Napi::Function const& callback)
         : Base(callback),
           tile_(tile),
+          index_(index),
           query_(query),
           tolerance_(tolerance),
           layer_name_(layer_name),
-          fields_(fields)
+          fields_(fields),
+          columnar_(columnar)
     {
     }
 
@@ -511,7 +694,7 @@ struct AsyncQueryMany : Napi::AsyncWorker
     {
         try
         {
-            _queryMany(result_, tile_, query_, tolerance_, layer_name_, fields_);
+            _queryMany(result_, tile_, *index_, query_, tolerance_, layer_name_, fields_);
         }
         catch (std::exception const& ex)
         {
@@ -520,16 +703,18 @@ struct AsyncQueryMany : Napi::AsyncWorker
     }
     std::vector<napi_value> GetResult(Napi::Env env) override
     {
-        Napi::Object obj = _queryManyResultToV8(env, result_);
+        Napi::Object obj = columnar_ ? _queryManyResultToColumns(env, result_) : _queryManyResultToV8(env, result_);
         return {env.Undefined(), obj};
     }
 
   private:
     mapnik::vector_tile_impl::merc_tile_ptr tile_;
+    std::shared_ptr<node_mapnik::vector_tile_query_index> index_;
     std::vector<query_lonlat> query_;
     double tolerance_;
     std::string layer_name_;
     std::vector<std::string> fields_;
+    bool columnar_;
     queryMany_result result_;
 };
 
@@ -634,7 +819,7 @@ Napi::Value VectorTile::query(Napi::CallbackInfo const& info)
     {
         try
         {
-            std::vector<query_result> result = detail::_query(tile_, lon, lat, tolerance, layer_name);
+            std::vector<query_result> result = detail::_query(tile_, *query_index_, lon, lat, tolerance, layer_name);
             Napi::Array arr = detail::_queryResultToV8(env, result);
             return arr; // Escape ? FIXME
         }
@@ -647,12 +832,138 @@ Napi::Value VectorTile::query(Napi::CallbackInfo const& info)
     else
     {
         Napi::Value callback = info[info.Length() - 1];
-        auto* worker = new detail::AsyncQuery(tile_, lon, lat, tolerance, layer_name, callback.As<Napi::Function>());
+        auto* worker = new detail::AsyncQuery(tile_, query_index_, lon, lat, tolerance, layer_name, callback.As<Napi::Function>());
         worker->Queue();
     }
     return env.Undefined();
 }
 
+/**
+ * Query several vector tiles by longitude and latitude at once, typically the
+ * neighbours of a tile around a point near its edges. The tiles are queried in
+ * parallel, a feature found in more than one tile is only returned once, with
+ * its closest hit, and the results are sorted by distance across all tiles.
+ * Features are matched by their layer name and encoded id: those without an
+ * id, or whose id is shared by other features of the same tile, are returned
+ * for every tile they are found in.
+ *
+ * @memberof VectorTile
+ * @static
+ * @name queryTiles
+ * @param {Array<mapnik.VectorTile>} tiles
+ * @param {number} longitude - longitude
+ * @param {number} latitude - latitude
+ * @param {Object} [options]
+ * @param {number} [options.tolerance=0] include features a specific distance from the
+ * lon/lat query in the response. Read more about tolerance at {@link VectorTile#query}.
+ * @param {string} [options.layer] restrict the query to a single layer
+ * @param {number} [options.threading_mode=mapnik.threadingMode.async] how the tiles are
+ * queried, `mapnik.threadingMode.deferred` queries them one after the other
+ * @param {Function} [callback] - `function(err, features)`
+ * @returns {Array<mapnik.Feature>} an array of {@link mapnik.Feature} objects, as
+ * returned by {@link VectorTile#query}
+ * @example
+ * mapnik.VectorTile.queryTiles([vt1, vt2, vt3, vt4], 139.61, 37.17, {tolerance: 100}, function(err, features) {
+ *   if (err) throw err;
+ *   console.log(features[0].layer, features[0].distance);
+ * });
+ */
+Napi::Value VectorTile::queryTiles(Napi::CallbackInfo const& info)
+{
+    Napi::Env env = info.Env();
+    if (info.Length() < 3 || !info[0].IsArray() || !info[1].IsNumber() || !info[2].IsNumber())
+    {
+        Napi::Error::New(env, "expects an array of VectorTile objects, lon and lat").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    std::vector<detail::query_tile> tiles;
+    Napi::Array tiles_array = info[0].As<Napi::Array>();
+    std::uint32_t num_tiles = tiles_array.Length();
+    tiles.reserve(num_tiles);
+    for (std::uint32_t i = 0; i < num_tiles; ++i)
+    {
+        Napi::Value val = tiles_array.Get(i);
+        if (!val.IsObject() || !val.As<Napi::Object>().InstanceOf(VectorTile::constructor.Value()))
+        {
+            Napi::TypeError::New(env, "must provide an array of VectorTile objects").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        VectorTile* vt = Napi::ObjectWrap<VectorTile>::Unwrap(val.As<Napi::Object>());
+        tiles.push_back({vt->tile_, vt->query_index_});
+    }
+    double tolerance = 0.0; // meters
+    std::string layer_name("");
+    std::launch threading_mode = std::launch::async;
+    if (info.Length() > 3 && !info[3].IsFunction())
+    {
+        if (!info[3].IsObject())
+        {
+            Napi::TypeError::New(env, "optional fourth argument must be an options object").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        Napi::Object options = info[3].As<Napi::Object>();
+        if (options.Has("tolerance"))
+        {
+            Napi::Value tol = options.Get("tolerance");
+            if (!tol.IsNumber())
+            {
+                Napi::TypeError::New(env, "tolerance value must be a number").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            tolerance = tol.As<Napi::Number>().DoubleValue();
+        }
+        if (options.Has("layer"))
+        {
+            Napi::Value layer_id = options.Get("layer");
+            if (!layer_id.IsString())
+            {
+                Napi::TypeError::New(env, "layer value must be a string").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            layer_name = layer_id.As<Napi::String>();
+        }
+        if (options.Has("threading_mode"))
+        {
+            Napi::Value param_val = options.Get("threading_mode");
+            if (!param_val.IsNumber())
+            {
+                Napi::TypeError::New(env, "option 'threading_mode' must be an unsigned integer").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            threading_mode = static_cast<std::launch>(param_val.As<Napi::Number>().Int32Value());
+            if (threading_mode != std::launch::async &&
+                threading_mode != std::launch::deferred &&
+                threading_mode != (std::launch::async | std::launch::deferred))
+            {
+                Napi::TypeError::New(env, "optional arg 'threading_mode' is invalid").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+        }
+    }
+
+    double lon = info[1].As<Napi::Number>().DoubleValue();
+    double lat = info[2].As<Napi::Number>().DoubleValue();
+
+    // If last argument is not a function go with sync call.
+    if (!info[info.Length() - 1].IsFunction())
+    {
+        try
+        {
+            std::vector<query_result> result = detail::_queryTiles(tiles, lon, lat, tolerance, layer_name, threading_mode);
+            return detail::_queryResultToV8(env, result);
+        }
+        catch (std::exception const& ex)
+        {
+            Napi::Error::New(env, ex.what()).ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+    }
+    Napi::Value callback = info[info.Length() - 1];
+    auto* worker = new detail::AsyncQueryTiles(tiles, lon, lat, tolerance, layer_name, threading_mode, callback.As<Napi::Function>());
+    worker->Queue();
+    return env.Undefined();
+}
+
 /**
  * Query a vector tile by multiple sets of latitude/longitude pairs.
  * Just like <mapnik.VectorTile.query> but with more points to search.
@@ -666,6 +977,8 @@ Napi::Value VectorTile::query(Napi::CallbackInfo const& info)
  * lon/lat query in the response. Read more about tolerance at {@link VectorTile#query}.
  * @param {string} options.layer - layer name
  * @param {Array<string>} [options.fields] - array of field names
+ * @param {boolean} [options.columnar=false] - return the results as typed arrays
+ * instead of one object per hit and per feature, see below
  * @param {Function} [callback] - `function(err, results)`
  * @returns {Object} The response has contains two main objects: `hits` and `features`.
  * The number of hits returned will correspond to the number of lon/lats queried and will
@@ -674,6 +987,12 @@ Napi::Value VectorTile::query(Napi::CallbackInfo const& info)
  * The `feature_id` is the corresponding object in features object.
  *
  * The values for the query is contained in the features object. Use attributes() to extract a value.
+ *
+ * With `columnar: true` the response is `{hits: {point, feature, distance}, features: {id, layer, attributes}}`.
+ * `hits.point` and `hits.feature` are `Uint32Array`s and `hits.distance` a `Float64Array`, with one
+ * entry per hit, ordered by query point and then by distance. `features.id` is a `Float64Array`
+ * of feature ids indexed by `hits.feature`, and `features.attributes` holds one array per field,
+ * indexed the same way, with `null` where a feature has no value.
  * @example
  * vt.queryMany([[139.61, 37.17], [140.64, 38.1]], {tolerance: 0}, function(err, results) {
  *   if (err) throw err;
@@ -684,6 +1003,12 @@ Napi::Value VectorTile::query(Napi::CallbackInfo const& info)
  *     console.log(results.features[0].distance, features[0].x_hit, features[0].y_hit); // 0, 0, 0
  *   }
  * });
+ *
+ * var columns = vt.queryMany([[139.61, 37.17], [140.64, 38.1]], {layer: 'world', fields: ['NAME'], columnar: true});
+ * for (var i = 0; i < columns.hits.point.length; ++i) {
+ *   var f = columns.hits.feature[i];
+ *   console.log(columns.hits.point[i], columns.hits.distance[i], columns.features.attributes.NAME[f]);
+ * }
  */
 Napi::Value VectorTile::queryMany(Napi::CallbackInfo const& info)
 {
@@ -699,6 +1024,7 @@ Napi::Value VectorTile::queryMany(Napi::CallbackInfo const& info)
     double tolerance = 0.0; // meters
     std::string layer_name("");
     std::vector<std::string> fields;
+    bool columnar = false;
     std::vector<query_lonlat> query;
 
     // Convert v8 queryArray to a std vector
@@ -779,6 +1105,16 @@ Napi::Value VectorTile::queryMany(Napi::CallbackInfo const& info)
                 ++i;
             }
         }
+        if (options.Has("columnar"))
+        {
+            Napi::Value param_val = options.Get("columnar");
+            if (!param_val.IsBoolean())
+            {
+                Napi::TypeError::New(env, "option 'columnar' must be a boolean").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            columnar = param_val.As<Napi::Boolean>();
+        }
     }
 
     if (layer_name.empty())
@@ -793,8 +1129,8 @@ Napi::Value VectorTile::queryMany(Napi::CallbackInfo const& info)
         try
         {
             queryMany_result result;
-            detail::_queryMany(result, tile_, query, tolerance, layer_name, fields);
-            Napi::Object result_obj = detail::_queryManyResultToV8(env, result);
+            detail::_queryMany(result, tile_, *query_index_, query, tolerance, layer_name, fields);
+            Napi::Object result_obj = columnar ? detail::_queryManyResultToColumns(env, result) : detail::_queryManyResultToV8(env, result);
             return scope.Escape(result_obj);
         }
         catch (std::exception const& ex)
@@ -806,9 +1142,33 @@ Napi::Value VectorTile::queryMany(Napi::CallbackInfo const& info)
     else
     {
         Napi::Value callback = info[info.Length() - 1];
-        auto* worker = new detail::AsyncQueryMany(tile_, query, tolerance, layer_name,
-                                                  fields, callback.As<Napi::Function>());
+        auto* worker = new detail::AsyncQueryMany(tile_, query_index_, query, tolerance, layer_name,
+                                                  fields, columnar, callback.As<Napi::Function>());
         worker->Queue();
         return env.Undefined();
     }
 }
+
+/**
+ * Count of the features {@link VectorTile#query} and {@link VectorTile#queryMany}
+ * decoded, and of those they skipped without decoding because the bounding box
+ * of their encoded geometry was too far from the queried points. The counts
+ * are process-wide and cumulative.
+ *
+ * @name queryStats
+ * @memberof VectorTile
+ * @static
+ * @returns {Object} `{featuresDecoded, featuresSkipped}`
+ * @example
+ * var stats = mapnik.VectorTile.queryStats();
+ * console.log(stats.featuresSkipped / (stats.featuresDecoded + stats.featuresSkipped));
+ */
+Napi::Value VectorTile::queryStats(Napi::CallbackInfo const& info)
+{
+    Napi::Env env = info.Env();
+    auto const& stats = node_mapnik::vector_tile_query_stats();
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("featuresDecoded", Napi::Number::New(env, static_cast<double>(stats.features_decoded.load())));
+    result.Set("featuresSkipped", Napi::Number::New(env, static_cast<double>(stats.features_skipped.load())));
+    return result;
+}
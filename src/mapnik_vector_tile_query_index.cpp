@@ -0,0 +1,455 @@
+#include "mapnik_vector_tile_query_index.hpp"
+
+// protozero
+#include <protozero/pbf_reader.hpp>
+#include <protozero/varint.hpp>
+
+// stl
+#include <algorithm>
+#include <limits>
+
+namespace node_mapnik {
+
+namespace {
+
+// Field numbers of the vector tile spec.
+enum : protozero::pbf_tag_type
+{
+    layer_name = 1,
+    layer_features = 2,
+    layer_keys = 3,
+    layer_values = 4,
+    layer_extent = 5,
+    layer_version = 15,
+    feature_id = 1,
+    feature_type = 3,
+    feature_geometry = 4
+};
+
+enum : std::uint32_t
+{
+    geom_point = 1,
+    geom_linestring = 2,
+    geom_polygon = 3,
+    cmd_move_to = 1,
+    cmd_line_to = 2,
+    cmd_close_path = 7
+};
+
+void append_varint(std::string& out, std::uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+void append_key(std::string& out, protozero::pbf_tag_type tag, protozero::pbf_wire_type type)
+{
+    append_varint(out, (static_cast<std::uint64_t>(tag) << 3) | static_cast<std::uint64_t>(type));
+}
+
+void append_bytes(std::string& out, protozero::pbf_tag_type tag, char const* data, std::size_t size)
+{
+    append_key(out, tag, protozero::pbf_wire_type::length_delimited);
+    append_varint(out, size);
+    out.append(data, size);
+}
+
+std::int32_t clamp(std::int64_t value)
+{
+    return static_cast<std::int32_t>(std::max<std::int64_t>(std::numeric_limits<std::int32_t>::min(),
+                                                            std::min<std::int64_t>(std::numeric_limits<std::int32_t>::max(), value)));
+}
+
+// From https://github.com/mourner/flatbush, maps a point on a 2^16 grid to
+// its position along a Hilbert curve.
+std::uint32_t hilbert(std::uint32_t x, std::uint32_t y)
+{
+    std::uint32_t a = x ^ y;
+    std::uint32_t b = 0xFFFF ^ a;
+    std::uint32_t c = 0xFFFF ^ (x | y);
+    std::uint32_t d = x & (y ^ 0xFFFF);
+
+    std::uint32_t A = a | (b >> 1);
+    std::uint32_t B = (a >> 1) ^ a;
+    std::uint32_t C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+    std::uint32_t D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+    a = A;
+    b = B;
+    c = C;
+    d = D;
+    A = ((a & (a >> 2)) ^ (b & (b >> 2)));
+    B = ((a & (b >> 2)) ^ (b & ((a ^ b) >> 2)));
+    C ^= ((a & (c >> 2)) ^ (b & (d >> 2)));
+    D ^= ((b & (c >> 2)) ^ ((a ^ b) & (d >> 2)));
+
+    a = A;
+    b = B;
+    c = C;
+    d = D;
+    A = ((a & (a >> 4)) ^ (b & (b >> 4)));
+    B = ((a & (b >> 4)) ^ (b & ((a ^ b) >> 4)));
+    C ^= ((a & (c >> 4)) ^ (b & (d >> 4)));
+    D ^= ((b & (c >> 4)) ^ ((a ^ b) & (d >> 4)));
+
+    a = A;
+    b = B;
+    c = C;
+    d = D;
+    C ^= ((a & (c >> 8)) ^ (b & (d >> 8)));
+    D ^= ((b & (c >> 8)) ^ ((a ^ b) & (d >> 8)));
+
+    a = C ^ (C >> 1);
+    b = D ^ (D >> 1);
+
+    std::uint32_t i0 = x ^ y;
+    std::uint32_t i1 = b | (0xFFFF ^ (i0 | a));
+
+    i0 = (i0 | (i0 << 8)) & 0x00FF00FF;
+    i0 = (i0 | (i0 << 4)) & 0x0F0F0F0F;
+    i0 = (i0 | (i0 << 2)) & 0x33333333;
+    i0 = (i0 | (i0 << 1)) & 0x55555555;
+
+    i1 = (i1 | (i1 << 8)) & 0x00FF00FF;
+    i1 = (i1 | (i1 << 4)) & 0x0F0F0F0F;
+    i1 = (i1 | (i1 << 2)) & 0x33333333;
+    i1 = (i1 | (i1 << 1)) & 0x55555555;
+
+    return (i1 << 1) | i0;
+}
+
+} // namespace
+
+bool encoded_geometry_bbox(std::uint32_t type, protozero::data_view const& geometry, tile_box& bbox)
+{
+    using iterator = protozero::const_varint_iterator<std::uint32_t>;
+    char const* end_data = geometry.data() + geometry.size();
+    iterator it(geometry.data(), end_data);
+    iterator end(end_data, end_data);
+    std::int64_t x = 0;
+    std::int64_t y = 0;
+    bool empty = true;
+    bbox = {std::numeric_limits<std::int32_t>::max(), std::numeric_limits<std::int32_t>::max(),
+            std::numeric_limits<std::int32_t>::min(), std::numeric_limits<std::int32_t>::min()};
+    auto command = [&](std::uint32_t& id, std::uint32_t& count) {
+        if (it == end) return false;
+        id = *it & 0x7;
+        count = *it >> 3;
+        ++it;
+        return true;
+    };
+    auto point = [&]() {
+        if (it == end) return false;
+        std::uint32_t dx = *it++;
+        if (it == end) return false;
+        std::uint32_t dy = *it++;
+        x += protozero::decode_zigzag32(dx);
+        y += protozero::decode_zigzag32(dy);
+        bbox.minx = std::min(bbox.minx, clamp(x));
+        bbox.miny = std::min(bbox.miny, clamp(y));
+        bbox.maxx = std::max(bbox.maxx, clamp(x));
+        bbox.maxy = std::max(bbox.maxy, clamp(y));
+        return true;
+    };
+    while (it != end)
+    {
+        std::uint32_t id = 0;
+        std::uint32_t count = 0;
+        if (!command(id, count) || id != cmd_move_to || count == 0) return false;
+        if (type == geom_point)
+        {
+            if (!empty) return false;
+            for (; count > 0; --count)
+            {
+                if (!point()) return false;
+            }
+        }
+        else if (type == geom_linestring || type == geom_polygon)
+        {
+            if (count != 1 || !point()) return false;
+            if (!command(id, count) || id != cmd_line_to || count == 0) return false;
+            for (; count > 0; --count)
+            {
+                if (!point()) return false;
+            }
+            if (type == geom_polygon && (!command(id, count) || id != cmd_close_path || count != 1)) return false;
+        }
+        else
+        {
+            return false;
+        }
+        empty = false;
+    }
+    return !empty;
+}
+
+query_stats& vector_tile_query_stats()
+{
+    static query_stats stats;
+    return stats;
+}
+
+layer_query_index::layer_query_index(protozero::data_view const& layer)
+{
+    std::vector<std::pair<box, std::uint32_t>> leaves;
+    std::uint64_t position = 0;
+    protozero::pbf_reader layer_msg(layer);
+    // Start of the field being read, within the layer
+    auto offset = [&]() {
+        return static_cast<std::size_t>(layer_msg.data().data() - layer.data());
+    };
+    std::size_t field_start = offset();
+    auto add_header_field = [&]() {
+        std::size_t field_end = offset();
+        if (!header_.empty() && header_.back().first + header_.back().second == field_start)
+        {
+            header_.back().second += field_end - field_start;
+        }
+        else
+        {
+            header_.emplace_back(field_start, field_end - field_start);
+        }
+    };
+    for (; layer_msg.next(); field_start = offset())
+    {
+        switch (layer_msg.tag())
+        {
+        case layer_name:
+        case layer_keys:
+        case layer_values:
+            layer_msg.get_view();
+            add_header_field();
+            break;
+        case layer_extent:
+            extent_ = layer_msg.get_uint32();
+            add_header_field();
+            break;
+        case layer_version:
+            layer_msg.get_uint32();
+            add_header_field();
+            break;
+        case layer_features:
+        {
+            auto view = layer_msg.get_view();
+            ++position;
+            bool has_id = false;
+            std::uint64_t id = position;
+            std::uint32_t type = 0;
+            protozero::data_view geometry;
+            bool has_geometry = false;
+            protozero::pbf_reader feature_msg(view);
+            while (feature_msg.next())
+            {
+                if (feature_msg.tag() == feature_id && feature_msg.wire_type() == protozero::pbf_wire_type::varint)
+                {
+                    has_id = true;
+                    id = feature_msg.get_uint64();
+                }
+                else if (feature_msg.tag() == feature_id)
+                {
+                    has_id = true;
+                    feature_msg.skip();
+                }
+                else if (feature_msg.tag() == feature_type && feature_msg.wire_type() == protozero::pbf_wire_type::varint)
+                {
+                    type = feature_msg.get_uint32();
+                }
+                else if (feature_msg.tag() == feature_geometry && feature_msg.wire_type() == protozero::pbf_wire_type::length_delimited)
+                {
+                    geometry = feature_msg.get_view();
+                    has_geometry = true;
+                }
+                else
+                {
+                    feature_msg.skip();
+                }
+            }
+            auto record = static_cast<std::uint32_t>(features_.size());
+            box bbox;
+            if (has_geometry && encoded_geometry_bbox(type, geometry, bbox))
+            {
+                leaves.emplace_back(bbox, record);
+            }
+            else
+            {
+                // Let the decoder deal with anything unusual, as it would
+                // without an index, including throwing on bad geometries.
+                unindexed_.push_back(record);
+            }
+            features_.emplace_back(static_cast<std::size_t>(view.data() - layer.data()), view.size());
+            ids_.push_back(id);
+            encoded_ids_.push_back(has_id);
+            break;
+        }
+        default:
+            layer_msg.skip();
+            break;
+        }
+    }
+    build(leaves);
+}
+
+void layer_query_index::build(std::vector<std::pair<box, std::uint32_t>> const& leaves)
+{
+    std::size_t num_leaves = leaves.size();
+    if (num_leaves == 0) return;
+
+    box total = leaves.front().first;
+    for (auto const& leaf : leaves)
+    {
+        box const& b = leaf.first;
+        total.minx = std::min(total.minx, b.minx);
+        total.miny = std::min(total.miny, b.miny);
+        total.maxx = std::max(total.maxx, b.maxx);
+        total.maxy = std::max(total.maxy, b.maxy);
+    }
+    double width = std::max(1.0, static_cast<double>(total.maxx) - total.minx);
+    double height = std::max(1.0, static_cast<double>(total.maxy) - total.miny);
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> order;
+    order.reserve(num_leaves);
+    for (std::size_t i = 0; i < num_leaves; ++i)
+    {
+        box const& b = leaves[i].first;
+        double cx = (static_cast<double>(b.minx) + b.maxx) / 2 - total.minx;
+        double cy = (static_cast<double>(b.miny) + b.maxy) / 2 - total.miny;
+        order.emplace_back(hilbert(static_cast<std::uint32_t>(0xFFFF * cx / width),
+                                   static_cast<std::uint32_t>(0xFFFF * cy / height)),
+                           static_cast<std::uint32_t>(i));
+    }
+    std::sort(order.begin(), order.end());
+
+    boxes_.reserve(num_leaves + num_leaves / (node_size - 1) + 1);
+    indices_.reserve(boxes_.capacity());
+    for (auto const& item : order)
+    {
+        boxes_.push_back(leaves[item.second].first);
+        indices_.push_back(leaves[item.second].second);
+    }
+    level_ends_.push_back(num_leaves);
+
+    // Always add at least one level of parents, so the root is a parent.
+    std::size_t level_start = 0;
+    do
+    {
+        std::size_t level_end = boxes_.size();
+        for (std::size_t i = level_start; i < level_end; i += node_size)
+        {
+            box parent = boxes_[i];
+            std::size_t end = std::min(i + node_size, level_end);
+            for (std::size_t j = i + 1; j < end; ++j)
+            {
+                parent.minx = std::min(parent.minx, boxes_[j].minx);
+                parent.miny = std::min(parent.miny, boxes_[j].miny);
+                parent.maxx = std::max(parent.maxx, boxes_[j].maxx);
+                parent.maxy = std::max(parent.maxy, boxes_[j].maxy);
+            }
+            boxes_.push_back(parent);
+            indices_.push_back(static_cast<std::uint32_t>(i));
+        }
+        level_start = level_end;
+        level_ends_.push_back(boxes_.size());
+    } while (boxes_.size() - level_start > 1);
+}
+
+void layer_query_index::query(double minx, double miny, double maxx, double maxy, std::vector<std::uint32_t>& result) const
+{
+    std::size_t first = result.size();
+    result.insert(result.end(), unindexed_.begin(), unindexed_.end());
+    if (boxes_.empty()) return;
+    std::size_t num_leaves = level_ends_.front();
+    std::vector<std::size_t> stack;
+    stack.push_back(boxes_.size() - 1);
+    while (!stack.empty())
+    {
+        std::size_t node = stack.back();
+        stack.pop_back();
+        std::size_t start = indices_[node];
+        std::size_t end = std::min(start + node_size, *std::upper_bound(level_ends_.begin(), level_ends_.end(), start));
+        for (std::size_t child = start; child < end; ++child)
+        {
+            box const& b = boxes_[child];
+            if (b.maxx < minx || b.minx > maxx || b.maxy < miny || b.miny > maxy) continue;
+            if (child < num_leaves)
+            {
+                result.push_back(indices_[child]);
+            }
+            else
+            {
+                stack.push_back(child);
+            }
+        }
+    }
+    std::sort(result.begin() + static_cast<std::ptrdiff_t>(first), result.end());
+}
+
+std::string layer_query_index::subset(protozero::data_view const& layer, std::vector<std::uint32_t> const& features) const
+{
+    std::string result;
+    for (auto const& range : header_)
+    {
+        result.append(layer.data() + range.first, range.second);
+    }
+    for (std::uint32_t record : features)
+    {
+        char const* data = layer.data() + features_[record].first;
+        std::size_t size = features_[record].second;
+        if (encoded_ids_[record])
+        {
+            append_bytes(result, layer_features, data, size);
+        }
+        else
+        {
+            // mapnik-vector-tile numbers features without an id by their
+            // position in the layer, starting at 1. The position is lost in a
+            // subset, so such features get it as an explicit id.
+            std::string id_field;
+            append_key(id_field, feature_id, protozero::pbf_wire_type::varint);
+            append_varint(id_field, ids_[record]);
+            append_key(result, layer_features, protozero::pbf_wire_type::length_delimited);
+            append_varint(result, id_field.size() + size);
+            result += id_field;
+            result.append(data, size);
+        }
+    }
+    return result;
+}
+
+std::shared_ptr<layer_query_index const> vector_tile_query_index::get(protozero::data_view const& tile, protozero::data_view const& layer)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tile.data() != tile_data_ || tile.size() != tile_size_)
+        {
+            layers_.clear();
+            tile_data_ = tile.data();
+            tile_size_ = tile.size();
+        }
+        auto itr = layers_.find(layer.data());
+        if (itr != layers_.end() && itr->second.first == layer.size())
+        {
+            return itr->second.second;
+        }
+    }
+    // Concurrent queries may both build the index of a layer, the last one wins.
+    auto index = std::make_shared<layer_query_index const>(layer);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (tile.data() == tile_data_ && tile.size() == tile_size_)
+    {
+        layers_[layer.data()] = std::make_pair(layer.size(), index);
+    }
+    return index;
+}
+
+void vector_tile_query_index::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    layers_.clear();
+    tile_data_ = nullptr;
+    tile_size_ = 0;
+}
+
+} // namespace node_mapnik
@@ -0,0 +1,112 @@
+#pragma once
+
+// protozero
+#include <protozero/data_view.hpp>
+
+// stl
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace node_mapnik {
+
+// Bounding box in tile coordinates.
+struct tile_box
+{
+    std::int32_t minx;
+    std::int32_t miny;
+    std::int32_t maxx;
+    std::int32_t maxy;
+};
+
+// Computes the bbox of the encoded geometry of a feature of the given type,
+// straight from its commands and without allocating. Returns false unless the
+// commands follow the sequence the spec prescribes for the type.
+bool encoded_geometry_bbox(std::uint32_t type, protozero::data_view const& geometry, tile_box& bbox);
+
+// Process-wide counts of the features the query paths decoded, and of those
+// they skipped because their bbox ruled them out.
+struct query_stats
+{
+    std::atomic<std::uint64_t> features_decoded{0};
+    std::atomic<std::uint64_t> features_skipped{0};
+};
+
+query_stats& vector_tile_query_stats();
+
+// Packed Hilbert R-tree over the bounding boxes of the features of one layer,
+// in tile coordinates. The boxes are read from the encoded geometries without
+// decoding them, so that VectorTile.query only has to decode the features
+// that can be near the queried point. Features whose geometry can't be read
+// that way are returned by every query.
+class layer_query_index
+{
+  public:
+    explicit layer_query_index(protozero::data_view const& layer);
+
+    // Number of tile units across the tile.
+    std::uint32_t extent() const { return extent_; }
+
+    // Number of features in the layer.
+    std::size_t size() const { return features_.size(); }
+
+    // Appends the features whose bbox intersects the box, and the unindexed
+    // ones, to `result` in layer order.
+    void query(double minx, double miny, double maxx, double maxy, std::vector<std::uint32_t>& result) const;
+
+    // Encodes a copy of the layer that only holds the given features. `layer`
+    // must be the message the index was built from.
+    std::string subset(protozero::data_view const& layer, std::vector<std::uint32_t> const& features) const;
+
+    // Id of a feature as mapnik-vector-tile decodes it: the encoded id, or
+    // the position of the feature in the layer when it has none.
+    std::uint64_t id(std::uint32_t record) const { return ids_[record]; }
+    bool has_encoded_id(std::uint32_t record) const { return encoded_ids_[record]; }
+
+  private:
+    using box = tile_box;
+
+    static constexpr std::size_t node_size = 16;
+
+    void build(std::vector<std::pair<box, std::uint32_t>> const& leaves);
+
+    std::uint32_t extent_ = 4096;
+    // Offset and size within the layer of the runs of fields that are not
+    // features, and of the message of each feature. The index is only used
+    // with the layer it was built from, see vector_tile_query_index.
+    std::vector<std::pair<std::size_t, std::size_t>> header_;
+    std::vector<std::pair<std::size_t, std::size_t>> features_;
+    std::vector<std::uint64_t> ids_;
+    std::vector<bool> encoded_ids_;
+    std::vector<std::uint32_t> unindexed_;
+    // Leaves first, then each level of parents up to the root.
+    std::vector<box> boxes_;
+    // Record of a leaf, or position of the first child of a parent.
+    std::vector<std::uint32_t> indices_;
+    std::vector<std::size_t> level_ends_;
+};
+
+// The indexes of the layers of one VectorTile, built on first use. A layer is
+// identified by the address and size of its encoded message within the tile
+// buffer. Any change to the address or size of the buffer drops all indexes,
+// but a buffer can be refilled in place, so replacing or clearing the tile
+// data must also call clear().
+class vector_tile_query_index
+{
+  public:
+    std::shared_ptr<layer_query_index const> get(protozero::data_view const& tile, protozero::data_view const& layer);
+    void clear();
+
+  private:
+    std::mutex mutex_;
+    char const* tile_data_ = nullptr;
+    std::size_t tile_size_ = 0;
+    std::unordered_map<char const*, std::pair<std::size_t, std::shared_ptr<layer_query_index const>>> layers_;
+};
+
+} // namespace node_mapnik
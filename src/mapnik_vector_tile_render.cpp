@@ -32,6 +32,7 @@
 #include "vector_tile_geometry_decoder.hpp"
 #include "vector_tile_load_tile.hpp"
 #include "object_to_container.hpp"
+#include "projection_cache.hpp"
 
 namespace {
 
@@ -172,11 +173,11 @@ struct AsyncRenderTile : Napi::AsyncWorker
             }
             mapnik::request m_req(width_, height_, map_extent);
             m_req.set_buffer_size(buffer_size_);
-            mapnik::projection map_proj(map->srs(), true);
+            auto map_proj = node_mapnik::acquire_projection(map->srs());
             double scale_denom = scale_denominator_;
             if (scale_denom <= 0.0)
             {
-                scale_denom = mapnik::scale_denominator(m_req.scale(), map_proj.is_geographic());
+                scale_denom = mapnik::scale_denominator(m_req.scale(), map_proj->is_geographic());
             }
             scale_denom *= scale_factor_;
             std::vector<mapnik::layer> const& layers = map->layers();
@@ -226,7 +227,7 @@ struct AsyncRenderTile : Napi::AsyncWorker
                         lyr_copy.set_datasource(ds);
                         ren.apply_to_layer(lyr_copy,
                                            ren,
-                                           map_proj,
+                                           *map_proj,
                                            m_req.scale(),
                                            scale_denom,
                                            m_req.width(),
@@ -259,7 +260,7 @@ struct AsyncRenderTile : Napi::AsyncWorker
                                                                   variables_,
                                                                   c_context, scale_factor_);
                     ren.start_map_processing(*map);
-                    process_layers(ren, m_req, map_proj, layers, scale_denom, map->srs(), tile_);
+                    process_layers(ren, m_req, *map_proj, layers, scale_denom, map->srs(), tile_);
                     ren.end_map_processing(*map);
 #else
                     SetError("no support for rendering svg with cairo backend");
@@ -274,7 +275,7 @@ struct AsyncRenderTile : Napi::AsyncWorker
                                 variables_,
                                 output_stream_iterator, scale_factor_);
                     ren.start_map_processing(*map);
-                    process_layers(ren, m_req, map_proj, layers, scale_denom, map->srs(), tile_);
+                    process_layers(ren, m_req, *map_proj, layers, scale_denom, map->srs(), tile_);
                     ren.end_map_processing(*map);
 #else
                     SetError("no support for rendering svg with native svg backend (-DSVG_RENDERER)");
@@ -293,7 +294,7 @@ struct AsyncRenderTile : Napi::AsyncWorker
                                                                   variables_,
                                                                   im_data, scale_factor_);
                     ren.start_map_processing(*map);
-                    process_layers(ren, m_req, map_proj, layers, scale_denom, map->srs(), tile_);
+                    process_layers(ren, m_req, *map_proj, layers, scale_denom, map->srs(), tile_);
                     ren.end_map_processing(*map);
                 }
                 else
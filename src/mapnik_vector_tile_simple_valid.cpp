@@ -9,9 +9,7 @@
 #include <mapnik/feature_kv_iterator.hpp>
 #include <mapnik/geometry/is_simple.hpp>
 #include <mapnik/geometry/is_valid.hpp>
-#include <mapnik/geometry/reprojection.hpp>
 #include <mapnik/util/feature_to_geojson.hpp>
-#include <mapnik/projection.hpp>
 // mapnik-vector-tile
 #include "mapnik_vector_tile.hpp"
 #include "vector_tile_compression.hpp"
@@ -22,6 +20,7 @@
 #include "vector_tile_geometry_decoder.hpp"
 #include "vector_tile_load_tile.hpp"
 #include "object_to_container.hpp"
+#include "projection_cache.hpp"
 
 namespace {
 
@@ -371,13 +370,11 @@ void layer_not_valid(protozero::pbf_reader& layer_msg,
             {
                 if (lat_lon)
                 {
-                    mapnik::projection wgs84("epsg:4326", true);
-                    mapnik::projection merc("epsg:3857", true);
-                    mapnik::proj_transform prj_trans(merc, wgs84);
-                    unsigned int n_err = 0;
+                    mapnik::geometry::geometry<double> geom = feature->get_geometry();
+                    node_mapnik::merc_to_lonlat(geom);
                     mapnik::util::apply_visitor(
                         visitor_geom_valid(errors, feature, ds.get_name(), split_multi_features),
-                        mapnik::geometry::reproject_copy(feature->get_geometry(), prj_trans, n_err));
+                        geom);
                 }
                 else
                 {
@@ -0,0 +1,351 @@
+#include "mercator.hpp"
+
+// mapnik
+#include <mapnik/well_known_srs.hpp>
+
+// stl
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__aarch64__)) && (defined(__GNUC__) || defined(__clang__))
+#define NODE_MAPNIK_MERCATOR_SIMD 1
+#endif
+
+namespace node_mapnik {
+
+void merc_to_lonlat_scalar(double* coords, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        double& x = coords[2 * i];
+        double& y = coords[2 * i + 1];
+        double tx = x;
+        double ty = y;
+        mapnik::merc2lonlat(tx, ty);
+        if (!std::isnan(x)) x = tx;
+        if (!std::isnan(y)) y = ty;
+    }
+}
+
+namespace {
+
+using mercator_fn = void (*)(double*, std::size_t);
+
+struct mercator_kernels
+{
+    mercator_fn forward;
+    mercator_fn inverse;
+    char const* name;
+};
+
+void lonlat_to_merc_scalar(double* coords, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        double& x = coords[2 * i];
+        double& y = coords[2 * i + 1];
+        double tx = x;
+        double ty = y;
+        mapnik::lonlat2merc(tx, ty);
+        if (!std::isnan(x)) x = tx;
+        if (!std::isnan(y)) y = ty;
+    }
+}
+
+#if defined(NODE_MAPNIK_MERCATOR_SIMD)
+
+// The vector kernels are written once with GCC/clang vector extensions, which
+// compile to NEON on arm64 and to AVX2 in the functions targeting it. There are
+// no vector transcendental functions to call, so sin/cos, exp, log and atan are
+// evaluated by range reduction and Taylor series, with enough terms to be
+// accurate to the last bit or two over the reduced ranges:
+//
+//   y   = R * log((1 + sin(lat)) / cos(lat))
+//   lat = 2 * atan(tanh(y / 2R)) = pi/2 - 2 * atan(exp(-y / R))
+
+#define NODE_MAPNIK_MERCATOR_INLINE inline __attribute__((always_inline))
+
+#if defined(__GNUC__) && !defined(__clang__)
+// the 32 byte vectors only cross function boundaries within AVX2 functions
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+typedef double v2d __attribute__((vector_size(16)));
+typedef std::int64_t v2i __attribute__((vector_size(16)));
+typedef double v4d __attribute__((vector_size(32)));
+typedef std::int64_t v4i __attribute__((vector_size(32)));
+
+template <typename VD>
+struct int_vector;
+template <>
+struct int_vector<v2d>
+{
+    using type = v2i;
+};
+template <>
+struct int_vector<v4d>
+{
+    using type = v4i;
+};
+
+constexpr double earth_radius = 6378137.0;
+constexpr double max_extent = 20037508.342789244; // earth_radius * pi
+constexpr double max_latitude = 85.051128779806604;
+constexpr double pi = 3.141592653589793;
+constexpr double pi_by_2_hi = 1.5707963267948966;
+constexpr double pi_by_2_lo = 6.123233995736766e-17;
+constexpr double pi_by_4 = 0.78539816339744831;
+constexpr double tan_pi_by_8 = 0.41421356237309503;
+constexpr double d2r = pi / 180.0;
+constexpr double r2d = 180.0 / pi;
+constexpr double ln2_hi = 6.93147180369123816490e-01;
+constexpr double ln2_lo = 1.90821492927058770002e-10;
+constexpr double log2e = 1.4426950408889634;
+constexpr double sqrt2 = 1.4142135623730951;
+// adding 1.5 * 2^52 rounds a small double to an integer held in the low bits
+constexpr double round_magic = 6755399441055744.0;
+constexpr std::int64_t sign_bit = std::numeric_limits<std::int64_t>::min();
+
+// sin(r) = r + r * r^2 * P(r^2), |r| <= pi/4
+constexpr double sin_coeffs[] = {
+    -1.0 / 6.0, 1.0 / 120.0, -1.0 / 5040.0, 1.0 / 362880.0, -1.0 / 39916800.0,
+    1.0 / 6227020800.0, -1.0 / 1307674368000.0, 1.0 / 355687428096000.0};
+// cos(r) = 1 + r^2 * P(r^2), |r| <= pi/4
+constexpr double cos_coeffs[] = {
+    -1.0 / 2.0, 1.0 / 24.0, -1.0 / 720.0, 1.0 / 40320.0, -1.0 / 3628800.0,
+    1.0 / 479001600.0, -1.0 / 87178291200.0, 1.0 / 20922789888000.0, -1.0 / 6402373705728000.0};
+// exp(r) = P(r), |r| <= log(2) / 2
+constexpr double exp_coeffs[] = {
+    1.0, 1.0, 1.0 / 2.0, 1.0 / 6.0, 1.0 / 24.0, 1.0 / 120.0, 1.0 / 720.0, 1.0 / 5040.0,
+    1.0 / 40320.0, 1.0 / 362880.0, 1.0 / 3628800.0, 1.0 / 39916800.0, 1.0 / 479001600.0,
+    1.0 / 6227020800.0};
+// log(m) = 2f + 2f * f^2 * P(f^2), f = (m - 1) / (m + 1), |f| <= 0.172
+constexpr double log_coeffs[] = {
+    1.0 / 3.0, 1.0 / 5.0, 1.0 / 7.0, 1.0 / 9.0, 1.0 / 11.0, 1.0 / 13.0, 1.0 / 15.0,
+    1.0 / 17.0, 1.0 / 19.0, 1.0 / 21.0};
+// atan(v) = v + v * v^2 * P(v^2), |v| <= tan(pi/8)
+constexpr double atan_coeffs[] = {
+    -1.0 / 3.0, 1.0 / 5.0, -1.0 / 7.0, 1.0 / 9.0, -1.0 / 11.0, 1.0 / 13.0, -1.0 / 15.0,
+    1.0 / 17.0, -1.0 / 19.0, 1.0 / 21.0, -1.0 / 23.0, 1.0 / 25.0, -1.0 / 27.0, 1.0 / 29.0,
+    -1.0 / 31.0, 1.0 / 33.0, -1.0 / 35.0, 1.0 / 37.0, -1.0 / 39.0};
+
+template <typename VD>
+NODE_MAPNIK_MERCATOR_INLINE VD splat(double value)
+{
+    return VD{} + value;
+}
+
+template <typename VD, typename Mask>
+NODE_MAPNIK_MERCATOR_INLINE VD select(Mask const& mask, VD const& a, VD const& b)
+{
+    using VI = typename int_vector<VD>::type;
+    VI const m = (VI)mask;
+    return (VD)((m & (VI)a) | (~m & (VI)b));
+}
+
+// NaN is kept, unlike with std::min/std::max
+template <typename VD>
+NODE_MAPNIK_MERCATOR_INLINE VD clamp(VD const& v, double lo, double hi)
+{
+    VD const vlo = splat<VD>(lo);
+    VD const vhi = splat<VD>(hi);
+    VD const above = select(v < vlo, vlo, v);
+    return select(above > vhi, vhi, above);
+}
+
+template <typename VD, std::size_t N>
+NODE_MAPNIK_MERCATOR_INLINE VD horner(VD const& x, double const (&coeffs)[N])
+{
+    VD r = splat<VD>(coeffs[N - 1]);
+    for (std::size_t i = N - 1; i-- > 0;)
+    {
+        r = r * x + coeffs[i];
+    }
+    return r;
+}
+
+// x > 0, NaN is kept
+template <typename VD>
+NODE_MAPNIK_MERCATOR_INLINE VD log(VD const& x)
+{
+    using VI = typename int_vector<VD>::type;
+    VI const bits = (VI)x;
+    VI exponent = (bits >> 52) - 1023;
+    VD m = (VD)((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+    auto const high = m > splat<VD>(sqrt2);
+    m = select(high, m * 0.5, m);
+    exponent -= (VI)high; // true is -1
+    VD const e = (VD)(exponent + (VI)splat<VD>(round_magic)) - round_magic;
+    VD const f = (m - 1.0) / (m + 1.0);
+    VD const f2 = f * f;
+    VD const r = e * ln2_hi + ((f + f) + (f + f) * f2 * horner(f2, log_coeffs) + e * ln2_lo);
+    return select(x != x, x, r);
+}
+
+// |t| <= pi
+template <typename VD>
+NODE_MAPNIK_MERCATOR_INLINE VD exp(VD const& t)
+{
+    using VI = typename int_vector<VD>::type;
+    VD const n_magic = t * log2e + round_magic;
+    VD const n = n_magic - round_magic;
+    VD const r = (t - n * ln2_hi) - n * ln2_lo;
+    VD const scale = (VD)(((VI)n_magic + 1023) << 52);
+    return horner(r, exp_coeffs) * scale;
+}
+
+// |v| <= tan(pi/8)
+template <typename VD>
+NODE_MAPNIK_MERCATOR_INLINE VD atan_reduced(VD const& v)
+{
+    VD const v2 = v * v;
+    return v + v * v2 * horner(v2, atan_coeffs);
+}
+
+template <typename VD>
+NODE_MAPNIK_MERCATOR_INLINE void lonlat_to_merc_lanes(VD& x, VD& y)
+{
+    x = clamp(x, -180.0, 180.0) * (max_extent / 180.0);
+    VD const lat = clamp(y, -max_latitude, max_latitude) * d2r;
+    // y is odd in lat, working on |lat| avoids the cancellation in 1 + sin(lat)
+    // south of the equator. Then reduce to |r| <= pi/4, swapping sin and cos
+    // above pi/4.
+    using VI = typename int_vector<VD>::type;
+    VI const sign = (VI)lat & sign_bit;
+    VD const a = (VD)((VI)lat ^ sign);
+    auto const high = a > splat<VD>(pi_by_4);
+    VD const r = select(high, (pi_by_2_hi - a) + pi_by_2_lo, a);
+    VD const r2 = r * r;
+    VD const sin_r = r + r * r2 * horner(r2, sin_coeffs);
+    VD const cos_r = 1.0 + r2 * horner(r2, cos_coeffs);
+    VD const sin_a = select(high, cos_r, sin_r);
+    VD const cos_a = select(high, sin_r, cos_r);
+    y = (VD)((VI)(log((1.0 + sin_a) / cos_a) * earth_radius) | sign);
+}
+
+template <typename VD>
+NODE_MAPNIK_MERCATOR_INLINE void merc_to_lonlat_lanes(VD& x, VD& y)
+{
+    x = (clamp(x, -max_extent, max_extent) / earth_radius) * r2d;
+    VD const t = clamp(y, -max_extent, max_extent) / earth_radius;
+    // lat is odd in t. With e = exp(-|t|):
+    //   |lat| = 2 * atan((1 - e) / (1 + e)), best while that is below tan(pi/8)
+    //   |lat| = pi/2 - 2 * atan(e), otherwise
+    // so that atan is only needed over |v| <= tan(pi/8).
+    using VI = typename int_vector<VD>::type;
+    VI const sign = (VI)t & sign_bit;
+    VD const a = (VD)((VI)t ^ sign);
+    VD const e = exp(-a);
+    auto const high = e < splat<VD>(tan_pi_by_8);
+    VD const atan_v = atan_reduced(select(high, e, (1.0 - e) / (1.0 + e)));
+    VD const lat = select(high, (pi_by_2_hi - 2.0 * atan_v) + pi_by_2_lo, 2.0 * atan_v);
+    // exp overflows the exponent bits of NaN, keep it
+    y = select(t != t, t, (VD)((VI)(lat * r2d) | sign));
+}
+
+template <typename VD, void (*lanes)(VD&, VD&)>
+NODE_MAPNIK_MERCATOR_INLINE void transform_step(double* coords)
+{
+    constexpr std::size_t width = sizeof(VD) / sizeof(double);
+    VD x;
+    VD y;
+    for (std::size_t j = 0; j < width; ++j)
+    {
+        x[j] = coords[2 * j];
+        y[j] = coords[2 * j + 1];
+    }
+    lanes(x, y);
+    for (std::size_t j = 0; j < width; ++j)
+    {
+        coords[2 * j] = x[j];
+        coords[2 * j + 1] = y[j];
+    }
+}
+
+template <typename VD, void (*lanes)(VD&, VD&)>
+NODE_MAPNIK_MERCATOR_INLINE void transform_vector(double* coords, std::size_t count)
+{
+    constexpr std::size_t width = sizeof(VD) / sizeof(double);
+    std::size_t i = 0;
+    for (; i + width <= count; i += width)
+    {
+        transform_step<VD, lanes>(coords + 2 * i);
+    }
+    if (i < count)
+    {
+        // the remaining points go through the same lanes, so that results
+        // don't depend on the position of a point in the array
+        double tail[2 * width] = {};
+        std::memcpy(tail, coords + 2 * i, (count - i) * 2 * sizeof(double));
+        transform_step<VD, lanes>(tail);
+        std::memcpy(coords + 2 * i, tail, (count - i) * 2 * sizeof(double));
+    }
+}
+
+#if defined(__x86_64__)
+
+// Two SSE2 lanes without FMA are no faster than libm, so x86 CPUs without
+// AVX2 and FMA keep the scalar kernel.
+__attribute__((target("avx2,fma"))) void lonlat_to_merc_avx2(double* coords, std::size_t count)
+{
+    transform_vector<v4d, lonlat_to_merc_lanes<v4d>>(coords, count);
+}
+
+__attribute__((target("avx2,fma"))) void merc_to_lonlat_avx2(double* coords, std::size_t count)
+{
+    transform_vector<v4d, merc_to_lonlat_lanes<v4d>>(coords, count);
+}
+
+#else
+
+void lonlat_to_merc_neon(double* coords, std::size_t count)
+{
+    transform_vector<v2d, lonlat_to_merc_lanes<v2d>>(coords, count);
+}
+
+void merc_to_lonlat_neon(double* coords, std::size_t count)
+{
+    transform_vector<v2d, merc_to_lonlat_lanes<v2d>>(coords, count);
+}
+
+#endif
+
+#endif
+
+mercator_kernels const& select_kernels()
+{
+    static mercator_kernels const kernels = []() -> mercator_kernels {
+#if defined(NODE_MAPNIK_MERCATOR_SIMD) && defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            return {lonlat_to_merc_avx2, merc_to_lonlat_avx2, "avx2"};
+        }
+#elif defined(NODE_MAPNIK_MERCATOR_SIMD)
+        return {lonlat_to_merc_neon, merc_to_lonlat_neon, "neon"};
+#endif
+        return {lonlat_to_merc_scalar, merc_to_lonlat_scalar, "scalar"};
+    }();
+    return kernels;
+}
+
+} // namespace
+
+void lonlat_to_merc(double* coords, std::size_t count)
+{
+    select_kernels().forward(coords, count);
+}
+
+void merc_to_lonlat(double* coords, std::size_t count)
+{
+    select_kernels().inverse(coords, count);
+}
+
+char const* mercator_kernel()
+{
+    return select_kernels().name;
+}
+
+} // namespace node_mapnik
@@ -0,0 +1,28 @@
+#pragma once
+
+// stl
+#include <cstddef>
+
+namespace node_mapnik {
+
+// Spherical mercator (epsg:3857) <-> lon/lat (epsg:4326) over `count`
+// interleaved x,y pairs, in place. Inputs are clamped like mapnik::lonlat2merc
+// and mapnik::merc2lonlat. NaN coordinates stay NaN.
+//
+// The implementation (AVX2, NEON or scalar) is picked once at runtime based on
+// what the CPU supports, so results depend on the CPU in their last bits. The
+// vector kernels are within 5e-8 m forward and 1e-13 degrees inverse of
+// mapnik's scalar functions, measured up to 3e-8 m and 6e-14 degrees over the
+// whole range. Most of that is the rounding error of the scalar functions:
+// against exact values both kernels are within 1.5e-8 m and 2.5e-14 degrees.
+void lonlat_to_merc(double* coords, std::size_t count);
+void merc_to_lonlat(double* coords, std::size_t count);
+
+// Name of the kernel picked at runtime: "avx2", "neon" or "scalar".
+char const* mercator_kernel();
+
+// merc_to_lonlat through mapnik::merc2lonlat on every CPU, for output that
+// must not change with the machine it is computed on.
+void merc_to_lonlat_scalar(double* coords, std::size_t count);
+
+} // namespace node_mapnik
@@ -26,6 +26,7 @@
 #endif
 #include "mapnik_expression.hpp"
 #include "blend.hpp"
+#include "projection_cache.hpp"
 
 // mapnik
 #include <mapnik/config.hpp> // for MAPNIK_DECL
@@ -65,6 +66,8 @@ static Napi::Value clearCache(Napi::CallbackInfo const& info)
     mapnik::marker_cache::instance().clear();
     mapnik::mapped_memory_cache::instance().clear();
 #endif
+    clearBlendCache();
+    clear_projection_cache();
     return env.Undefined();
 }
 } // namespace node_mapnik
@@ -346,6 +349,9 @@ Napi::Object init(Napi::Env env, Napi::Object exports)
     exports.Set("memoryFonts", Napi::Function::New(env, node_mapnik::memory_fonts));
     exports.Set("clearCache", Napi::Function::New(env, node_mapnik::clearCache));
     exports.Set("blend", Napi::Function::New(env, node_mapnik::blend));
+    exports.Set("blendMany", Napi::Function::New(env, node_mapnik::blendMany));
+    exports.Set("blendStats", Napi::Function::New(env, node_mapnik::blendStats));
+    exports.Set("setBlendCacheSize", Napi::Function::New(env, node_mapnik::setBlendCacheSize));
     exports.Set("rgb2hsl", Napi::Function::New(env, node_mapnik::rgb2hsl));
     exports.Set("hsl2rgb", Napi::Function::New(env, node_mapnik::hsl2rgb));
     // classes
@@ -0,0 +1,166 @@
+#pragma once
+
+// mapnik
+#include <mapnik/geometry.hpp>
+#include <mapnik/geom_util.hpp>
+#include <mapnik/util/variant.hpp>
+
+namespace detail {
+
+// Distance from x/y to the closest part of a geometry, as used by
+// VectorTile.query. Polygons report 0 when the point is inside and no hit
+// otherwise.
+struct p2p_result
+{
+    double distance = -1;
+    double x_hit = 0;
+    double y_hit = 0;
+};
+
+struct p2p_distance
+{
+    p2p_distance(double x, double y)
+        : x_(x),
+          y_(y) {}
+
+    p2p_result operator()(mapnik::geometry::geometry_empty const&) const
+    {
+        p2p_result p2p;
+        return p2p;
+    }
+
+    p2p_result operator()(mapnik::geometry::point<double> const& geom) const
+    {
+        p2p_result p2p;
+        p2p.x_hit = geom.x;
+        p2p.y_hit = geom.y;
+        p2p.distance = mapnik::distance(geom.x, geom.y, x_, y_);
+        return p2p;
+    }
+    p2p_result operator()(mapnik::geometry::multi_point<double> const& geom) const
+    {
+        p2p_result p2p;
+        for (auto const& pt : geom)
+        {
+            p2p_result p2p_sub = operator()(pt);
+            if (p2p_sub.distance >= 0 && (p2p.distance < 0 || p2p_sub.distance < p2p.distance))
+            {
+                p2p.x_hit = p2p_sub.x_hit;
+                p2p.y_hit = p2p_sub.y_hit;
+                p2p.distance = p2p_sub.distance;
+            }
+        }
+        return p2p;
+    }
+    p2p_result operator()(mapnik::geometry::line_string<double> const& geom) const
+    {
+        p2p_result p2p;
+        auto num_points = geom.size();
+        if (num_points > 1)
+        {
+            for (std::size_t i = 1; i < num_points; ++i)
+            {
+                auto const& pt0 = geom[i - 1];
+                auto const& pt1 = geom[i];
+                double dist = mapnik::point_to_segment_distance(x_, y_, pt0.x, pt0.y, pt1.x, pt1.y);
+                if (dist >= 0 && (p2p.distance < 0 || dist < p2p.distance))
+                {
+                    p2p.x_hit = pt0.x;
+                    p2p.y_hit = pt0.y;
+                    p2p.distance = dist;
+                }
+            }
+        }
+        return p2p;
+    }
+    p2p_result operator()(mapnik::geometry::multi_line_string<double> const& geom) const
+    {
+        p2p_result p2p;
+        for (auto const& line : geom)
+        {
+            p2p_result p2p_sub = operator()(line);
+            if (p2p_sub.distance >= 0 && (p2p.distance < 0 || p2p_sub.distance < p2p.distance))
+            {
+                p2p.x_hit = p2p_sub.x_hit;
+                p2p.y_hit = p2p_sub.y_hit;
+                p2p.distance = p2p_sub.distance;
+            }
+        }
+        return p2p;
+    }
+    p2p_result operator()(mapnik::geometry::polygon<double> const& poly) const
+    {
+        p2p_result p2p;
+        std::size_t num_rings = poly.size();
+        bool inside = false;
+        for (std::size_t ring_index = 0; ring_index < num_rings; ++ring_index)
+        {
+            auto const& ring = poly[ring_index];
+            auto num_points = ring.size();
+            if (num_points < 4)
+            {
+                if (ring_index == 0) // exterior
+                    return p2p;
+                else // interior
+                    continue;
+            }
+            for (std::size_t index = 1; index < num_points; ++index)
+            {
+                auto const& pt0 = ring[index - 1];
+                auto const& pt1 = ring[index];
+                // todo - account for tolerance
+                if (mapnik::detail::pip(pt0.x, pt0.y, pt1.x, pt1.y, x_, y_))
+                {
+                    inside = !inside;
+                }
+            }
+            if (ring_index == 0 && !inside) return p2p;
+        }
+        if (inside) p2p.distance = 0;
+        return p2p;
+    }
+
+    p2p_result operator()(mapnik::geometry::multi_polygon<double> const& geom) const
+    {
+        p2p_result p2p;
+        for (auto const& poly : geom)
+        {
+            p2p_result p2p_sub = operator()(poly);
+            if (p2p_sub.distance >= 0 && (p2p.distance < 0 || p2p_sub.distance < p2p.distance))
+            {
+                p2p.x_hit = p2p_sub.x_hit;
+                p2p.y_hit = p2p_sub.y_hit;
+                p2p.distance = p2p_sub.distance;
+            }
+        }
+        return p2p;
+    }
+    p2p_result operator()(mapnik::geometry::geometry_collection<double> const& collection) const
+    {
+        // There is no current way that a geometry collection could be returned from a vector tile.
+        // LCOV_EXCL_START
+        p2p_result p2p;
+        for (auto const& geom : collection)
+        {
+            p2p_result p2p_sub = mapnik::util::apply_visitor((*this), geom);
+            if (p2p_sub.distance >= 0 && (p2p.distance < 0 || p2p_sub.distance < p2p.distance))
+            {
+                p2p.x_hit = p2p_sub.x_hit;
+                p2p.y_hit = p2p_sub.y_hit;
+                p2p.distance = p2p_sub.distance;
+            }
+        }
+        return p2p;
+        // LCOV_EXCL_STOP
+    }
+
+    double x_;
+    double y_;
+};
+
+inline p2p_result path_to_point_distance(mapnik::geometry::geometry<double> const& geom, double x, double y)
+{
+    return mapnik::util::apply_visitor(p2p_distance(x, y), geom);
+}
+
+} // namespace detail
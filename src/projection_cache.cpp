@@ -0,0 +1,190 @@
+#include "projection_cache.hpp"
+#include "mercator.hpp"
+
+// mapnik
+#include <mapnik/util/variant.hpp>
+
+// stl
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace node_mapnik {
+
+namespace {
+
+// Idle instances kept per key, beyond that released ones are destroyed.
+constexpr std::size_t max_idle = 16;
+
+struct transform_entry
+{
+    transform_entry(std::string const& source_srs, std::string const& dest_srs)
+        : source(source_srs, true),
+          dest(dest_srs, true),
+          transform(source, dest) {}
+
+    mapnik::projection source;
+    mapnik::projection dest;
+    mapnik::proj_transform transform;
+};
+
+template <typename T>
+class instance_pool
+{
+  public:
+    template <typename Make>
+    std::shared_ptr<T> acquire(std::string const& key, Make const& make)
+    {
+        std::unique_ptr<T> item;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto itr = idle_.find(key);
+            if (itr != idle_.end() && !itr->second.empty())
+            {
+                item = std::move(itr->second.back());
+                itr->second.pop_back();
+            }
+        }
+        if (!item) item = make();
+        return std::shared_ptr<T>(item.release(), [this, key](T* released) {
+            this->release(key, released);
+        });
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_.clear();
+    }
+
+  private:
+    void release(std::string const& key, T* released)
+    {
+        std::unique_ptr<T> item(released);
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& items = idle_[key];
+        if (items.size() < max_idle) items.push_back(std::move(item));
+    }
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::vector<std::unique_ptr<T>>> idle_;
+};
+
+// Never destroyed, a pointer handed out may be released during exit.
+instance_pool<mapnik::projection>& projections()
+{
+    static auto* pool = new instance_pool<mapnik::projection>();
+    return *pool;
+}
+
+instance_pool<transform_entry>& transforms()
+{
+    static auto* pool = new instance_pool<transform_entry>();
+    return *pool;
+}
+
+struct merc_to_lonlat_visitor
+{
+    merc_to_lonlat_kernel kernel;
+
+    void operator()(mapnik::geometry::geometry_empty&) const {}
+
+    static_assert(sizeof(mapnik::geometry::point<double>) == 2 * sizeof(double),
+                  "points are reprojected as interleaved x,y pairs");
+
+    void operator()(mapnik::geometry::point<double>& pt) const
+    {
+        kernel(&pt.x, 1);
+    }
+
+    void operator()(std::vector<mapnik::geometry::point<double>>& points) const
+    {
+        if (points.empty()) return;
+        kernel(&points.front().x, points.size());
+    }
+
+    void operator()(mapnik::geometry::line_string<double>& line) const
+    {
+        (*this)(static_cast<std::vector<mapnik::geometry::point<double>>&>(line));
+    }
+
+    void operator()(mapnik::geometry::multi_point<double>& points) const
+    {
+        (*this)(static_cast<std::vector<mapnik::geometry::point<double>>&>(points));
+    }
+
+    void operator()(mapnik::geometry::polygon<double>& poly) const
+    {
+        for (auto& ring : poly)
+        {
+            (*this)(static_cast<std::vector<mapnik::geometry::point<double>>&>(ring));
+        }
+    }
+
+    void operator()(mapnik::geometry::multi_line_string<double>& lines) const
+    {
+        for (auto& line : lines)
+        {
+            (*this)(line);
+        }
+    }
+
+    void operator()(mapnik::geometry::multi_polygon<double>& polys) const
+    {
+        for (auto& poly : polys)
+        {
+            (*this)(poly);
+        }
+    }
+
+    void operator()(mapnik::geometry::geometry_collection<double>& collection) const
+    {
+        for (auto& geom : collection)
+        {
+            mapnik::util::apply_visitor(*this, geom);
+        }
+    }
+};
+
+} // namespace
+
+std::shared_ptr<mapnik::projection const> acquire_projection(std::string const& srs)
+{
+    return projections().acquire(srs, [&srs]() {
+        return std::make_unique<mapnik::projection>(srs, true);
+    });
+}
+
+std::shared_ptr<mapnik::proj_transform const> acquire_transform(std::string const& source, std::string const& dest)
+{
+    // mapnik transforms between these two analytically, the instances hold
+    // no PROJ state and can be used by any number of threads.
+    static transform_entry const wgs84_to_merc("epsg:4326", "epsg:3857");
+    static transform_entry const merc_to_wgs84("epsg:3857", "epsg:4326");
+    if (source == "epsg:4326" && dest == "epsg:3857")
+    {
+        return std::shared_ptr<mapnik::proj_transform const>(std::shared_ptr<void>(), &wgs84_to_merc.transform);
+    }
+    if (source == "epsg:3857" && dest == "epsg:4326")
+    {
+        return std::shared_ptr<mapnik::proj_transform const>(std::shared_ptr<void>(), &merc_to_wgs84.transform);
+    }
+    std::shared_ptr<transform_entry> entry = transforms().acquire(source + '\n' + dest, [&source, &dest]() {
+        return std::make_unique<transform_entry>(source, dest);
+    });
+    return std::shared_ptr<mapnik::proj_transform const>(entry, &entry->transform);
+}
+
+void clear_projection_cache()
+{
+    projections().clear();
+    transforms().clear();
+}
+
+void merc_to_lonlat(mapnik::geometry::geometry<double>& geom, merc_to_lonlat_kernel kernel)
+{
+    mapnik::util::apply_visitor(merc_to_lonlat_visitor{kernel ? kernel : merc_to_lonlat}, geom);
+}
+
+} // namespace node_mapnik
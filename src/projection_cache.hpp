@@ -0,0 +1,35 @@
+#pragma once
+
+// mapnik
+#include <mapnik/geometry.hpp>
+#include <mapnik/projection.hpp>
+#include <mapnik/proj_transform.hpp>
+
+// stl
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace node_mapnik {
+
+// Process-wide pools of projections and transforms, keyed by SRS. PROJ objects
+// must not be used by two threads at once, so each caller gets an instance of
+// its own for as long as it holds the returned pointer, which puts it back in
+// the pool when released. Instances are only created when the pool for their
+// key is empty.
+//
+// Transforms between epsg:4326 and epsg:3857 are computed analytically by
+// mapnik and never touch PROJ, so a single instance of each is shared by all.
+std::shared_ptr<mapnik::projection const> acquire_projection(std::string const& srs);
+std::shared_ptr<mapnik::proj_transform const> acquire_transform(std::string const& source, std::string const& dest);
+
+// Drops the idle instances of the pools.
+void clear_projection_cache();
+
+// Reprojects a spherical mercator geometry to lon/lat in place, one ring or
+// line at a time through `kernel`, by default the vectorized one of
+// mercator.hpp.
+using merc_to_lonlat_kernel = void (*)(double*, std::size_t);
+void merc_to_lonlat(mapnik::geometry::geometry<double>& geom, merc_to_lonlat_kernel kernel = nullptr);
+
+} // namespace node_mapnik
@@ -0,0 +1,58 @@
+#include "thread_pool.hpp"
+
+// stl
+#include <system_error>
+#include <thread>
+
+namespace node_mapnik {
+
+thread_pool& thread_pool::instance()
+{
+    static thread_pool* pool = new thread_pool();
+    return *pool;
+}
+
+thread_pool::thread_pool()
+{
+    unsigned count = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < count; ++i)
+    {
+        try
+        {
+            std::thread([this]() { work(); }).detach();
+            ++size_;
+        }
+        catch (std::system_error const&)
+        {
+            // Could not spawn another thread: make do with the others,
+            // or with the calling threads alone.
+            break;
+        }
+    }
+}
+
+void thread_pool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    ready_.notify_one();
+}
+
+void thread_pool::work()
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [this]() { return !tasks_.empty(); });
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+} // namespace node_mapnik
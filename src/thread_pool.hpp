@@ -0,0 +1,117 @@
+#pragma once
+
+// stl
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace node_mapnik {
+
+// Process-wide helper threads, one per CPU, shared by every job that splits
+// its work across threads. Jobs run on their libuv thread and borrow helpers
+// from here, so concurrent jobs never start more threads than there are CPUs:
+// they queue for the same helpers instead. The threads are started on first
+// use and live as long as the process: the pool is never destroyed, so that
+// exiting does not wait on jobs in flight.
+class thread_pool
+{
+  public:
+    static thread_pool& instance();
+
+    std::size_t size() const { return size_; }
+
+    void submit(std::function<void()> task);
+
+  private:
+    thread_pool();
+    void work();
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::function<void()>> tasks_;
+    std::size_t size_ = 0;
+};
+
+// Runs work(i) for every i in [0, count) on the calling thread and at most
+// `concurrency - 1` helpers of the thread_pool. Items are handed out in
+// order. Once an item throws no further items are started and the first
+// exception is rethrown.
+//
+// The calling thread works through the items itself, so a call never waits
+// for a busy pool. Helpers which only get to run once it is done find the
+// call closed and return without touching it.
+template <typename Work>
+void parallel_for(std::size_t count, std::size_t concurrency, Work const& work)
+{
+    std::atomic<std::size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto run = [&]() {
+        for (std::size_t i = next++; i < count && !failed; i = next++)
+        {
+            try
+            {
+                work(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) error = std::current_exception();
+                failed = true;
+            }
+        }
+    };
+    if (count == 0)
+    {
+        return;
+    }
+    thread_pool& pool = thread_pool::instance();
+    std::size_t helpers = std::min<std::size_t>({std::max<std::size_t>(concurrency, 1), count, pool.size() + 1}) - 1;
+    if (helpers == 0)
+    {
+        run();
+    }
+    else
+    {
+        struct call_state
+        {
+            std::mutex mutex;
+            std::condition_variable done;
+            std::function<void()> run;
+            std::size_t active = 0;
+            bool closed = false;
+        };
+        auto state = std::make_shared<call_state>();
+        state->run = run;
+        for (std::size_t h = 0; h < helpers; ++h)
+        {
+            pool.submit([state]() {
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (state->closed) return;
+                    ++state->active;
+                }
+                state->run();
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    --state->active;
+                }
+                state->done.notify_one();
+            });
+        }
+        run();
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->closed = true;
+        state->done.wait(lock, [&state]() { return state->active == 0; });
+    }
+    if (error) std::rethrow_exception(error);
+}
+
+} // namespace node_mapnik
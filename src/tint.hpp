@@ -95,4 +95,16 @@ struct Tinter
         return (a0 == 0 &&
                 a1 == 1);
     }
+
+    bool operator==(Tinter const& other) const
+    {
+        return (h0 == other.h0 &&
+                h1 == other.h1 &&
+                s0 == other.s0 &&
+                s1 == other.s1 &&
+                l0 == other.l0 &&
+                l1 == other.l1 &&
+                a0 == other.a0 &&
+                a1 == other.a1);
+    }
 };
@@ -49,6 +49,8 @@ test('blend fails', (assert) => {
   assert.throws(function() { mapnik.blend(images, {compression:'foo'}, function(err, result) {}); });
   assert.throws(function() { mapnik.blend(images, {width:-1}, function(err, result) {}); });
   assert.throws(function() { mapnik.blend(images, {height:-1}, function(err, result) {}); });
+  assert.throws(function() { mapnik.blend(images, {concurrency:0}, function(err, result) {}); });
+  assert.throws(function() { mapnik.blend(images, {concurrency:'foo'}, function(err, result) {}); });
   assert.end();
 });
 
@@ -75,6 +77,28 @@ test('blended png - reverse', (assert) => {
   });
 });
 
+test('blended png - concurrent decode', (assert) => {
+  var expected = new mapnik.Image.open('test/blend-fixtures/expected.png');
+  mapnik.blend(images, {concurrency:4}, function(err, result) {
+    if (err) throw err;
+    var actual = new mapnik.Image.fromBytesSync(result);
+    assert.equal(0,expected.compare(actual));
+    assert.end();
+  });
+});
+
+test('blended png - concurrent decode - fails on corrupt layer', (assert) => {
+  var input = [
+    fs.readFileSync('test/blend-fixtures/1a.png'),
+    fs.readFileSync('test/blend-fixtures/corrupt-1.png')
+  ];
+  mapnik.blend(input, {concurrency:2, reencode:true}, function(err, result) {
+    assert.ok(err);
+    assert.notOk(result);
+    assert.end();
+  });
+});
+
 test('blended png - objects', (assert) => {
   var input = [{
     buffer: fs.readFileSync('test/blend-fixtures/1.png')
@@ -183,6 +207,25 @@ test('blended png - objects - x and y', (assert) => {
   });
 });
 
+test('blended png - objects - x and y - only decodes visible window', (assert) => {
+  var input = [{
+    buffer: fs.readFileSync('test/blend-fixtures/1.png'),
+    x: 10,
+    y: 10
+  },{
+    buffer: fs.readFileSync('test/blend-fixtures/2.png')
+  }];
+  var before = mapnik.blendStats().decodeSkippedBytes;
+  mapnik.blend(input, {reencode:true}, function(err, result) {
+    if (err) throw err;
+    var image = new mapnik.Image.fromBytesSync(input[0].buffer);
+    var visible = (image.width() - 10) * (image.height() - 10);
+    var skipped = (image.width() * image.height() - visible) * 4;
+    assert.equal(mapnik.blendStats().decodeSkippedBytes - before, skipped);
+    assert.end();
+  });
+});
+
 test('blended png - single objects', (assert) => {
   var input = [{
     buffer: fs.readFileSync('test/blend-fixtures/1a.png'),
@@ -531,6 +574,131 @@ test('blended pass format webp with compression', (assert) => {
   });
 });
 
+test('blend to mapnik.Image without encoding', (assert) => {
+  assert.throws(function() { mapnik.blend(images, {encode:'no'}, function(err, result) {}); });
+  assert.throws(function() { mapnik.blend(images, {target:{}}, function(err, result) {}); });
+  assert.throws(function() { mapnik.blend(images, {target:new mapnik.Image(256, 256, {type: mapnik.imageType.gray8})}, function(err, result) {}); });
+  assert.throws(function() { mapnik.blend(images, {target:new mapnik.Image(256, 256), width:10}, function(err, result) {}); });
+  var canvas = new mapnik.Image(256, 256);
+  assert.throws(function() { mapnik.blend([images[0], canvas], {target:canvas}, function(err, result) {}); },
+                /target must not be one of the images to blend/);
+  assert.throws(function() { mapnik.blend([{buffer:canvas, x:10, y:10}], {target:canvas}, function(err, result) {}); },
+                /target must not be one of the images to blend/);
+  var expected = new mapnik.Image.open('test/blend-fixtures/expected.png');
+  mapnik.blend(images, {encode:false}, function(err, result) {
+    if (err) throw err;
+    assert.ok(result instanceof mapnik.Image);
+    assert.equal(0, expected.compare(result));
+    assert.end();
+  });
+});
+
+test('blend into target mapnik.Image', (assert) => {
+  var expected = new mapnik.Image.open('test/blend-fixtures/expected.png');
+  var target = new mapnik.Image(256, 256);
+  mapnik.blend([images[0]], {target:target}, function(err, result) {
+    if (err) throw err;
+    assert.ok(result instanceof mapnik.Image);
+    // blend the next layer on top of the raw result, then encode
+    mapnik.blend([result, images[1]], {reencode:true}, function(err, buffer) {
+      if (err) throw err;
+      assert.equal(0, expected.compare(new mapnik.Image.fromBytesSync(buffer)));
+      assert.equal(target.width(), 256);
+      assert.end();
+    });
+  });
+});
+
+test('blend result cache', (assert) => {
+  assert.throws(function() { mapnik.setBlendCacheSize(); });
+  assert.throws(function() { mapnik.setBlendCacheSize(-1); });
+  mapnik.setBlendCacheSize(1024 * 1024);
+  var before = mapnik.blendStats();
+  mapnik.blend(images, {reencode:true}, function(err, first) {
+    if (err) throw err;
+    mapnik.blend(images, {reencode:true}, function(err, second) {
+      if (err) throw err;
+      assert.ok(first.equals(second));
+      // different options must not hit the cached result
+      mapnik.blend(images, {reencode:true, format:'jpeg'}, function(err, third) {
+        if (err) throw err;
+        assert.notOk(first.equals(third));
+        var after = mapnik.blendStats();
+        assert.equal(after.cacheHits - before.cacheHits, 1);
+        assert.equal(after.cacheMisses - before.cacheMisses, 2);
+        assert.equal(after.cacheEntries, 2);
+        // entries keep their inputs to compare them on a hit
+        assert.ok(after.cacheBytes >= 2 * (images[0].length + images[1].length));
+        assert.equal(after.cacheMaxBytes, 1024 * 1024);
+        mapnik.setBlendCacheSize(first.length);
+        assert.ok(mapnik.blendStats().cacheEvictions > before.cacheEvictions);
+        mapnik.setBlendCacheSize(0);
+        assert.equal(mapnik.blendStats().cacheEntries, 0);
+        assert.end();
+      });
+    });
+  });
+});
+
+test('blended png - opaque layer with alpha channel hides lower layers', (assert) => {
+  var im = new mapnik.Image(256, 256);
+  im.fill(new mapnik.Color('green'));
+  // png32 keeps the alpha channel although every pixel is opaque
+  var input = [fs.readFileSync('test/blend-fixtures/corrupt-1.png'), im.encodeSync('png32')];
+  var before = mapnik.blendStats();
+  mapnik.blend(input, {concurrency:1, reencode:true}, function(err, result) {
+    if (err) throw err;
+    assert.equal(0, im.compare(new mapnik.Image.fromBytesSync(result)));
+    var stats = mapnik.blendStats();
+    assert.equal(stats.opacityDetected - before.opacityDetected, 1);
+    // now the corrupt layer is dropped before decoding, whatever the concurrency
+    mapnik.blend(input, {concurrency:4, reencode:true}, function(err, result) {
+      if (err) throw err;
+      assert.equal(0, im.compare(new mapnik.Image.fromBytesSync(result)));
+      assert.equal(mapnik.blendStats().opacityCacheHits - stats.opacityCacheHits, 1);
+      assert.end();
+    });
+  });
+});
+
+test('blendMany', (assert) => {
+  assert.throws(function() { mapnik.blendMany(); });
+  assert.throws(function() { mapnik.blendMany(images, function(err, result) {}); });
+  assert.throws(function() { mapnik.blendMany(images, [], function(err, result) {}); });
+  assert.throws(function() { mapnik.blendMany(images, [{width:256}], function(err, result) {}); });
+  assert.throws(function() { mapnik.blendMany(images, [{width:256, height:0}], function(err, result) {}); });
+  assert.throws(function() { mapnik.blendMany(images, [{width:256, height:256, x:'foo'}], function(err, result) {}); });
+  assert.throws(function() { mapnik.blendMany(images, [{width:256, height:256, format:'foo'}], function(err, result) {}); });
+  assert.throws(function() { mapnik.blendMany(images, [{width:256, height:256}], {concurrency:0}, function(err, result) {}); });
+  assert.throws(function() { mapnik.blendMany(images, [{width:256, height:256}], {}); });
+  var expected = new mapnik.Image.open('test/blend-fixtures/expected.png');
+  var shifted = images.map(function(buffer) { return {buffer: buffer, x: 10, y: 10}; });
+  mapnik.blend(shifted, {width:256, height:256}, function(err, expected_shifted) {
+    if (err) throw err;
+    mapnik.blendMany(images, [
+      {width:256, height:256},
+      {x:-10, y:-10, width:256, height:256},
+      {width:256, height:256, format:'jpeg'}
+    ], {concurrency:2}, function(err, results) {
+      if (err) throw err;
+      assert.equal(results.length, 3);
+      assert.equal(0, expected.compare(new mapnik.Image.fromBytesSync(results[0])));
+      var actual_shifted = new mapnik.Image.fromBytesSync(results[1]);
+      assert.equal(0, new mapnik.Image.fromBytesSync(expected_shifted).compare(actual_shifted));
+      assert.equal(new mapnik.Image.fromBytesSync(results[2]).width(), 256);
+      assert.end();
+    });
+  });
+});
+
+test('blendMany - fails on bad images', (assert) => {
+  mapnik.blendMany(images_bad, [{width:256, height:256}], function(err, results) {
+    assert.ok(err);
+    assert.notOk(results);
+    assert.end();
+  });
+});
+
 test('hsl to rgb works properly', (assert) => {
   // Assert throws on bad parameters
   assert.throws(function() { mapnik.hsl2rgb(); });
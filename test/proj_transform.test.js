@@ -141,3 +141,163 @@ test('should not throw with invalid bbox (3873 -> 4326) backward', (assert) => {
   assert.doesNotThrow(function() { trans.backward(long_lat_box); });
   assert.end();
 });
+
+test('should transform Float64Array in place (4326 -> 3857)', (assert) => {
+  var from = new mapnik.Projection('epsg:4326');
+  var to = new mapnik.Projection('epsg:3857');
+  var trans = new mapnik.ProjTransform(from,to);
+  var points = [[-122.33517, 47.63752], [0, 0], [179.9, -60.5]];
+  var coords = new Float64Array(points.length * 2);
+  points.forEach(function(pt, i) { coords[i * 2] = pt[0]; coords[i * 2 + 1] = pt[1]; });
+  var failures = trans.forwardArray(coords);
+  assert.ok(failures instanceof Uint8Array);
+  assert.equal(failures.length, 1);
+  assert.equal(failures[0], 0);
+  points.forEach(function(pt, i) {
+    var expected = trans.forward(pt);
+    assert.ok(Math.abs(coords[i * 2] - expected[0]) < 1e-6);
+    assert.ok(Math.abs(coords[i * 2 + 1] - expected[1]) < 1e-6);
+  });
+  failures = trans.backwardArray(coords);
+  assert.equal(failures[0], 0);
+  points.forEach(function(pt, i) {
+    assert.ok(Math.abs(coords[i * 2] - pt[0]) < 1e-9);
+    assert.ok(Math.abs(coords[i * 2 + 1] - pt[1]) < 1e-9);
+  });
+  assert.end();
+});
+
+test('should flag failed points in Float64Array', (assert) => {
+  var from = new mapnik.Projection('epsg:4326');
+  var to = new mapnik.Projection('epsg:3857');
+  var trans = new mapnik.ProjTransform(from,to);
+  var coords = new Float64Array(20);
+  coords[2 * 9] = NaN;
+  var failures = trans.forwardArray(coords);
+  assert.equal(failures.length, 2);
+  assert.equal(failures[0], 0);
+  assert.equal(failures[1], 2);
+  assert.ok(isNaN(coords[2 * 9]) && isNaN(coords[2 * 9 + 1]));
+  assert.equal(coords[0], 0);
+  assert.end();
+});
+
+test('should transform Float64Array async (4326 -> 3857)', (assert) => {
+  var from = new mapnik.Projection('epsg:4326');
+  var to = new mapnik.Projection('epsg:3857');
+  var trans = new mapnik.ProjTransform(from,to);
+  // large enough to be split across threads
+  var count = 300000;
+  var coords = new Float64Array(count * 2);
+  for (var i = 0; i < count; ++i) {
+    coords[i * 2] = -180 + 360 * i / count;
+    coords[i * 2 + 1] = -80 + 160 * i / count;
+  }
+  var expected = new Float64Array(coords);
+  trans.forwardArray(expected);
+  trans.forwardArray(coords, function(err, failures) {
+    assert.ifError(err);
+    assert.equal(failures.length, Math.ceil(count / 8));
+    assert.ok(failures.every(function(b) { return b === 0; }));
+    assert.deepEqual(coords, expected);
+    trans.backwardArray(coords, function(err, failures) {
+      assert.ifError(err);
+      assert.ok(failures.every(function(b) { return b === 0; }));
+      assert.ok(Math.abs(coords[2] - (-180 + 360 / count)) < 1e-9);
+      assert.end();
+    });
+  });
+});
+
+test('should throw with invalid Float64Array usage', (assert) => {
+  var from = new mapnik.Projection('epsg:4326');
+  var to = new mapnik.Projection('epsg:3857');
+  var trans = new mapnik.ProjTransform(from,to);
+  assert.throws(function() { trans.forwardArray(); });
+  assert.throws(function() { trans.forwardArray([0, 0]); });
+  assert.throws(function() { trans.forwardArray(new Float32Array(2)); });
+  assert.throws(function() { trans.forwardArray(new Float64Array(3)); });
+  assert.throws(function() { trans.backwardArray(new Float64Array(2), {}); });
+  assert.end();
+});
+
+test('forwardArray/backwardArray match forward/backward (4326 <-> 3857)', (assert) => {
+  var wgs84 = new mapnik.Projection('epsg:4326');
+  var merc = new mapnik.Projection('epsg:3857');
+  var points = [[0, 0], [180, 85.0511287798066], [-180, -85.0511287798066],
+                [190, 89.9], [-190, -90], [1e-12, -1e-12], [-0.5, 0.5]];
+  for (var lon = -180; lon <= 180; lon += 7.3) {
+    for (var lat = -85; lat <= 85; lat += 0.85) {
+      points.push([lon, lat]);
+    }
+  }
+  [new mapnik.ProjTransform(wgs84, merc), new mapnik.ProjTransform(merc, wgs84)].forEach(function(trans, reversed) {
+    var coords = new Float64Array(points.length * 2);
+    points.forEach(function(pt, i) { coords[i * 2] = pt[0]; coords[i * 2 + 1] = pt[1]; });
+    var failures = reversed ? trans.backwardArray(coords) : trans.forwardArray(coords);
+    assert.ok(failures.every(function(b) { return b === 0; }));
+    var worst = 0;
+    points.forEach(function(pt, i) {
+      var expected = reversed ? trans.backward(pt) : trans.forward(pt);
+      worst = Math.max(worst, Math.abs(coords[i * 2] - expected[0]), Math.abs(coords[i * 2 + 1] - expected[1]));
+    });
+    assert.ok(worst <= 5e-8, 'mercator within 5e-8 m of the scalar path: ' + worst);
+
+    var merc_coords = new Float64Array(coords);
+    failures = reversed ? trans.forwardArray(coords) : trans.backwardArray(coords);
+    assert.ok(failures.every(function(b) { return b === 0; }));
+    worst = 0;
+    points.forEach(function(pt, i) {
+      var mpt = [merc_coords[i * 2], merc_coords[i * 2 + 1]];
+      var expected = reversed ? trans.forward(mpt) : trans.backward(mpt);
+      worst = Math.max(worst, Math.abs(coords[i * 2] - expected[0]), Math.abs(coords[i * 2 + 1] - expected[1]));
+    });
+    assert.ok(worst <= 1e-13, 'lon/lat within 1e-13 degrees of the scalar path: ' + worst);
+  });
+  assert.end();
+});
+
+test('forwardArray/backwardArray stay within 5e-8 m and 1e-13 degrees of forward/backward', (assert) => {
+  var trans = new mapnik.ProjTransform(new mapnik.Projection('epsg:4326'), new mapnik.Projection('epsg:3857'));
+  var max_extent = 20037508.342789244;
+  // fixed seed, so that a failure can be reproduced
+  var seed = 12345;
+  function random() {
+    seed = (seed * 16807) % 2147483647;
+    return seed / 2147483647;
+  }
+  var count = 100000;
+  var lonlat = new Float64Array(count * 2);
+  var merc = new Float64Array(count * 2);
+  for (var i = 0; i < count; ++i) {
+    lonlat[i * 2] = random() * 360 - 180;
+    lonlat[i * 2 + 1] = random() * 170.2 - 85.1;
+    merc[i * 2] = (random() * 2 - 1) * max_extent;
+    merc[i * 2 + 1] = (random() * 2 - 1) * max_extent;
+  }
+  var forward = new Float64Array(lonlat);
+  var backward = new Float64Array(merc);
+  trans.forwardArray(forward);
+  trans.backwardArray(backward);
+  var worst_forward = 0;
+  var worst_backward = 0;
+  for (i = 0; i < count; ++i) {
+    var expected = trans.forward([lonlat[i * 2], lonlat[i * 2 + 1]]);
+    worst_forward = Math.max(worst_forward, Math.abs(forward[i * 2] - expected[0]), Math.abs(forward[i * 2 + 1] - expected[1]));
+    expected = trans.backward([merc[i * 2], merc[i * 2 + 1]]);
+    worst_backward = Math.max(worst_backward, Math.abs(backward[i * 2] - expected[0]), Math.abs(backward[i * 2 + 1] - expected[1]));
+  }
+  assert.ok(worst_forward <= 5e-8, 'forward within 5e-8 m: ' + worst_forward);
+  assert.ok(worst_backward <= 1e-13, 'backward within 1e-13 degrees: ' + worst_backward);
+  assert.end();
+});
+
+test('forwardArray keeps NaN (4326 -> 3857)', (assert) => {
+  var trans = new mapnik.ProjTransform(new mapnik.Projection('epsg:4326'), new mapnik.Projection('epsg:3857'));
+  var coords = new Float64Array([NaN, 10, 10, NaN, 10, 10]);
+  var failures = trans.forwardArray(coords);
+  assert.equal(failures[0], 3);
+  assert.ok(coords.slice(0, 4).every(isNaN));
+  assert.ok(Math.abs(coords[4] - trans.forward([10, 10])[0]) < 1e-6);
+  assert.end();
+});
@@ -148,6 +148,160 @@ test('query polygon', (assert) => {
   }
 });
 
+test('query results do not change once the tile is indexed', (assert) => {
+  var data = fs.readFileSync(path.resolve(__dirname + "/data/vector_tile/tile3.mvt"));
+  var vt = new mapnik.VectorTile(5,28,12);
+  vt.setData(data);
+  function summary(features) {
+    return features.map(function(f) { return [f.layer, f.id(), f.distance, f.x_hit, f.y_hit]; });
+  }
+  var first = summary(vt.query(139.6142578125,37.17782559332976,{tolerance:0}));
+  assert.deepEqual(first, [['world',89,0,0,0],['world2',89,0,0,0]]);
+  assert.deepEqual(summary(vt.query(139.6142578125,37.17782559332976,{tolerance:0})), first);
+  assert.deepEqual(summary(vt.query(139.6142578125,37.17782559332976,{tolerance:0,layer:'world2'})), [first[1]]);
+  // far away from any feature, including with a tolerance
+  assert.deepEqual(vt.query(-150,-60,{tolerance:1000}), []);
+  vt.query(139.6142578125,37.17782559332976,{tolerance:0}, function(err, features) {
+    assert.ifError(err);
+    assert.deepEqual(summary(features), first);
+    assert.end();
+  });
+});
+
+test('query skips features far from the point without decoding them', (assert) => {
+  var data = fs.readFileSync(path.resolve(__dirname + "/data/vector_tile/tile3.mvt"));
+  var vt = new mapnik.VectorTile(5,28,12);
+  vt.setData(data);
+  var before = mapnik.VectorTile.queryStats();
+  assert.deepEqual(vt.query(-150,-60), []);
+  var after = mapnik.VectorTile.queryStats();
+  assert.ok(after.featuresSkipped > before.featuresSkipped);
+  assert.equal(after.featuresDecoded, before.featuresDecoded);
+  assert.equal(vt.query(139.6142578125,37.17782559332976).length, 2);
+  assert.ok(mapnik.VectorTile.queryStats().featuresDecoded >= after.featuresDecoded + 2);
+  assert.end();
+});
+
+test('query sees data replaced after the tile was indexed', (assert) => {
+  var data = fs.readFileSync(path.resolve(__dirname + "/data/vector_tile/tile3.mvt"));
+  var vt = new mapnik.VectorTile(5,28,12);
+  vt.setData(data);
+  assert.equal(vt.query(139.6142578125,37.17782559332976).length, 2);
+  vt.clear();
+  assert.deepEqual(vt.query(139.6142578125,37.17782559332976), []);
+  vt.setData(data);
+  assert.equal(vt.query(139.6142578125,37.17782559332976).length, 2);
+  vt.setData(data, function(err) {
+    assert.ifError(err);
+    assert.equal(vt.query(139.6142578125,37.17782559332976).length, 2);
+    vt.clear(function(err) {
+      assert.ifError(err);
+      assert.deepEqual(vt.query(139.6142578125,37.17782559332976), []);
+      vt.addData(data, function(err) {
+        assert.ifError(err);
+        assert.equal(vt.query(139.6142578125,37.17782559332976).length, 2);
+        assert.end();
+      });
+    });
+  });
+});
+
+test('queryTiles merges the results of neighbouring tiles', (assert) => {
+  var geojson = JSON.stringify({
+    type: 'FeatureCollection',
+    features: [
+      {type: 'Feature', geometry: {type: 'LineString', coordinates: [[-10,10],[10,10]]}, properties: {name: 'line'}},
+      {type: 'Feature', geometry: {type: 'Point', coordinates: [0.05,10.05]}, properties: {name: 'point'}}
+    ]
+  });
+  var west = new mapnik.VectorTile(1,0,0);
+  west.addGeoJSON(geojson, 'layer-name');
+  var east = new mapnik.VectorTile(1,1,0);
+  east.addGeoJSON(geojson, 'layer-name');
+  assert.throws(function() { mapnik.VectorTile.queryTiles(); });
+  assert.throws(function() { mapnik.VectorTile.queryTiles([west, {}], 0, 10); });
+  assert.throws(function() { mapnik.VectorTile.queryTiles([west, east], 0, 10, null); });
+  assert.throws(function() { mapnik.VectorTile.queryTiles([west, east], 0, 10, {threading_mode: 99}); });
+  function names(features) {
+    return features.map(function(f) { return f.attributes().name; });
+  }
+  var separate = west.query(0.01, 10, {tolerance: 20000}).concat(east.query(0.01, 10, {tolerance: 20000}));
+  assert.ok(names(separate).filter(function(name) { return name === 'line'; }).length > 1);
+  function check(features) {
+    assert.deepEqual(names(features).sort(), ['line', 'point']);
+    for (var i = 1; i < features.length; ++i) {
+      assert.ok(features[i - 1].distance <= features[i].distance);
+    }
+  }
+  check(mapnik.VectorTile.queryTiles([west, east], 0.01, 10, {tolerance: 20000}));
+  check(mapnik.VectorTile.queryTiles([west, east], 0.01, 10, {tolerance: 20000, layer: 'layer-name', threading_mode: mapnik.threadingMode.deferred}));
+  assert.deepEqual(mapnik.VectorTile.queryTiles([], 0.01, 10), []);
+  mapnik.VectorTile.queryTiles([west, east], 0.01, 10, {tolerance: 20000}, function(err, features) {
+    assert.ifError(err);
+    check(features);
+    assert.end();
+  });
+});
+
+// Encodes a tile with a single layer 'points' of point features, given as
+// [x, y] in tile units or [x, y, id].
+function encodePoints(points) {
+  function varint(n) {
+    var bytes = [];
+    while (n > 127) {
+      bytes.push((n & 127) | 128);
+      n = Math.floor(n / 128);
+    }
+    bytes.push(n);
+    return bytes;
+  }
+  function zigzag(n) {
+    return (n << 1) ^ (n >> 31);
+  }
+  function message(tag, bytes) {
+    return [(tag << 3) | 2].concat(varint(bytes.length), bytes);
+  }
+  var layer = [0x78, 2].concat(message(1, Array.from(Buffer.from('points'))));
+  points.forEach(function(point) {
+    var feature = point.length > 2 ? [0x08].concat(varint(point[2])) : [];
+    feature = feature.concat([0x18, 1], message(4, [9].concat(varint(zigzag(point[0])), varint(zigzag(point[1])))));
+    layer = layer.concat(message(2, feature));
+  });
+  layer = layer.concat([0x28], varint(4096));
+  return Buffer.from(message(3, layer));
+}
+
+test('queryTiles keeps features without an id apart', (assert) => {
+  // Both tiles hold two id-less points on their shared edge, numbered 1 and 2
+  // by their position in each tile.
+  var west = new mapnik.VectorTile(1,0,0);
+  west.setData(encodePoints([[4096, 2048], [4090, 2048]]));
+  var east = new mapnik.VectorTile(1,1,0);
+  east.setData(encodePoints([[0, 2048], [6, 2048]]));
+  var lon = 0, lat = 66.51326044311186, options = {tolerance: 100000};
+  var separate = west.query(lon, lat, options).concat(east.query(lon, lat, options));
+  assert.equal(separate.length, 4);
+  assert.deepEqual(separate.map(function(f) { return f.id(); }).sort(), [1, 1, 2, 2]);
+  assert.equal(mapnik.VectorTile.queryTiles([west, east], lon, lat, options).length, 4);
+  // Features sharing an id within a tile are kept, and ids are matched
+  // across tiles only when they are encoded.
+  var shared = new mapnik.VectorTile(1,0,0);
+  shared.setData(encodePoints([[4096, 2048, 7], [4090, 2048, 7]]));
+  assert.equal(shared.query(lon, lat, options).length, 2);
+  assert.equal(mapnik.VectorTile.queryTiles([shared], lon, lat, options).length, 2);
+  var west_id = new mapnik.VectorTile(1,0,0);
+  west_id.setData(encodePoints([[4096, 2048, 7]]));
+  var east_id = new mapnik.VectorTile(1,1,0);
+  east_id.setData(encodePoints([[0, 2048, 7], [6, 2048]]));
+  var merged = mapnik.VectorTile.queryTiles([west_id, east_id], lon, lat, options);
+  assert.deepEqual(merged.map(function(f) { return f.id(); }).sort(), [2, 7]);
+  mapnik.VectorTile.queryTiles([west, east], lon, lat, options, function(err, features) {
+    assert.ifError(err);
+    assert.equal(features.length, 4);
+    assert.end();
+  });
+});
+
 /*
 test('mapnik.VectorTile query point', (assert) => {
   vtile = new mapnik.VectorTile(0,0,0);
@@ -119,6 +119,40 @@ test('vtile.queryMany async', (assert) => {
   });
 });
 
+test('vtile.queryMany columnar', (assert) => {
+  var vtile = new mapnik.VectorTile(0,0,0);
+  vtile.addGeoJSON(JSON.stringify(geojson),"layer-name");
+  assert.throws(function() { vtile.queryMany([[0,0]], {layer:'layer-name', columnar:1}); });
+  var points = [[0,0],[0,0],[-40,-40]];
+  var options = {tolerance:1e9,fields:['name'],layer:'layer-name',columnar:true};
+  function checkColumns(columns) {
+    var objects = vtile.queryMany(points, {tolerance:1e9,fields:['name'],layer:'layer-name'});
+    assert.ok(columns.hits.point instanceof Uint32Array);
+    assert.ok(columns.hits.feature instanceof Uint32Array);
+    assert.ok(columns.hits.distance instanceof Float64Array);
+    assert.ok(columns.features.id instanceof Float64Array);
+    var i = 0;
+    objects.hits.forEach(function(hits, p) {
+      hits.forEach(function(hit) {
+        assert.equal(columns.hits.point[i], p);
+        assert.equal(columns.hits.feature[i], hit.feature_id);
+        assert.equal(columns.hits.distance[i], hit.distance);
+        ++i;
+      });
+    });
+    assert.equal(columns.hits.point.length, i);
+    assert.deepEqual(Array.from(columns.features.id), [1, 3]);
+    assert.equal(columns.features.layer, 'layer-name');
+    assert.deepEqual(columns.features.attributes, {name: ['A', 'B']});
+  }
+  checkColumns(vtile.queryMany(points, options));
+  vtile.queryMany(points, options, function(err, columns) {
+    assert.ifError(err);
+    checkColumns(columns);
+    assert.end();
+  });
+});
+
 test('vtile.queryMany concurrent x4', (assert) => {
   var remaining = 4;
   function run() {
@@ -191,6 +225,25 @@ test('vtile.queryMany profile x10 runs', (assert) => {
   run();
 });
 
+test('vtile.queryMany matches one query per point', (assert) => {
+  var points = [];
+  for (var lon = -170; lon < 180; lon += 10) {
+    for (var lat = -60; lat < 80; lat += 7) {
+      points.push([lon + 0.5, lat + 0.25]);
+    }
+  }
+  var manyResults = profile.queryMany(points, {tolerance:100000, layer:'world'});
+  var total = 0;
+  points.forEach(function(pt, i) {
+    var expected = profile.query(pt[0], pt[1], {tolerance:100000, layer:'world'}).map(function(f) { return f.id(); });
+    var actual = (manyResults.hits[i] || []).map(function(hit) { return manyResults.features[hit.feature_id].id(); });
+    assert.deepEqual(actual.sort(), expected.sort(), 'hits for point ' + i);
+    total += actual.length;
+  });
+  assert.ok(total > 0);
+  assert.end();
+});
+
 function check(assert, manyResults) {
   assert.equal(Array.isArray(manyResults.hits), true);
   assert.equal(manyResults.hits.length, 3);
@@ -180,7 +180,13 @@ test('should fail when adding bad parameters to add geoJSON', (assert) => {
   assert.throws(function() { vtile.addGeoJSON(geo_str, "layer", {process_all_rings:null}); });
   assert.throws(function() { vtile.addGeoJSON(geo_str, "layer", {simplify_distance:null}); });
   assert.throws(function() { vtile.addGeoJSON(geo_str, "layer", {simplify_distance:-0.5}); });
-  assert.end();
+  assert.throws(function() { vtile.addGeoJSON({}, "layer", function() {}); });
+  assert.throws(function() { vtile.addGeoJSON(geo_str, function() {}); });
+  assert.throws(function() { vtile.addGeoJSON(geo_str, "layer", null, function() {}); });
+  vtile.addGeoJSON('asdf', 'layer-a', function(err) {
+    assert.ok(err);
+    assert.end();
+  });
 });
 
 test('should be able to create a vector tile from geojson', (assert) => {
@@ -622,6 +628,354 @@ test('should be able to create a vector tile from multiple geojson files', (asse
   });
 });
 
+test('toGeoJSON writes properties and geometries of all types', (assert) => {
+  var vtile = new mapnik.VectorTile(0,0,0);
+  var geojson = {
+    "type": "FeatureCollection",
+    "features": [
+      {
+        "type": "Feature",
+        "geometry": { "type": "Point", "coordinates": [ -122, 48 ] },
+        "properties": { "name": "quote \" backslash \\ newline \n tab \t", "int": -42, "double": 0.1, "bool": false }
+      },
+      {
+        "type": "Feature",
+        "geometry": { "type": "MultiPoint", "coordinates": [ [ -122, 48 ], [ 10, 10 ] ] },
+        "properties": { "unicode": "Zürich 東京" }
+      },
+      {
+        "type": "Feature",
+        "geometry": { "type": "LineString", "coordinates": [ [ -10, -10 ], [ 10, 10 ], [ 20, 0 ] ] },
+        "properties": {}
+      },
+      {
+        "type": "Feature",
+        "geometry": { "type": "MultiLineString", "coordinates": [ [ [ -10, -10 ], [ 10, 10 ] ], [ [ 20, 20 ], [ 30, 20 ] ] ] },
+        "properties": {}
+      },
+      {
+        "type": "Feature",
+        "geometry": { "type": "Polygon", "coordinates": [ [ [ -10, -10 ], [ 10, -10 ], [ 10, 10 ], [ -10, 10 ], [ -10, -10 ] ] ] },
+        "properties": {}
+      }
+    ]
+  };
+  vtile.addGeoJSON(JSON.stringify(geojson), "layer");
+  var out = JSON.parse(vtile.toGeoJSONSync('layer'));
+  assert.equal(out.features.length, 5);
+  assert.deepEqual(out.features.map(function(f) { return f.geometry.type; }),
+                   ['Point', 'MultiPoint', 'LineString', 'MultiLineString', 'Polygon']);
+  assert.deepEqual(out.features[0].properties, geojson.features[0].properties);
+  assert.deepEqual(Object.keys(out.features[0].properties), ['bool', 'double', 'int', 'name']);
+  assert.deepEqual(out.features[1].properties, geojson.features[1].properties);
+  assert.equal(out.features[4].geometry.coordinates[0].length, 5);
+  out.features.slice(0, 4).forEach(function(feature, i) {
+    var expected = JSON.stringify(geojson.features[i].geometry.coordinates);
+    var actual = JSON.stringify(feature.geometry.coordinates, function(key, val) {
+      return typeof val === 'number' ? Math.round(val) : val;
+    });
+    assert.equal(actual, expected);
+  });
+  assert.end();
+});
+
+test('toGeoJSON rounds coordinates to the requested precision', (assert) => {
+  var vtile = new mapnik.VectorTile(14,2621,6332);
+  var features = [];
+  for (var i = 0; i < 10; ++i) {
+    features.push({
+      "type": "Feature",
+      "geometry": { "type": "LineString", "coordinates": [ [ -122.405 + i * 0.0001, 37.78 ], [ -122.401, 37.7805 + i * 0.0001 ] ] },
+      "properties": { "ratio": 1 / 3 }
+    });
+  }
+  vtile.addGeoJSON(JSON.stringify({ "type": "FeatureCollection", "features": features }), "layer");
+  var full = JSON.parse(vtile.toGeoJSONSync(0));
+  function decimals(value) {
+    var str = String(value);
+    return str.indexOf('.') < 0 ? 0 : str.length - str.indexOf('.') - 1;
+  }
+  function compare(out, max_decimals, tolerance) {
+    assert.equal(out.features.length, full.features.length);
+    out.features.forEach(function(feature, i) {
+      assert.equal(feature.properties.ratio, 1 / 3);
+      feature.geometry.coordinates.forEach(function(pt, j) {
+        var expected = full.features[i].geometry.coordinates[j];
+        for (var k = 0; k < 2; ++k) {
+          assert.ok(decimals(pt[k]) <= max_decimals);
+          assert.ok(Math.abs(pt[k] - expected[k]) <= tolerance);
+        }
+      });
+    });
+  }
+  var json = vtile.toGeoJSONSync(0, { precision: 3 });
+  compare(JSON.parse(json), 3, 0.0006);
+  // a grid unit at z14 is about 5e-6 degrees of longitude
+  var auto = vtile.toGeoJSONSync(0, { precision: 'auto' });
+  compare(JSON.parse(auto), 7, 0.0000001);
+  assert.ok(auto.length < vtile.toGeoJSONSync(0).length);
+  vtile.toGeoJSON(0, { precision: 3 }, function(err, async_json) {
+    assert.ifError(err);
+    assert.equal(async_json, json);
+    streamGeoJSON(vtile, '__all__', { precision: 'auto', chunk_features: 3 }, function(err, chunks) {
+      assert.ifError(err);
+      assert.equal(chunks.join(''), vtile.toGeoJSONSync('__all__', { precision: 'auto' }));
+      assert.end();
+    });
+  });
+});
+
+test('toGeoJSON only writes the features and properties asked for', (assert) => {
+  var vtile = new mapnik.VectorTile(0,0,0);
+  var features = [];
+  for (var i = 0; i < 10; ++i) {
+    features.push({
+      "type": "Feature",
+      "geometry": i % 2 ?
+        { "type": "Point", "coordinates": [ -100 + i * 20, i * 5 ] } :
+        { "type": "Polygon", "coordinates": [ [ [ -100 + i * 20, i * 5 ], [ -95 + i * 20, i * 5 ], [ -95 + i * 20, 5 + i * 5 ], [ -100 + i * 20, i * 5 ] ] ] },
+      "properties": { "index": i, "name": "feature " + i, "odd": i % 2 === 1 }
+    });
+  }
+  vtile.addGeoJSON(JSON.stringify({ "type": "FeatureCollection", "features": features }), "layer");
+  var all = JSON.parse(vtile.toGeoJSONSync('__all__')).features;
+  assert.equal(all.length, 10);
+  function indexes(json) {
+    return JSON.parse(json).features.map(function(f) { return f.properties.index; });
+  }
+  var bbox = [-57, 0, 10, 22];
+  assert.deepEqual(indexes(vtile.toGeoJSONSync('__all__', { bbox: bbox })), [2, 3, 4]);
+  assert.deepEqual(indexes(vtile.toGeoJSONSync('__all__', { bbox: [-180, -85, 180, 85] })), all.map(function(f) { return f.properties.index; }));
+  assert.deepEqual(indexes(vtile.toGeoJSONSync('__all__', { bbox: [150, -80, 160, -70] })), []);
+  var filter = new mapnik.Expression("[odd] = true and [index] > 4");
+  assert.deepEqual(indexes(vtile.toGeoJSONSync(0, { filter: filter })), [5, 7, 9]);
+  assert.deepEqual(indexes(vtile.toGeoJSONSync(0, { filter: filter, bbox: [-10, 20, 50, 40] })), [5, 7]);
+  var selected = JSON.parse(vtile.toGeoJSONSync('layer', { properties: ['index', 'missing'] }));
+  assert.equal(selected.features.length, 10);
+  selected.features.forEach(function(f, i) {
+    assert.deepEqual(f.properties, { index: i });
+  });
+  var none = JSON.parse(vtile.toGeoJSONSync('layer', { properties: [] }));
+  assert.deepEqual(none.features[0].properties, {});
+  // the filter sees every property, not only the selected ones
+  var options = { filter: filter, properties: ['name'] };
+  var json = vtile.toGeoJSONSync('__array__', options);
+  assert.deepEqual(JSON.parse(json)[0].features.map(function(f) { return f.properties; }),
+                   [ { name: 'feature 5' }, { name: 'feature 7' }, { name: 'feature 9' } ]);
+  vtile.toGeoJSON('__array__', options, function(err, async_json) {
+    assert.ifError(err);
+    assert.equal(async_json, json);
+    streamGeoJSON(vtile, '__array__', Object.assign({ chunk_features: 1 }, options), function(err, chunks) {
+      assert.ifError(err);
+      assert.equal(chunks.join(''), json);
+      assert.end();
+    });
+  });
+});
+
+function streamGeoJSON(vtile, layer, options, callback) {
+  var chunks = [];
+  var opts = Object.assign({}, options, {
+    on_chunk: function(chunk, next) {
+      chunks.push(chunk);
+      setImmediate(next);
+    }
+  });
+  vtile.toGeoJSON(layer, opts, function(err) {
+    callback(err, chunks);
+  });
+}
+
+test('toGeoJSON streams chunks that join to the full output', (assert) => {
+  var vtile = new mapnik.VectorTile(0,0,0);
+  var features = [];
+  for (var i = 0; i < 25; ++i) {
+    features.push({
+      "type": "Feature",
+      "geometry": { "type": "Point", "coordinates": [ -120 + i, 40 + i ] },
+      "properties": { "id": i }
+    });
+  }
+  vtile.addGeoJSON(JSON.stringify({ "type": "FeatureCollection", "features": features }), "one");
+  vtile.addGeoJSON(JSON.stringify({ "type": "FeatureCollection", "features": features.slice(0, 3) }), "two");
+  var expected_all = vtile.toGeoJSONSync('__all__');
+  var expected_array = vtile.toGeoJSONSync('__array__');
+  var expected_two = vtile.toGeoJSONSync('two');
+  var expected_first = vtile.toGeoJSONSync(0);
+  streamGeoJSON(vtile, '__all__', { chunk_features: 10 }, function(err, chunks) {
+    assert.ifError(err);
+    assert.equal(chunks.length, 3);
+    assert.equal(chunks.join(''), expected_all);
+    streamGeoJSON(vtile, '__array__', { chunk_features: 1 }, function(err, chunks) {
+      assert.ifError(err);
+      assert.equal(chunks.length, 29);
+      assert.equal(chunks.join(''), expected_array);
+      streamGeoJSON(vtile, 'two', {}, function(err, chunks) {
+        assert.ifError(err);
+        assert.equal(chunks.length, 1);
+        assert.equal(chunks.join(''), expected_two);
+        streamGeoJSON(vtile, 0, { chunk_features: 7 }, function(err, chunks) {
+          assert.ifError(err);
+          assert.equal(chunks.join(''), expected_first);
+          assert.end();
+        });
+      });
+    });
+  });
+});
+
+test('addGeoJSON reads Buffers and strings, sync and async, the same', (assert) => {
+  var features = [];
+  for (var i = 0; i < 20; ++i) {
+    features.push({
+      "type": "Feature",
+      "geometry": i % 2 ?
+        { "type": "LineString", "coordinates": [ [ -120 + i, 40 ], [ -119 + i, 41.5 ] ] } :
+        { "type": "Polygon", "coordinates": [ [ [ i, i ], [ i + 1, i ], [ i + 1, i + 1 ], [ i, i ] ] ] },
+      "properties": { "name": "feature \"" + i + "\" \u00e9", "index": i, "ratio": i / 3, "odd": i % 2 === 1, "nothing": null }
+    });
+  }
+  var geo_str = JSON.stringify({ "type": "FeatureCollection", "features": features });
+  var expected = new mapnik.VectorTile(0,0,0);
+  assert.equal(expected.addGeoJSON(geo_str, "layer", { simplify_distance: 1.0 }), true);
+  var out = JSON.parse(expected.toGeoJSONSync(0));
+  assert.equal(out.features.length, 20);
+  assert.equal(out.features[0].id, 1);
+  assert.deepEqual(out.features[3].properties, { "name": "feature \"3\" \u00e9", "index": 3, "ratio": 1, "odd": true });
+  var from_buffer = new mapnik.VectorTile(0,0,0);
+  from_buffer.addGeoJSON(Buffer.from(geo_str), "layer", { simplify_distance: 1.0 });
+  assert.deepEqual(from_buffer.getData(), expected.getData());
+  var async_buffer = new mapnik.VectorTile(0,0,0);
+  async_buffer.addGeoJSON(Buffer.from(geo_str), "layer", { simplify_distance: 1.0 }, function(err) {
+    assert.ifError(err);
+    assert.deepEqual(async_buffer.getData(), expected.getData());
+    var sync_string = new mapnik.VectorTile(0,0,0);
+    sync_string.addGeoJSON(geo_str, "layer");
+    var async_string = new mapnik.VectorTile(0,0,0);
+    async_string.addGeoJSON(geo_str, "layer", function(err) {
+      assert.ifError(err);
+      assert.deepEqual(async_string.getData(), sync_string.getData());
+      assert.end();
+    });
+  });
+});
+
+test('addGeoJSON still reads GeoJSON with nested properties', (assert) => {
+  var vtile = new mapnik.VectorTile(0,0,0);
+  vtile.addGeoJSON(JSON.stringify({
+    "type": "FeatureCollection",
+    "features": [{
+      "type": "Feature",
+      "geometry": { "type": "Point", "coordinates": [ -122, 48 ] },
+      "properties": { "name": "nested", "tags": { "a": 1 } }
+    }]
+  }), "layer");
+  var out = JSON.parse(vtile.toGeoJSONSync(0));
+  assert.equal(out.features.length, 1);
+  assert.equal(out.features[0].properties.name, 'nested');
+  assert.end();
+});
+
+test('addGeoJSON encodes the same tile as the geojson plugin', (assert) => {
+  var features = [
+    { "type": "Feature", "geometry": { "type": "Point", "coordinates": [ -122, 48 ] }, "properties": { "name": "point" } },
+    { "type": "Feature", "geometry": { "type": "LineString", "coordinates": [ [ -120, 40 ], [ -110, 42 ], [ -100, 35 ] ] }, "properties": { "name": "line" } },
+    // unclosed ring
+    { "type": "Feature", "geometry": { "type": "Polygon", "coordinates": [ [ [ 0, 0 ], [ 10, 0 ], [ 10, 10 ], [ 0, 10 ] ] ] }, "properties": { "name": "open" } },
+    // clockwise exterior ring, counterclockwise hole
+    { "type": "Feature", "geometry": { "type": "Polygon", "coordinates": [
+      [ [ 20, 20 ], [ 20, 40 ], [ 40, 40 ], [ 40, 20 ], [ 20, 20 ] ],
+      [ [ 25, 25 ], [ 35, 25 ], [ 35, 35 ], [ 25, 35 ], [ 25, 25 ] ]
+    ] }, "properties": { "name": "clockwise" } },
+    { "type": "Feature", "geometry": { "type": "MultiPolygon", "coordinates": [
+      [ [ [ -40, -40 ], [ -40, -20 ], [ -20, -20 ], [ -20, -40 ] ] ],
+      [ [ [ -60, -60 ], [ -50, -60 ], [ -50, -50 ], [ -60, -50 ], [ -60, -60 ] ] ]
+    ] }, "properties": { "name": "multi" } }
+  ];
+  var read = new mapnik.VectorTile(0,0,0);
+  read.addGeoJSON(JSON.stringify({ "type": "FeatureCollection", "features": features }), "layer");
+  // A nested property makes addGeoJSON hand the document to the plugin. It
+  // is on a last feature without a geometry, which is not encoded.
+  var plugin = new mapnik.VectorTile(0,0,0);
+  plugin.addGeoJSON(JSON.stringify({ "type": "FeatureCollection", "features": features.concat([
+    { "type": "Feature", "geometry": null, "properties": { "nested": { "a": 1 } } }
+  ]) }), "layer");
+  assert.equal(JSON.parse(read.toGeoJSONSync(0)).features.length, 5);
+  assert.deepEqual(read.getData(), plugin.getData());
+  assert.end();
+});
+
+test('toGeoJSON stream waits for next and ignores later changes to the tile', (assert) => {
+  var vtile = new mapnik.VectorTile(0,0,0);
+  var features = [];
+  for (var i = 0; i < 4; ++i) {
+    features.push({
+      "type": "Feature",
+      "geometry": { "type": "Point", "coordinates": [ i, i ] },
+      "properties": { "id": i }
+    });
+  }
+  vtile.addGeoJSON(JSON.stringify({ "type": "FeatureCollection", "features": features }), "layer");
+  var expected = vtile.toGeoJSONSync('__all__');
+  var chunks = [];
+  var paused = null;
+  vtile.toGeoJSON('__all__', {
+    chunk_features: 1,
+    on_chunk: function(chunk, next) {
+      chunks.push(chunk);
+      if (chunks.length === 1) {
+        paused = next;
+        vtile.clear(function() {});
+        return;
+      }
+      next();
+      // calling it twice does not skip a chunk
+      next();
+    }
+  }, function(err) {
+    assert.ifError(err);
+    assert.equal(chunks.join(''), expected);
+    assert.end();
+  });
+  setTimeout(function() {
+    assert.equal(chunks.length, 1);
+    paused();
+  }, 50);
+});
+
+test('toGeoJSON reports an error thrown by on_chunk and stops the stream', (assert) => {
+  var vtile = new mapnik.VectorTile(0,0,0);
+  var features = [];
+  for (var i = 0; i < 5; ++i) {
+    features.push({
+      "type": "Feature",
+      "geometry": { "type": "Point", "coordinates": [ i, i ] },
+      "properties": { "id": i }
+    });
+  }
+  vtile.addGeoJSON(JSON.stringify({ "type": "FeatureCollection", "features": features }), "layer");
+  var calls = 0;
+  var kept = null;
+  vtile.toGeoJSON('__all__', {
+    chunk_features: 1,
+    on_chunk: function(chunk, next) {
+      ++calls;
+      kept = next;
+      throw new Error('consumer failed');
+    }
+  }, function(err) {
+    assert.ok(err);
+    assert.equal(err.message, 'consumer failed');
+    assert.equal(calls, 1);
+    // the stream is over, resuming it does nothing
+    kept();
+    setTimeout(function() {
+      assert.equal(calls, 1);
+      assert.end();
+    }, 20);
+  });
+});
+
 test('toGeoJSON should fail with invalid useage', (assert) => {
   var vtile = new mapnik.VectorTile(0,0,0);
   assert.throws(function() { vtile.toGeoJSONSync(); });
@@ -667,6 +1021,18 @@ test('toGeoJSON should fail with invalid useage', (assert) => {
   assert.throws(function() { vtile.toGeoJSON(-1, function(err, jstr) {}) });
   assert.throws(function() { vtile.toGeoJSON('foo', function(err, jstr) {}) });
   assert.throws(function() { vtile.toGeoJSON(null, function(err, jstr) {}) });
+  assert.throws(function() { vtile.toGeoJSONSync(0, null); });
+  assert.throws(function() { vtile.toGeoJSONSync(0, { precision: -1 }); });
+  assert.throws(function() { vtile.toGeoJSONSync(0, { precision: 16 }); });
+  assert.throws(function() { vtile.toGeoJSONSync(0, { precision: 2.5 }); });
+  assert.throws(function() { vtile.toGeoJSONSync(0, { precision: 'full' }); });
+  assert.throws(function() { vtile.toGeoJSON(0, { precision: null }, function(err, jstr) {}) });
+  assert.throws(function() { vtile.toGeoJSONSync(0, { bbox: [0, 0, 1] }); });
+  assert.throws(function() { vtile.toGeoJSONSync(0, { bbox: [0, 0, 1, 'a'] }); });
+  assert.throws(function() { vtile.toGeoJSONSync(0, { bbox: [1, 0, 0, 1] }); });
+  assert.throws(function() { vtile.toGeoJSONSync(0, { filter: '[name] = 1' }); });
+  assert.throws(function() { vtile.toGeoJSONSync(0, { properties: 'name' }); });
+  assert.throws(function() { vtile.toGeoJSON(0, { properties: [1] }, function(err, jstr) {}) });
 
   assert.end();
 });
@@ -861,6 +1227,45 @@ test('should create empty buffer with getData with no data provided.', (assert)
   });
 });
 
+test('getData buffers keep their bytes when the tile changes', (assert) => {
+  var data = fs.readFileSync("./test/data/vector_tile/tile1.vector.pbf");
+  var geojson = JSON.stringify({
+    type: 'Feature',
+    geometry: { type: 'Point', coordinates: [-101, 39] },
+    properties: { name: 'point' }
+  });
+  var vtile = new mapnik.VectorTile(9,112,195);
+  vtile.setData(data);
+  var expected = Buffer.from(vtile.getData());
+  var first = vtile.getData();
+  assert.deepEqual(vtile.getData(), first);
+  vtile.addGeoJSON(geojson, 'points');
+  assert.deepEqual(first, expected);
+  assert.deepEqual(vtile.names(), ['world', 'world2', 'points']);
+  var added = vtile.getData();
+  vtile.clearSync();
+  assert.deepEqual(first, expected);
+  var copy = new mapnik.VectorTile(9,112,195);
+  copy.setData(added);
+  assert.deepEqual(copy.names(), ['world', 'world2', 'points']);
+  assert.equal(vtile.getData().length, 0);
+  vtile.setData(data);
+  vtile.getData(function(err, shared) {
+    if (err) throw err;
+    assert.deepEqual(shared, expected);
+    var released = vtile.getData({release: true});
+    assert.deepEqual(released, expected);
+    assert.deepEqual(shared, expected);
+    assert.equal(vtile.getData().length, 0);
+    vtile.setData(data, function(err) {
+      if (err) throw err;
+      assert.deepEqual(shared, expected);
+      assert.deepEqual(vtile.getData(), expected);
+      assert.end();
+    });
+  });
+});
+
 test('should return the correct bufferedExtent', (assert) => {
   var vtile = new mapnik.VectorTile(9,112,195);
   var extent = vtile.bufferedExtent();
@@ -1792,6 +2197,55 @@ test('should be able to get tile info as JSON with decoded geometry', (assert) =
   assert.end();
 });
 
+test('should be able to get tile info as JSON asynchronously', (assert) => {
+  var vtile = new mapnik.VectorTile(9,112,195);
+  vtile.setData(Buffer.from(_data,"hex"));
+  var expected = vtile.toJSON();
+  var expected_decoded = vtile.toJSON({decode_geometry:true});
+  vtile.toJSON(function(err, json) {
+    assert.ifError(err);
+    assert.deepEqual(json, expected);
+    vtile.toJSON({decode_geometry:true}, function(err, json) {
+      assert.ifError(err);
+      assert.deepEqual(json, expected_decoded);
+      assert.end();
+    });
+  });
+});
+
+test('should be able to get tile geometries as typed arrays from toJSON', (assert) => {
+  var vtile = new mapnik.VectorTile(9,112,195);
+  vtile.setData(Buffer.from(_data,"hex"));
+  var expected = vtile.toJSON();
+  var typed = vtile.toJSON({typed_geometry:true});
+  assert.equal(typed.length, expected.length);
+  typed.forEach(function(layer, i) {
+    assert.equal(layer.name, expected[i].name);
+    var feature = layer.features[0];
+    assert.ok(feature.geometry instanceof Uint32Array);
+    assert.deepEqual(Array.from(feature.geometry), expected[i].features[0].geometry);
+    assert.deepEqual(feature.properties, expected[i].features[0].properties);
+  });
+  vtile.toJSON({decode_geometry:true, typed_geometry:true}, function(err, json) {
+    assert.ifError(err);
+    assert.equal(json.length, 2);
+    json.forEach(function(layer) {
+      var feature = layer.features[0];
+      assert.equal(feature.geometry_type, 'Polygon');
+      assert.ok(feature.geometry instanceof Int32Array);
+      assert.deepEqual(Array.from(feature.geometry), [4224,-128,4224,4224,-128,4224,-128,-128,4224,-128]);
+      assert.deepEqual(Array.from(feature.geometry_parts), [5]);
+      assert.deepEqual(Array.from(feature.geometry_polygons), [1]);
+      // all views of a layer share one buffer
+      assert.equal(feature.geometry.buffer, feature.geometry_parts.buffer);
+      assert.equal(feature.geometry.byteOffset, 0);
+      assert.equal(feature.geometry_parts.byteOffset, 40);
+    });
+    assert.notEqual(json[0].features[0].geometry.buffer, json[1].features[0].geometry.buffer);
+    assert.end();
+  });
+});
+
 test('should be able to get tile info as various flavors of GeoJSON', (assert) => {
   var vtile = new mapnik.VectorTile(9,112,195);
   vtile.setData(Buffer.from(_data,"hex"));
@@ -1866,6 +2320,8 @@ test('should fail to parse toJSON due to bad input', (assert) => {
   var vtile = new mapnik.VectorTile(0,0,0);
   assert.throws(function() { vtile.toJSON(null) });
   assert.throws(function() { vtile.toJSON({decode_geometry:null}) });
+  assert.throws(function() { vtile.toJSON({typed_geometry:null}) });
+  assert.throws(function() { vtile.toJSON(null, function() {}) });
   assert.end();
 });
 